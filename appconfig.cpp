@@ -0,0 +1,56 @@
+#include "appconfig.h"
+#include <QSettings>
+#include <QtGlobal>
+
+AppConfig AppConfig::fromSettings(const QSettings& settings)
+{
+    AppConfig config;
+
+    config.tmdbApiKey = settings.value("Settings/tmdb_api_key").toString();
+    config.tmdbApiBaseUrl = settings.value("Settings/tmdb_api_base_url", config.tmdbApiBaseUrl).toString();
+
+    config.posterCacheBytes = settings.value("Settings/poster_cache_bytes",
+                                             config.posterCacheBytes).toLongLong();
+    config.posterMemoryCacheBytes = settings.value("Settings/poster_memory_cache_bytes",
+                                                   config.posterMemoryCacheBytes).toLongLong();
+    config.searchCacheTtlSeconds = qMax(0, settings.value("Settings/search_cache_ttl_seconds",
+                                                          config.searchCacheTtlSeconds).toInt());
+    config.configurationCacheTtlSeconds = qMax(0, settings.value("Settings/configuration_cache_ttl_seconds",
+                                                                 config.configurationCacheTtlSeconds).toInt());
+    config.tmdbRequestsPerSecond = settings.value("Settings/tmdb_requests_per_second",
+                                                  config.tmdbRequestsPerSecond).toDouble();
+    config.tmdbMaxInFlight = qMax(1, settings.value("Settings/tmdb_max_in_flight",
+                                                    config.tmdbMaxInFlight).toInt());
+    config.tmdbMaxRetries = qMax(0, settings.value("Settings/tmdb_max_retries",
+                                                   config.tmdbMaxRetries).toInt());
+    config.safeWrites = settings.value("Settings/safe_writes", config.safeWrites).toBool();
+
+    config.maxConcurrentLookups = qMax(1, settings.value("Batch/max_concurrent_lookups",
+                                                         config.maxConcurrentLookups).toInt());
+    config.maxConcurrentWrites = qMax(1, settings.value("Batch/max_concurrent_writes",
+                                                        config.maxConcurrentWrites).toInt());
+    config.maxWritesPerDevice = qMax(1, settings.value("Batch/max_writes_per_device",
+                                                       config.maxWritesPerDevice).toInt());
+    config.queueCapacity = qMax(1, settings.value("Batch/queue_capacity",
+                                                  config.queueCapacity).toInt());
+    config.maxImageBytesInFlight = qMax<qint64>(1, settings.value("Batch/max_image_bytes_in_flight",
+                                                                  config.maxImageBytesInFlight).toLongLong());
+    config.useLibraryIndex = settings.value("Batch/library_index", config.useLibraryIndex).toBool();
+    config.libraryIndexFile = settings.value("Batch/library_index_file", config.libraryIndexFile).toString();
+    config.skipFilesWithCover = settings.value("Batch/skip_files_with_cover", config.skipFilesWithCover).toBool();
+
+    config.watchSettleSeconds = qMax(1, settings.value("Watch/settle_seconds",
+                                                       config.watchSettleSeconds).toInt());
+
+    config.metricsFile = settings.value("Metrics/file", config.metricsFile).toString();
+    config.metricsFormat = settings.value("Metrics/format", config.metricsFormat).toString();
+    config.metricsIntervalSeconds = qMax(1, settings.value("Metrics/interval_seconds",
+                                                           config.metricsIntervalSeconds).toInt());
+
+    config.matchThreshold = qBound(0.0, settings.value("Matching/threshold", config.matchThreshold).toDouble(), 1.0);
+    config.matchMinimumMargin = qBound(0.0, settings.value("Matching/minimum_margin",
+                                                           config.matchMinimumMargin).toDouble(), 1.0);
+    config.reviewQueueFile = settings.value("Matching/review_queue_file", config.reviewQueueFile).toString();
+
+    return config;
+}
@@ -0,0 +1,82 @@
+#ifndef APPCONFIG_H
+#define APPCONFIG_H
+
+#include <QString>
+
+class QSettings;
+
+// Settings read from config.ini, shared by the GUI and the batch tagger
+struct AppConfig
+{
+    // TMDb api key
+    QString tmdbApiKey;
+
+    // TMDb API root, empty for api.themoviedb.org. Lets MovieTagBench's stand-in server replace TMDb.
+    QString tmdbApiBaseUrl;
+
+    // Byte budgets of the poster cache on disk and in memory
+    qint64 posterCacheBytes = 256 * 1024 * 1024;
+    qint64 posterMemoryCacheBytes = 32 * 1024 * 1024;
+
+    // How long TMDb search results and movie details are reused, 0 disables both caches
+    int searchCacheTtlSeconds = 60 * 60;
+
+    // Age after which the saved TMDb configuration is fetched again, 0 disables saving it
+    int configurationCacheTtlSeconds = 3 * 24 * 60 * 60;
+
+    // TMDb request rate limit (0 disables it), requests running at once and
+    // retries of requests answered with HTTP 429/5xx
+    double tmdbRequestsPerSecond = 20;
+    int tmdbMaxInFlight = 8;
+    int tmdbMaxRetries = 3;
+
+    // Journal in-place edits and only rewrite files through reflink clones, see MediaTagWriter::setSafeWrites()
+    bool safeWrites = false;
+
+    // Batch mode: maximum number of TMDb lookups (search + poster) in flight
+    int maxConcurrentLookups = 4;
+
+    // Batch mode: maximum number of files being written at the same time
+    int maxConcurrentWrites = 2;
+
+    // Maximum number of files being written at the same time on one storage device
+    int maxWritesPerDevice = 1;
+
+    // Batch mode: maximum number of files waiting between two pipeline stages
+    int queueCapacity = 64;
+
+    // Batch mode: poster bytes held for writes that haven't finished. No new lookups
+    // start while more are in flight, so memory stays flat however large the library.
+    qint64 maxImageBytesInFlight = 64 * 1024 * 1024;
+
+    // Batch mode: skip files the library index lists as tagged and unchanged.
+    // An empty file name uses LibraryIndex::defaultDatabasePath().
+    bool useLibraryIndex = true;
+    QString libraryIndexFile;
+
+    // Batch mode: leave files alone that already have a cover (checked with TagProbe)
+    bool skipFilesWithCover = false;
+
+    // Watch mode: seconds a new file must stay unchanged before it is tagged
+    int watchSettleSeconds = 30;
+
+    // Timings and counters (see Metrics) exported every few seconds, an empty file
+    // name disables the export. Format "jsonl" appends JSON lines, "prometheus"
+    // replaces a Prometheus text file.
+    QString metricsFile;
+    QString metricsFormat = "jsonl";
+    int metricsIntervalSeconds = 60;
+
+    // Automatic matching (see MovieMatcher): the best search result is tagged without
+    // asking if it scores at least matchThreshold and leads the runner-up by
+    // matchMinimumMargin. Batch mode lists other files in the review queue, an empty
+    // file name uses ReviewQueue::defaultFilePath().
+    double matchThreshold = 0.75;
+    double matchMinimumMargin = 0.1;
+    QString reviewQueueFile;
+
+    // Read all known keys, falling back to the defaults above
+    static AppConfig fromSettings(const QSettings& settings);
+};
+
+#endif // APPCONFIG_H
@@ -0,0 +1,174 @@
+#include "batchtagger.h"
+#include "directorywatcher.h"
+#include "tmdbclient.h"
+#include "appconfig.h"
+#include "tagprobe.h"
+#include "metrics.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QSettings>
+#include <QFile>
+#include <QDir>
+#include <QDirIterator>
+#include <QDebug>
+
+// List the files without a cover, nothing is looked up or written
+static int runAudit(const QStringList& directories)
+{
+    int withCover = 0;
+    int withoutCover = 0;
+    int unreadable = 0;
+    qint64 bytesRead = 0;
+
+    for (const QString& directory : directories) {
+        QDirIterator it(directory, QStringList() << "*.mp4" << "*.mkv",
+                        QDir::Files | QDir::Readable, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            QString filePath = it.next();
+            TagProbe probe(filePath);
+            switch (probe.probeCover()) {
+            case TagProbe::CoverState::Present:
+                ++withCover;
+                break;
+            case TagProbe::CoverState::Missing:
+                ++withoutCover;
+                qInfo().noquote() << "No cover:" << filePath;
+                break;
+            case TagProbe::CoverState::Unknown:
+                ++unreadable;
+                qWarning().noquote() << "Can't check" << filePath << "-" << probe.errorString();
+                break;
+            }
+            bytesRead += probe.bytesRead();
+        }
+    }
+
+    qInfo().noquote() << QString("Audit finished: %1 with cover, %2 without, %3 unreadable, %4 KiB read")
+                             .arg(withCover)
+                             .arg(withoutCover)
+                             .arg(unreadable)
+                             .arg(bytesRead / 1024);
+    return withoutCover == 0 ? 0 : 2;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("MovieTagBatch");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Add cover art to all mp4 and mkv files in library directories.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("directories", "Library directories to scan recursively.", "<directory>...");
+    QCommandLineOption configOption("config", "Path to the configuration file.", "file", "config.ini");
+    QCommandLineOption lookupsOption("lookups", "Maximum TMDb lookups in flight.", "count");
+    QCommandLineOption writesOption("writes", "Maximum files written at the same time.", "count");
+    QCommandLineOption forceOption("force", "Tag all files, including those the library index lists as unchanged.");
+    QCommandLineOption auditOption("audit", "Only list the files without a cover, nothing is written.");
+    QCommandLineOption watchOption("watch", "Keep running and tag new files as they appear in the directories.");
+    parser.addOption(configOption);
+    parser.addOption(lookupsOption);
+    parser.addOption(writesOption);
+    parser.addOption(forceOption);
+    parser.addOption(auditOption);
+    parser.addOption(watchOption);
+    parser.process(a);
+
+    const QStringList directories = parser.positionalArguments();
+    if (directories.isEmpty()) {
+        parser.showHelp(1);
+    }
+
+    // The audit needs neither the configuration nor TMDb
+    if (parser.isSet(auditOption)) {
+        return runAudit(directories);
+    }
+
+    // Read the configuration file
+    QString configFilePath = parser.value(configOption);
+    if (!QFile::exists(configFilePath)) {
+        qCritical().noquote() << "Error:" << configFilePath << "file not found!";
+        return 1;
+    }
+
+    QSettings settings(configFilePath, QSettings::IniFormat);
+    AppConfig config = AppConfig::fromSettings(settings);
+    if (config.tmdbApiKey.isEmpty()) {
+        qCritical().noquote() << "Error: Failed to read TMDb API key from" << configFilePath;
+        return 1;
+    }
+
+    // Command line overrides
+    if (parser.isSet(lookupsOption)) {
+        config.maxConcurrentLookups = qMax(1, parser.value(lookupsOption).toInt());
+    }
+    if (parser.isSet(writesOption)) {
+        config.maxConcurrentWrites = qMax(1, parser.value(writesOption).toInt());
+    }
+
+    TmdbClient tmdbClient(config.tmdbApiKey);
+    tmdbClient.setApiBaseUrl(config.tmdbApiBaseUrl);
+    tmdbClient.posterCache().setMaxDiskBytes(config.posterCacheBytes);
+    tmdbClient.posterCache().setMaxMemoryBytes(config.posterMemoryCacheBytes);
+    tmdbClient.setSearchCacheTtl(config.searchCacheTtlSeconds);
+    tmdbClient.setConfigurationCacheTtl(config.configurationCacheTtlSeconds);
+    tmdbClient.requestScheduler().setRequestsPerSecond(config.tmdbRequestsPerSecond);
+    tmdbClient.requestScheduler().setMaxInFlight(config.tmdbMaxInFlight);
+    tmdbClient.requestScheduler().setMaxRetries(config.tmdbMaxRetries);
+    BatchTagger batchTagger(&tmdbClient, config);
+    batchTagger.setForceRetag(parser.isSet(forceOption));
+
+    // Watch mode: files that appear later are handed over once they stopped growing
+    bool watch = parser.isSet(watchOption);
+    DirectoryWatcher directoryWatcher;
+    directoryWatcher.setSettleSeconds(config.watchSettleSeconds);
+    QObject::connect(&directoryWatcher, &DirectoryWatcher::fileReady, &batchTagger, &BatchTagger::addFile);
+
+    for (const QString& directory : directories) {
+        if (!QDir(directory).exists()) {
+            qWarning().noquote() << "Skipping missing directory" << directory;
+            continue;
+        }
+        if (watch) {
+            directoryWatcher.addRoot(directory);
+        }
+        batchTagger.addDirectory(directory);
+    }
+
+    // Metrics are exported periodically and once more whenever the batch is done
+    MetricsExporter metricsExporter;
+    metricsExporter.setFilePath(config.metricsFile);
+    metricsExporter.setFormat(MetricsExporter::formatFromString(config.metricsFormat));
+    metricsExporter.start(config.metricsIntervalSeconds);
+    QObject::connect(&batchTagger, &BatchTagger::finished, &metricsExporter, [&metricsExporter]() {
+        if (!metricsExporter.exportNow()) {
+            qWarning().noquote() << "Couldn't export metrics:" << metricsExporter.errorString();
+        }
+    });
+
+    // Without --watch the batch ends once every file is processed
+    if (!watch) {
+        QObject::connect(&batchTagger, &BatchTagger::finished, &a, [&a, &batchTagger]() {
+            a.exit(batchTagger.failedCount() == 0 ? 0 : 2);
+        });
+    }
+
+    // A watcher without a TMDb configuration would only collect files it can never tag,
+    // nothing asks for the configuration again. Exit so a service manager can restart it.
+    if (watch) {
+        QObject::connect(&tmdbClient, &TmdbClient::error, &a,
+                         [&a](TmdbClient::ErrorSource source, const QString& message) {
+                             if (source == TmdbClient::ErrorSource::Configuration) {
+                                 qCritical().noquote() << "Error: Watch mode stopped, no TMDb configuration:" << message;
+                                 a.exit(1);
+                             }
+                         });
+    }
+
+    // Scanning starts right away, lookups begin once the configuration arrives
+    tmdbClient.getConfiguration();
+    batchTagger.start();
+
+    return a.exec();
+}
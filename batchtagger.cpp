@@ -0,0 +1,465 @@
+#include "batchtagger.h"
+#include "tmdbclient.h"
+#include "releasenameparser.h"
+#include "tagprobe.h"
+#include "metrics.h"
+#include <QTimer>
+#include <QDebug>
+#include <memory>
+
+// Number of directory entries examined per scan step, keeps the event loop responsive
+static const int SCAN_STEP_SIZE = 64;
+
+// Candidates whose runtime is fetched when the search alone doesn't settle the match
+static const int RUNTIME_CANDIDATES = 3;
+
+BatchTagger::BatchTagger(TmdbClient *tmdbClient, const AppConfig& config, QObject *parent)
+    : QObject(parent)
+    , m_tmdbClient(tmdbClient)
+    , m_config(config)
+    , m_libraryIndex(config.libraryIndexFile.isEmpty() ? LibraryIndex::defaultDatabasePath() : config.libraryIndexFile)
+    , m_reviewQueue(config.reviewQueueFile)
+{
+    // Without a usable index every file is tagged, as if it was the first run
+    if (m_config.useLibraryIndex && !m_libraryIndex.open()) {
+        qWarning().noquote() << "Library index unavailable, tagging all files";
+    }
+
+    m_matcher.setThreshold(m_config.matchThreshold);
+    m_matcher.setMinimumMargin(m_config.matchMinimumMargin);
+
+    m_tagWriteQueue.setMaxThreadCount(m_config.maxConcurrentWrites);
+    m_tagWriteQueue.setMaxConcurrentWritesPerDevice(m_config.maxWritesPerDevice);
+    m_tagWriteQueue.setSafeWrites(m_config.safeWrites);
+
+    connect(&m_tagWriteQueue, &TagWriteQueue::jobFinished, this, &BatchTagger::onWriteFinished);
+
+    // Lookups can only download posters once the client is configured
+    connect(m_tmdbClient, &TmdbClient::configurationComplete, this, &BatchTagger::schedulePump);
+
+    // Without a configuration no lookup can succeed, drain the pipeline
+    connect(m_tmdbClient, &TmdbClient::error,
+            this, [this](TmdbClient::ErrorSource source, const QString& message) {
+                if (source != TmdbClient::ErrorSource::Configuration || m_finished) {
+                    return;
+                }
+                qWarning() << "Batch aborted, couldn't get TMDb configuration:" << message;
+                m_pendingRoots.clear();
+                m_pendingFiles.clear();
+                m_scanner.reset();
+                while (!m_lookupQueue.isEmpty()) {
+                    failJob(m_lookupQueue.dequeue(), "TMDb configuration unavailable");
+                }
+                schedulePump();
+            });
+}
+
+BatchTagger::~BatchTagger()
+{
+}
+
+void BatchTagger::addDirectory(const QString& rootPath)
+{
+    m_pendingRoots.append(rootPath);
+    restartIfFinished();
+}
+
+void BatchTagger::addFile(const QString& filePath)
+{
+    m_pendingFiles.append(filePath);
+    restartIfFinished();
+}
+
+void BatchTagger::restartIfFinished()
+{
+    if (!m_started) {
+        return;
+    }
+
+    // New work after finished(), the next summary covers this run only. The stage
+    // timings it lists are the exception, Metrics counts them since startup.
+    if (m_finished) {
+        m_finished = false;
+        m_elapsed.restart();
+        m_peakImageBytesInFlight = m_imageBytesInFlight;
+        m_taggedCount = 0;
+        m_failedCount = 0;
+        m_unchangedCount = 0;
+        m_alreadyCoveredCount = 0;
+        m_reviewCount = 0;
+    }
+    schedulePump();
+}
+
+void BatchTagger::start()
+{
+    m_started = true;
+    m_finished = false;
+    m_elapsed.start();
+    schedulePump();
+}
+
+int BatchTagger::taggedCount() const
+{
+    return m_taggedCount;
+}
+
+int BatchTagger::failedCount() const
+{
+    return m_failedCount;
+}
+
+int BatchTagger::unchangedCount() const
+{
+    return m_unchangedCount;
+}
+
+int BatchTagger::alreadyCoveredCount() const
+{
+    return m_alreadyCoveredCount;
+}
+
+int BatchTagger::reviewCount() const
+{
+    return m_reviewCount;
+}
+
+qint64 BatchTagger::peakImageBytesInFlight() const
+{
+    return m_peakImageBytesInFlight;
+}
+
+void BatchTagger::setForceRetag(bool force)
+{
+    m_forceRetag = force;
+}
+
+void BatchTagger::schedulePump()
+{
+    if (m_pumpScheduled || !m_started) {
+        return;
+    }
+
+    // Coalesce all stage transitions of this event loop iteration into one pump
+    m_pumpScheduled = true;
+    QTimer::singleShot(0, this, &BatchTagger::pump);
+}
+
+void BatchTagger::pump()
+{
+    m_pumpScheduled = false;
+
+    startLookups();
+    scanMore();
+
+    if (isIdle()) {
+        if (!m_finished) {
+            m_finished = true;
+            const PosterCache& posterCache = m_tmdbClient->posterCache();
+            qInfo().noquote() << QString("Batch finished in %1 s: %2 tagged, %3 failed, %4 unchanged, %5 already had a cover, %6 need review")
+                                     .arg(m_elapsed.elapsed() / 1000.0, 0, 'f', 1)
+                                     .arg(m_taggedCount)
+                                     .arg(m_failedCount)
+                                     .arg(m_unchangedCount)
+                                     .arg(m_alreadyCoveredCount)
+                                     .arg(m_reviewCount);
+            if (m_reviewCount > 0) {
+                qInfo().noquote() << "Review queue:" << m_reviewQueue.filePath();
+            }
+            qInfo().noquote() << QString("Poster cache: %1 memory hits, %2 disk hits, %3 misses")
+                                     .arg(posterCache.memoryHits())
+                                     .arg(posterCache.diskHits())
+                                     .arg(posterCache.misses());
+            qInfo().noquote() << QString("Searches: %1 requests, %2 cache hits, %3 coalesced")
+                                     .arg(m_tmdbClient->searchRequests())
+                                     .arg(m_tmdbClient->searchCacheHits())
+                                     .arg(m_tmdbClient->coalescedSearches());
+            qInfo().noquote() << QString("TMDb requests retried after 429/5xx: %1")
+                                     .arg(m_tmdbClient->requestScheduler().retriedRequests());
+            qint64 peakRss = Metrics::peakResidentBytes();
+            qInfo().noquote() << QString("Memory: peak RSS %1, posters in flight peaked at %2 of %3 MiB")
+                                     .arg(peakRss < 0 ? QString("unknown") : QString("%1 MiB").arg(peakRss / (1024.0 * 1024.0), 0, 'f', 1))
+                                     .arg(m_peakImageBytesInFlight / (1024.0 * 1024.0), 0, 'f', 1)
+                                     .arg(m_config.maxImageBytesInFlight / (1024.0 * 1024.0), 0, 'f', 1);
+
+            // Per-stage timings and sizes, counted since the program started
+            const QStringList metricLines = Metrics::instance().summaryLines();
+            if (!metricLines.isEmpty()) {
+                qInfo().noquote() << "Stages:";
+                for (const QString& line : metricLines) {
+                    qInfo().noquote() << "  " + line;
+                }
+            }
+            emit finished();
+        }
+    }
+}
+
+bool BatchTagger::isIdle() const
+{
+    return m_pendingRoots.isEmpty() && m_pendingFiles.isEmpty() && !m_scanner
+           && m_lookupQueue.isEmpty() && m_lookupsInFlight == 0
+           && m_writeJobs.isEmpty();
+}
+
+void BatchTagger::scanMore()
+{
+    int examined = 0;
+    while (m_lookupQueue.size() < m_config.queueCapacity && examined < SCAN_STEP_SIZE) {
+        // Single files first, they were waited for already
+        if (!m_pendingFiles.isEmpty()) {
+            enqueueFile(QFileInfo(m_pendingFiles.takeFirst()));
+            ++examined;
+            continue;
+        }
+
+        if (!m_scanner) {
+            if (m_pendingRoots.isEmpty()) {
+                return;
+            }
+            m_scanner = std::make_unique<QDirIterator>(m_pendingRoots.takeFirst(),
+                                                       QStringList() << "*.mp4" << "*.mkv",
+                                                       QDir::Files | QDir::Readable,
+                                                       QDirIterator::Subdirectories);
+        }
+
+        if (!m_scanner->hasNext()) {
+            m_scanner.reset();
+            continue;
+        }
+
+        enqueueFile(m_scanner->nextFileInfo());
+        ++examined;
+    }
+
+    // More to scan, continue on the next event loop iteration
+    if (examined == SCAN_STEP_SIZE) {
+        schedulePump();
+    }
+}
+
+void BatchTagger::enqueueFile(const QFileInfo& fileInfo)
+{
+    // Files already tagged and unchanged since (same size and time) are skipped
+    if (!m_forceRetag && m_libraryIndex.isUpToDate(fileInfo)) {
+        ++m_unchangedCount;
+        return;
+    }
+
+    // Only reads the metadata headers, never the media data
+    if (m_config.skipFilesWithCover
+        && TagProbe(fileInfo.filePath()).probeCover() == TagProbe::CoverState::Present) {
+        ++m_alreadyCoveredCount;
+        return;
+    }
+
+    Job job;
+    job.filePath = fileInfo.filePath();
+    ReleaseInfo release = ReleaseNameParser::parse(job.filePath);
+    job.searchText = release.title;
+    job.year = release.year;
+    job.fileYear = release.year;
+    m_lookupQueue.enqueue(job);
+}
+
+void BatchTagger::startLookups()
+{
+    if (!m_tmdbClient->isConfigured()) {
+        return;
+    }
+
+    // Backpressure: don't look up more files than the write stage can absorb, neither
+    // in number nor in poster bytes. Lookups already running may overshoot the byte
+    // budget by maxConcurrentLookups posters at most.
+    while (!m_lookupQueue.isEmpty()
+           && m_lookupsInFlight < m_config.maxConcurrentLookups
+           && m_writeJobs.size() + m_lookupsInFlight < m_config.queueCapacity
+           && m_imageBytesInFlight < m_config.maxImageBytesInFlight) {
+        Job job = m_lookupQueue.dequeue();
+        job.lookupTimer.start();
+        ++m_lookupsInFlight;
+
+        m_tmdbClient->searchMovie(job.searchText, job.year, 1, this, [this, job](bool ok, const TmdbClient::SearchPage& page) {
+            onSearchFinished(job, ok, page.movies);
+        });
+    }
+}
+
+void BatchTagger::onSearchFinished(const Job& job, bool ok, const MovieResults& movies)
+{
+    // The year in the file name may be off (e.g. a festival release), try again without it
+    if (ok && movies.isEmpty() && job.year > 0) {
+        Job retryJob = job;
+        retryJob.year = 0;
+        m_tmdbClient->searchMovie(retryJob.searchText, this, [this, retryJob](bool ok, const TmdbClient::SearchPage& page) {
+            onSearchFinished(retryJob, ok, page.movies);
+        });
+        return;
+    }
+
+    if (!ok || movies.isEmpty()) {
+        --m_lookupsInFlight;
+        failJob(job, ok ? QString("No movies found for '%1'").arg(job.searchText)
+                        : QString("Search failed for '%1'").arg(job.searchText));
+        schedulePump();
+        return;
+    }
+
+    // Step 1: Rank the results against the file name, most files are settled here
+    MovieMatcher::Match match = m_matcher.match(job.searchText, job.fileYear, 0, movies);
+    if (match.accepted) {
+        acceptMatch(job, match.best().movie);
+        return;
+    }
+
+    // Step 2: Ambiguous, the runtime can still tell a remake from the original. Searches
+    // don't report it, so it costs a details request per candidate; only worth it if
+    // the container knows its duration.
+    qint64 duration = TagProbe(job.filePath).probeDuration();
+    if (duration > 0) {
+        Job runtimeJob = job;
+        runtimeJob.runtime = static_cast<int>((duration + 30000) / 60000);
+        matchWithRuntimes(runtimeJob, match);
+        return;
+    }
+
+    queueForReview(job, match);
+}
+
+void BatchTagger::matchWithRuntimes(const Job& job, const MovieMatcher::Match& match)
+{
+    // The ranked results, the leading ones get their runtime filled in as details arrive
+    struct PendingDetails {
+        MovieResults movies;
+        int remaining = 0;
+    };
+    auto pending = std::make_shared<PendingDetails>();
+    for (const MovieMatcher::Candidate& candidate : match.candidates) {
+        pending->movies.append(candidate.movie);
+    }
+    int count = qMin(RUNTIME_CANDIDATES, static_cast<int>(pending->movies.size()));
+    pending->remaining = count;
+
+    for (int i = 0; i < count; ++i) {
+        m_tmdbClient->getMovieDetails(pending->movies.at(i).id, this, [this, job, pending, i](bool ok, const MovieResult& movie) {
+            // A failed request leaves the runtime unknown, it just doesn't count for that candidate
+            if (ok) {
+                pending->movies[i].runtime = movie.runtime;
+            }
+            if (--pending->remaining > 0) {
+                return;
+            }
+
+            MovieMatcher::Match rematch = m_matcher.match(job.searchText, job.fileYear, job.runtime, pending->movies);
+            if (rematch.accepted) {
+                acceptMatch(job, rematch.best().movie);
+            } else {
+                queueForReview(job, rematch);
+            }
+        });
+    }
+}
+
+void BatchTagger::acceptMatch(const Job& job, const MovieResult& movie)
+{
+    Metrics::instance().increment("auto_match_accepted");
+
+    // Genres and credits are only in the details, often cached by matchWithRuntimes().
+    // If they can't be fetched the file is still tagged, from the search result alone.
+    m_tmdbClient->getMovieDetails(movie.id, this, [this, job, movie](bool ok, const MovieResult& details) {
+        downloadPoster(job, ok ? details : movie);
+    });
+}
+
+void BatchTagger::downloadPoster(const Job& job, const MovieResult& movie)
+{
+    QString posterPath = movie.posterPath;
+    if (posterPath.isEmpty() || !posterPath.startsWith("/")) {
+        --m_lookupsInFlight;
+        failJob(job, QString("No poster available for '%1'").arg(job.searchText));
+        schedulePump();
+        return;
+    }
+
+    Job posterJob = job;
+    posterJob.tmdbId = movie.id;
+    posterJob.movie = movie;
+    posterJob.posterPath = posterPath;
+
+    // Several files may resolve to the same movie, download its poster only once
+    QList<Job>& waiters = m_posterWaiters[posterPath];
+    waiters.append(posterJob);
+    if (waiters.size() == 1) {
+        m_tmdbClient->downloadMoviePoster(posterPath, this, [this, posterPath](const QByteArray& imageData) {
+            onPosterDownloaded(imageData, posterPath);
+        });
+    }
+}
+
+void BatchTagger::queueForReview(const Job& job, const MovieMatcher::Match& match)
+{
+    --m_lookupsInFlight;
+    ++m_reviewCount;
+    Metrics::instance().increment("auto_match_review");
+
+    // The file stays untagged (and out of the library index), the next run tries again.
+    // It's listed in the review queue only once, however many runs it stays ambiguous.
+    if (!m_reviewQueue.append(job.filePath, job.searchText, job.fileYear, job.runtime, match)) {
+        qWarning().noquote() << m_reviewQueue.errorString();
+    }
+    qWarning().noquote() << "Needs review" << job.filePath << "-" << match.reason;
+    emit fileNeedsReview(job.filePath, match.reason);
+    schedulePump();
+}
+
+void BatchTagger::onPosterDownloaded(const QByteArray& imageData, const QString& posterPath)
+{
+    const QList<Job> waiters = m_posterWaiters.take(posterPath);
+    for (Job job : waiters) {
+        --m_lookupsInFlight;
+        if (imageData.isEmpty()) {
+            failJob(job, QString("Failed to download poster %1").arg(posterPath));
+            continue;
+        }
+        job.posterData = imageData;
+
+        // The downloaded poster is embedded as-is on a worker thread, in the same pass as the details
+        quint64 jobId = m_tagWriteQueue.submit(job.filePath, job.posterData, job.movie);
+        m_writeJobs.insert(jobId, job);
+        m_imageBytesInFlight += job.posterData.size();
+        m_peakImageBytesInFlight = qMax(m_peakImageBytesInFlight, m_imageBytesInFlight);
+    }
+
+    if (!waiters.isEmpty()) {
+        schedulePump();
+    }
+}
+
+void BatchTagger::onWriteFinished(quint64 jobId, const QString& filePath, bool ok, const QString& message)
+{
+    // The poster and the details are freed when job goes out of scope, the worker
+    // drops its copy as soon as its task returns
+    Job job = m_writeJobs.take(jobId);
+    m_imageBytesInFlight -= job.posterData.size();
+
+    // Lookup, poster and write of one file, waiting in front of the lookup stage excluded
+    Metrics::instance().observeElapsed("batch_file_seconds", job.lookupTimer);
+
+    if (ok) {
+        ++m_taggedCount;
+        m_libraryIndex.recordTagged(filePath, job.tmdbId, job.posterData);
+        qInfo().noquote() << "Tagged" << filePath;
+        emit fileTagged(filePath);
+    } else {
+        failJob(job, message.isEmpty() ? QString("Failed to write tags") : message);
+    }
+
+    schedulePump();
+}
+
+void BatchTagger::failJob(const Job& job, const QString& reason)
+{
+    ++m_failedCount;
+    qWarning().noquote() << "Failed" << job.filePath << "-" << reason;
+    emit fileFailed(job.filePath, reason);
+}
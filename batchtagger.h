@@ -0,0 +1,138 @@
+#ifndef BATCHTAGGER_H
+#define BATCHTAGGER_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QHash>
+#include <QQueue>
+#include <QList>
+#include <QElapsedTimer>
+#include <QDirIterator>
+#include <memory>
+#include "appconfig.h"
+#include "tagwritequeue.h"
+#include "libraryindex.h"
+#include "movieresult.h"
+#include "moviematcher.h"
+#include "reviewqueue.h"
+
+class TmdbClient;
+
+// Headless tagging of whole library directories.
+//
+// Files flow through three bounded stages that run concurrently:
+//   scan   - walk the directory trees for *.mp4/*.mkv files
+//   lookup - search TMDb for the parsed title, pick the result (MovieMatcher)
+//            and download the poster
+//   write  - embed the poster and the movie details through TagWriteQueue on
+//            worker threads
+// Each stage stops pulling work while the queue in front of the next
+// stage is full, or while the posters of unfinished writes exceed
+// AppConfig::maxImageBytesInFlight, so memory stays bounded on very large
+// libraries.
+// Files the library index lists as tagged and unchanged never leave the
+// scan stage, unless setForceRetag(true) is used. Files without a confident
+// match are not tagged but listed in the ReviewQueue.
+class BatchTagger : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit BatchTagger(TmdbClient *tmdbClient, const AppConfig& config, QObject *parent = nullptr);
+    ~BatchTagger();
+
+    // Queue a library root to be scanned recursively
+    void addDirectory(const QString& rootPath);
+
+    // Queue a single file, e.g. one reported by DirectoryWatcher. If the
+    // pipeline finished before, it runs again and emits finished() once more.
+    void addFile(const QString& filePath);
+
+    // Start the pipeline, finished() is emitted once every file is processed
+    void start();
+
+    // Tag every file, even those the library index lists as unchanged
+    void setForceRetag(bool force);
+
+    // Counts of the current run, they start over when new files arrive after finished()
+    int taggedCount() const;
+    int failedCount() const;
+    int unchangedCount() const;
+    int alreadyCoveredCount() const;
+    int reviewCount() const;
+    // Most poster bytes held for unfinished writes at any time of this run
+    qint64 peakImageBytesInFlight() const;
+
+signals:
+    void fileTagged(const QString& filePath);
+    void fileFailed(const QString& filePath, const QString& reason);
+    void fileNeedsReview(const QString& filePath, const QString& reason);
+    void finished();
+
+private:
+    struct Job {
+        QString filePath;
+        QString searchText;
+        int year = 0;           // Year searched for, 0 if unknown or dropped on retry
+        int fileYear = 0;       // From the file name, 0 if unknown
+        int runtime = 0;        // Minutes, from the container once a match is ambiguous
+        int tmdbId = 0;
+        MovieResult movie;      // Details of the accepted match, written along with the poster
+        QString posterPath;
+        QByteArray posterData;
+        QElapsedTimer lookupTimer;  // Started when the lookup begins
+    };
+
+    void schedulePump();
+    void pump();
+    void scanMore();
+    void enqueueFile(const QFileInfo& fileInfo);
+    void restartIfFinished();
+    void startLookups();
+    void onSearchFinished(const Job& job, bool ok, const MovieResults& movies);
+    void matchWithRuntimes(const Job& job, const MovieMatcher::Match& match);
+    void acceptMatch(const Job& job, const MovieResult& movie);
+    void downloadPoster(const Job& job, const MovieResult& movie);
+    void queueForReview(const Job& job, const MovieMatcher::Match& match);
+    void onPosterDownloaded(const QByteArray& imageData, const QString& posterPath);
+    void onWriteFinished(quint64 jobId, const QString& filePath, bool ok, const QString& message);
+    void failJob(const Job& job, const QString& reason);
+    bool isIdle() const;
+
+    TmdbClient *m_tmdbClient;
+    AppConfig m_config;
+
+    // Scan stage
+    QStringList m_pendingRoots;
+    QStringList m_pendingFiles;
+    std::unique_ptr<QDirIterator> m_scanner;
+    QQueue<Job> m_lookupQueue;
+    LibraryIndex m_libraryIndex;
+    bool m_forceRetag = false;
+
+    // Lookup stage
+    int m_lookupsInFlight = 0;
+    QHash<QString, QList<Job>> m_posterWaiters;  // Jobs waiting for each poster path
+    MovieMatcher m_matcher;
+    ReviewQueue m_reviewQueue;
+
+    // Write stage
+    TagWriteQueue m_tagWriteQueue;
+    QHash<quint64, Job> m_writeJobs;  // Submitted writes by job id
+    qint64 m_imageBytesInFlight = 0;  // Poster bytes of m_writeJobs, shared posters count per file
+    qint64 m_peakImageBytesInFlight = 0;
+
+    bool m_started = false;
+    bool m_pumpScheduled = false;
+    bool m_finished = false;
+    int m_taggedCount = 0;
+    int m_failedCount = 0;
+    int m_unchangedCount = 0;
+    int m_alreadyCoveredCount = 0;
+    int m_reviewCount = 0;
+    QElapsedTimer m_elapsed;
+};
+
+#endif // BATCHTAGGER_H
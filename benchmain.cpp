@@ -0,0 +1,460 @@
+#include "batchtagger.h"
+#include "tmdbclient.h"
+#include "tmdbmockserver.h"
+#include "fixturegenerator.h"
+#include "appconfig.h"
+#include "metrics.h"
+#include "mediatagwriter.h"
+#include "tagprobe.h"
+#include "releasenameparser.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+#include <QDir>
+#include <QFile>
+#include <QDebug>
+#include <algorithm>
+
+// Synthetic library: a mix of the layouts found in real collections, named
+// like releases so the parser finds a title and a year in each one
+static bool generateLibrary(const QString& directory, int fileCount, qint64 payloadBytes)
+{
+    for (int i = 0; i < fileCount; ++i) {
+        QString baseName = QString("%1/Benchmark.Movie.%2.%3.1080p.BluRay.x264")
+                               .arg(directory)
+                               .arg(i, 5, 10, QChar('0'))
+                               .arg(1970 + i % 50);
+        QString error;
+        bool ok = false;
+
+        switch (i % 4) {
+        case 0:
+        case 1:
+        case 2: {
+            // Moov in front without padding (media data shifted), moov at the end,
+            // and moov in front with room for the cover (written in place)
+            FixtureGenerator::Mp4Options options;
+            options.layout = i % 4 == 1 ? FixtureGenerator::Mp4Layout::MoovLast : FixtureGenerator::Mp4Layout::MoovFirst;
+            options.paddingBytes = i % 4 == 2 ? 256 * 1024 : 0;
+            options.payloadBytes = payloadBytes;
+            ok = FixtureGenerator::writeMp4(baseName + ".mp4", options, &error);
+            break;
+        }
+        default: {
+            // mkvmerge reserves a few KiB after the SeekHead
+            FixtureGenerator::MkvOptions options;
+            options.voidBytes = 4096;
+            options.payloadBytes = payloadBytes;
+            ok = FixtureGenerator::writeMkv(baseName + ".mkv", options, &error);
+            break;
+        }
+        }
+
+        if (!ok) {
+            qCritical().noquote() << "Couldn't create" << baseName << "-" << error;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Bytes this process read and wrote through system calls so far (rchar/wchar of
+// /proc/self/io), page cache hits included. -1 where the kernel doesn't tell.
+struct IoCounters {
+    qint64 readBytes = -1;
+    qint64 writtenBytes = -1;
+};
+
+static IoCounters ioCounters()
+{
+    IoCounters counters;
+#if defined(Q_OS_LINUX)
+    QFile file("/proc/self/io");
+    if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        const QList<QByteArray> lines = file.readAll().split('\n');
+        for (const QByteArray& line : lines) {
+            if (line.startsWith("rchar:")) {
+                counters.readBytes = line.mid(6).trimmed().toLongLong();
+            } else if (line.startsWith("wchar:")) {
+                counters.writtenBytes = line.mid(6).trimmed().toLongLong();
+            }
+        }
+    }
+#endif
+    return counters;
+}
+
+static QString formatBytes(qint64 bytes)
+{
+    if (bytes < 0) {
+        return "?";
+    }
+    if (bytes < 1024 * 1024) {
+        return QString("%1 KiB").arg(bytes / 1024.0, 0, 'f', 1);
+    }
+    return QString("%1 MiB").arg(bytes / (1024.0 * 1024.0), 0, 'f', 1);
+}
+
+// File layouts the writer benchmark covers
+struct WriterCase {
+    const char *name;
+    bool isMkv;
+    FixtureGenerator::Mp4Layout layout;
+    qint64 paddingBytes;        // MP4 "free" after ilst, MKV Void after the SeekHead
+    bool movesMediaData;        // Expected to rewrite the payload, all others must not
+};
+
+static const WriterCase WRITER_CASES[] = {
+    { "mp4 moov first", false, FixtureGenerator::Mp4Layout::MoovFirst, 0, true },
+    { "mp4 moov first, padded", false, FixtureGenerator::Mp4Layout::MoovFirst, 1024 * 1024, false },
+    { "mp4 moov last", false, FixtureGenerator::Mp4Layout::MoovLast, 0, false },
+    { "mp4 moov last, padded", false, FixtureGenerator::Mp4Layout::MoovLast, 1024 * 1024, false },
+    { "mkv", true, FixtureGenerator::Mp4Layout::MoovFirst, 4096, false },
+};
+
+// Time MediaTagWriter on freshly generated files of every layout and size, and
+// flag writes that touch far more of the file than the tag region
+static int runWriterBenchmark(const QString& directory, const QList<qint64>& sizes, int repeat,
+                              qint64 maxRewriteBytes, bool safeWrites)
+{
+    QByteArray cover = TmdbMockServer::generatePoster();
+    // Anything beyond this on a layout that doesn't move media data is a regression
+    qint64 tagRegionLimit = 16 * cover.size() + 1024 * 1024;
+    int problems = 0;
+
+    qInfo().noquote() << QString("Cover: %1, %2 run(s) per case%3")
+                             .arg(formatBytes(cover.size()))
+                             .arg(repeat)
+                             .arg(safeWrites ? ", safe writes" : "");
+
+    for (const WriterCase& writerCase : WRITER_CASES) {
+        for (qint64 size : sizes) {
+            QString label = QString("%1, %2").arg(QString::fromLatin1(writerCase.name), formatBytes(size));
+            if (writerCase.movesMediaData && size > maxRewriteBytes) {
+                qInfo().noquote() << QString("%1: skipped, would rewrite %2").arg(label, formatBytes(size));
+                continue;
+            }
+
+            QString filePath = QString("%1/writer-bench.%2").arg(directory, writerCase.isMkv ? "mkv" : "mp4");
+            QList<double> milliseconds;
+            IoCounters io;
+            QString failure;
+
+            for (int run = 0; run < repeat && failure.isEmpty(); ++run) {
+                // Step 1: Fresh file, not timed
+                QString error;
+                bool generated = false;
+                if (writerCase.isMkv) {
+                    FixtureGenerator::MkvOptions options;
+                    options.payloadBytes = size;
+                    options.voidBytes = writerCase.paddingBytes;
+                    generated = FixtureGenerator::writeMkv(filePath, options, &error);
+                } else {
+                    FixtureGenerator::Mp4Options options;
+                    options.layout = writerCase.layout;
+                    options.paddingBytes = writerCase.paddingBytes;
+                    options.payloadBytes = size;
+                    generated = FixtureGenerator::writeMp4(filePath, options, &error);
+                }
+                if (!generated) {
+                    failure = "couldn't generate the file: " + error;
+                    break;
+                }
+
+                // Step 2: Write the cover, end to end through the public entry point
+                MediaTagWriter writer;
+                writer.setSafeWrites(safeWrites);
+                QObject::connect(&writer, &MediaTagWriter::error, [&failure](const QString& message) {
+                    failure = message;
+                });
+
+                IoCounters before = ioCounters();
+                QElapsedTimer timer;
+                timer.start();
+                bool written = writer.writeTagsToFile(filePath, cover, MediaTagWriter::CoverFormat::Jpeg);
+                milliseconds.append(timer.nsecsElapsed() / 1e6);
+                IoCounters after = ioCounters();
+                io.readBytes = before.readBytes < 0 ? -1 : after.readBytes - before.readBytes;
+                io.writtenBytes = before.writtenBytes < 0 ? -1 : after.writtenBytes - before.writtenBytes;
+
+                // Step 3: The file must still be intact and have its cover
+                if (!written) {
+                    failure = failure.isEmpty() ? QString("write failed") : failure;
+                } else if (!writerCase.isMkv && !FixtureGenerator::verifyMp4(filePath, &error)) {
+                    failure = "file damaged: " + error;
+                } else if (TagProbe(filePath).probeCover() != TagProbe::CoverState::Present) {
+                    failure = "cover missing after the write";
+                }
+            }
+            QFile::remove(filePath);
+
+            if (!failure.isEmpty()) {
+                ++problems;
+                qWarning().noquote() << QString("%1: FAILED, %2").arg(label, failure);
+                continue;
+            }
+
+            std::sort(milliseconds.begin(), milliseconds.end());
+            bool rewrite = !writerCase.movesMediaData && io.writtenBytes > tagRegionLimit;
+            if (rewrite) {
+                ++problems;
+            }
+            qInfo().noquote() << QString("%1: %2 ms (median), read %3, written %4%5")
+                                     .arg(label)
+                                     .arg(milliseconds.at(milliseconds.size() / 2), 0, 'f', 2)
+                                     .arg(formatBytes(io.readBytes), formatBytes(io.writtenBytes))
+                                     .arg(rewrite ? ", REWRITE: expected an in-place write" : "");
+        }
+    }
+
+    return problems == 0 ? 0 : 2;
+}
+
+// Parse every name of the corpus (name, expected title, expected year per tab separated
+// line) and report the accuracy and the throughput. Exits with 2 below minAccuracy.
+static int runParserBenchmark(const QString& corpusPath, double minAccuracy)
+{
+    struct Sample {
+        QString name;
+        QString title;
+        int year = 0;
+    };
+
+    // Step 1: Corpus, '#' starts a comment line
+    QFile corpus(corpusPath);
+    if (!corpus.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qCritical().noquote() << "Error: Couldn't read" << corpusPath << "-" << corpus.errorString();
+        return 1;
+    }
+    QList<Sample> samples;
+    int lineNumber = 0;
+    while (!corpus.atEnd()) {
+        QString line = QString::fromUtf8(corpus.readLine()).trimmed();
+        ++lineNumber;
+        if (line.isEmpty() || line.startsWith('#')) {
+            continue;
+        }
+        QStringList fields = line.split('\t');
+        if (fields.size() != 3) {
+            qWarning().noquote() << QString("%1:%2: expected name, title and year").arg(corpusPath).arg(lineNumber);
+            continue;
+        }
+        samples.append(Sample{ fields.at(0), fields.at(1), fields.at(2).toInt() });
+    }
+    if (samples.isEmpty()) {
+        qCritical().noquote() << "Error: No release names in" << corpusPath;
+        return 1;
+    }
+
+    // Step 2: Accuracy, title (case aside) and year must both match
+    int correct = 0;
+    for (const Sample& sample : std::as_const(samples)) {
+        ReleaseInfo info = ReleaseNameParser::parse(sample.name);
+        if (info.title.compare(sample.title, Qt::CaseInsensitive) == 0 && info.year == sample.year) {
+            ++correct;
+        } else {
+            qInfo().noquote() << QString("MISS %1 -> \"%2\" %3, expected \"%4\" %5")
+                                     .arg(sample.name, info.title).arg(info.year).arg(sample.title).arg(sample.year);
+        }
+    }
+    double accuracy = static_cast<double>(correct) / samples.size();
+
+    // Step 3: Throughput, whole passes over the corpus for at least half a second
+    QElapsedTimer timer;
+    timer.start();
+    qint64 parsed = 0;
+    int titleLength = 0;  // Keeps the results alive
+    do {
+        for (const Sample& sample : std::as_const(samples)) {
+            titleLength += ReleaseNameParser::parse(sample.name).title.size();
+        }
+        parsed += samples.size();
+    } while (timer.elapsed() < 500);
+    double seconds = timer.nsecsElapsed() / 1e9;
+
+    qInfo().noquote() << QString("Parser: %1 names, %2 correct, accuracy %3% (floor %4%)")
+                             .arg(samples.size())
+                             .arg(correct)
+                             .arg(accuracy * 100, 0, 'f', 1)
+                             .arg(minAccuracy * 100, 0, 'f', 1);
+    qInfo().noquote() << QString("Throughput: %1 names/s (%2 names in %3 s, %4 title characters)")
+                             .arg(parsed / qMax(seconds, 1e-9), 0, 'f', 0)
+                             .arg(parsed)
+                             .arg(seconds, 0, 'f', 2)
+                             .arg(titleLength);
+    return accuracy >= minAccuracy ? 0 : 2;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("MovieTagBench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Tag a generated library against a local TMDb stand-in and report the throughput.");
+    parser.addHelpOption();
+    QCommandLineOption serveOption("serve", "Only run the TMDb stand-in server, e.g. for tmdb_api_base_url in config.ini.");
+    QCommandLineOption portOption("port", "Port of the stand-in server, any free one by default.", "port", "0");
+    QCommandLineOption recordingsOption("recordings", "Directory with recorded TMDb responses, see TmdbMockServer.", "directory");
+    QCommandLineOption minLatencyOption("min-latency", "Shortest reply delay of the stand-in server in ms.", "ms", "20");
+    QCommandLineOption maxLatencyOption("max-latency", "Longest reply delay of the stand-in server in ms.", "ms", "80");
+    QCommandLineOption errorRateOption("error-rate", "Share of requests failed with 429/503 (0..1).", "rate", "0");
+    QCommandLineOption filesOption("files", "Number of files in the generated library.", "count", "200");
+    QCommandLineOption sizeOption("size", "Media payload per file in MiB, stored sparse.", "MiB", "8");
+    QCommandLineOption directoryOption("directory", "Create the library here instead of a temporary directory.", "directory");
+    QCommandLineOption keepOption("keep", "Keep the generated library.");
+    QCommandLineOption lookupsOption("lookups", "Maximum TMDb lookups in flight.", "count");
+    QCommandLineOption writesOption("writes", "Maximum files written at the same time.", "count");
+    QCommandLineOption writerOption("writer", "Benchmark MediaTagWriter alone on MP4/MKV layouts of several sizes.");
+    QCommandLineOption sizesOption("sizes", "Writer benchmark: comma separated file sizes in MiB.", "MiB,...", "4,64,1024,32768");
+    QCommandLineOption repeatOption("repeat", "Writer benchmark: runs per layout and size.", "count", "3");
+    QCommandLineOption maxRewriteOption("max-rewrite", "Writer benchmark: largest file to test on layouts that move the media data, in MiB.", "MiB", "1024");
+    QCommandLineOption safeOption("safe", "Writer benchmark: use safe writes, see safe_writes in config.ini.");
+    QCommandLineOption parserOption("parser", "Benchmark ReleaseNameParser alone on a corpus of release names.");
+    QCommandLineOption corpusOption("corpus", "Parser benchmark: tab separated file of name, title and year.", "file",
+                                    QStringLiteral(MOVIETAG_SOURCE_DIR "/releasenames.tsv"));
+    QCommandLineOption minAccuracyOption("min-accuracy", "Parser benchmark: lowest share of names parsed correctly (0..1).", "share", "0.99");
+    parser.addOption(serveOption);
+    parser.addOption(portOption);
+    parser.addOption(recordingsOption);
+    parser.addOption(minLatencyOption);
+    parser.addOption(maxLatencyOption);
+    parser.addOption(errorRateOption);
+    parser.addOption(filesOption);
+    parser.addOption(sizeOption);
+    parser.addOption(directoryOption);
+    parser.addOption(keepOption);
+    parser.addOption(lookupsOption);
+    parser.addOption(writesOption);
+    parser.addOption(writerOption);
+    parser.addOption(sizesOption);
+    parser.addOption(repeatOption);
+    parser.addOption(maxRewriteOption);
+    parser.addOption(safeOption);
+    parser.addOption(parserOption);
+    parser.addOption(corpusOption);
+    parser.addOption(minAccuracyOption);
+    parser.process(a);
+
+    // The parser benchmark touches no files but the corpus
+    if (parser.isSet(parserOption)) {
+        return runParserBenchmark(parser.value(corpusOption), qBound(0.0, parser.value(minAccuracyOption).toDouble(), 1.0));
+    }
+
+    // Files are created here, a temporary directory unless --directory is given
+    QTemporaryDir temporaryDirectory;
+    QString libraryDirectory = parser.isSet(directoryOption) ? parser.value(directoryOption) : temporaryDirectory.path();
+    temporaryDirectory.setAutoRemove(!parser.isSet(keepOption));
+    if (!QDir().mkpath(libraryDirectory)) {
+        qCritical().noquote() << "Error: Couldn't create" << libraryDirectory;
+        return 1;
+    }
+
+    // The writer benchmark needs no TMDb at all
+    if (parser.isSet(writerOption)) {
+        QList<qint64> sizes;
+        const QStringList sizeValues = parser.value(sizesOption).split(',', Qt::SkipEmptyParts);
+        for (const QString& value : sizeValues) {
+            sizes.append(qMax<qint64>(1, value.trimmed().toLongLong()) * 1024 * 1024);
+        }
+        return runWriterBenchmark(libraryDirectory, sizes, qMax(1, parser.value(repeatOption).toInt()),
+                                  parser.value(maxRewriteOption).toLongLong() * 1024 * 1024, parser.isSet(safeOption));
+    }
+
+    // Step 1: Stand-in server
+    TmdbMockServer server;
+    server.setRecordingsDirectory(parser.value(recordingsOption));
+    server.setLatency(parser.value(minLatencyOption).toInt(), parser.value(maxLatencyOption).toInt());
+    server.setErrorRate(parser.value(errorRateOption).toDouble());
+    if (!server.listen(static_cast<quint16>(parser.value(portOption).toUInt()))) {
+        qCritical().noquote() << "Error: Couldn't start the TMDb stand-in server:" << server.errorString();
+        return 1;
+    }
+
+    if (parser.isSet(serveOption)) {
+        qInfo().noquote() << "TMDb stand-in listening, set tmdb_api_base_url=" + server.apiBaseUrl();
+        return a.exec();
+    }
+
+    // Step 2: Library
+    int fileCount = qMax(1, parser.value(filesOption).toInt());
+    qint64 payloadBytes = qMax<qint64>(1, parser.value(sizeOption).toLongLong()) * 1024 * 1024;
+    QElapsedTimer generateTimer;
+    generateTimer.start();
+    if (!generateLibrary(libraryDirectory, fileCount, payloadBytes)) {
+        return 1;
+    }
+    qInfo().noquote() << QString("Generated %1 files in %2 in %3 s")
+                             .arg(fileCount)
+                             .arg(libraryDirectory)
+                             .arg(generateTimer.elapsed() / 1000.0, 0, 'f', 1);
+
+    // Step 3: The batch pipeline against the stand-in. Nothing outside the library
+    // is touched: no library index, no saved configuration, no posters on disk.
+    AppConfig config;
+    config.tmdbApiKey = "benchmark";
+    config.tmdbApiBaseUrl = server.apiBaseUrl();
+    config.tmdbRequestsPerSecond = 0;
+    config.useLibraryIndex = false;
+    config.reviewQueueFile = libraryDirectory + "/review-queue.jsonl";
+    if (parser.isSet(lookupsOption)) {
+        config.maxConcurrentLookups = qMax(1, parser.value(lookupsOption).toInt());
+    }
+    if (parser.isSet(writesOption)) {
+        config.maxConcurrentWrites = qMax(1, parser.value(writesOption).toInt());
+    }
+
+    TmdbClient tmdbClient(config.tmdbApiKey);
+    tmdbClient.setApiBaseUrl(config.tmdbApiBaseUrl);
+    tmdbClient.setConfigurationCacheTtl(0);
+    // A directory of its own: the shared cache would be indexed, and evicted, by a bench run
+    tmdbClient.posterCache().setDirectory(temporaryDirectory.filePath("posters"));
+    tmdbClient.posterCache().setMaxDiskBytes(0);
+    tmdbClient.posterCache().setMaxMemoryBytes(config.posterMemoryCacheBytes);
+    tmdbClient.requestScheduler().setRequestsPerSecond(config.tmdbRequestsPerSecond);
+    tmdbClient.requestScheduler().setMaxInFlight(config.tmdbMaxInFlight);
+    tmdbClient.requestScheduler().setMaxRetries(config.tmdbMaxRetries);
+
+    BatchTagger batchTagger(&tmdbClient, config);
+    batchTagger.addDirectory(libraryDirectory);
+
+    QElapsedTimer runTimer;
+    QObject::connect(&batchTagger, &BatchTagger::finished, &a, [&]() {
+        // Step 4: Report
+        double seconds = runTimer.nsecsElapsed() / 1e9;
+        int processed = batchTagger.taggedCount() + batchTagger.failedCount() + batchTagger.reviewCount();
+        const Metrics& metrics = Metrics::instance();
+        qint64 peakRss = Metrics::peakResidentBytes();
+
+        qInfo().noquote() << QString("Benchmark: %1 files in %2 s, %3 files/s")
+                                 .arg(processed)
+                                 .arg(seconds, 0, 'f', 2)
+                                 .arg(processed / qMax(seconds, 1e-9), 0, 'f', 1);
+        qInfo().noquote() << QString("Per file: p50 %1 ms, p99 %2 ms")
+                                 .arg(metrics.quantile("batch_file_seconds", 0.5) * 1000, 0, 'f', 1)
+                                 .arg(metrics.quantile("batch_file_seconds", 0.99) * 1000, 0, 'f', 1);
+        qInfo().noquote() << QString("Matching: %1 tagged automatically, %2 sent to review")
+                                 .arg(batchTagger.taggedCount())
+                                 .arg(batchTagger.reviewCount());
+        qInfo().noquote() << QString("Peak RSS: %1, posters in flight: %2 MiB, buffer pool: %3 hits, %4 misses")
+                                 .arg(peakRss < 0 ? QString("unknown") : QString("%1 MiB").arg(peakRss / (1024.0 * 1024.0), 0, 'f', 1))
+                                 .arg(batchTagger.peakImageBytesInFlight() / (1024.0 * 1024.0), 0, 'f', 1)
+                                 .arg(metrics.counter("buffer_pool_hits"))
+                                 .arg(metrics.counter("buffer_pool_misses"));
+        qInfo().noquote() << QString("Stand-in server: %1 requests, %2 failed on purpose")
+                                 .arg(server.requestCount())
+                                 .arg(server.failedRequestCount());
+        if (parser.isSet(keepOption) || parser.isSet(directoryOption)) {
+            qInfo().noquote() << "Library kept in" << libraryDirectory;
+        }
+        a.exit(batchTagger.failedCount() == 0 ? 0 : 2);
+    });
+
+    runTimer.start();
+    tmdbClient.getConfiguration();
+    batchTagger.start();
+
+    return a.exec();
+}
@@ -0,0 +1,80 @@
+#include "bufferpool.h"
+#include "metrics.h"
+#include <QMutexLocker>
+
+BufferPool::Buffer::Buffer(qsizetype size, BufferPool& pool)
+    : m_pool(pool)
+    , m_data(pool.take(size))
+{
+}
+
+BufferPool::Buffer::~Buffer()
+{
+    m_pool.give(std::move(m_data));
+}
+
+char *BufferPool::Buffer::data()
+{
+    // Never shared, data() doesn't detach
+    return m_data.data();
+}
+
+qsizetype BufferPool::Buffer::size() const
+{
+    return m_data.size();
+}
+
+BufferPool& BufferPool::instance()
+{
+    static BufferPool pool;
+    return pool;
+}
+
+void BufferPool::setMaxIdleBytes(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_maxIdleBytes = qMax<qint64>(0, bytes);
+    while (m_idleBytes > m_maxIdleBytes && !m_idle.isEmpty()) {
+        m_idleBytes -= m_idle.takeLast().size();
+    }
+}
+
+qint64 BufferPool::idleBytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_idleBytes;
+}
+
+QByteArray BufferPool::take(qsizetype size)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        // Smallest idle buffer that is large enough, buffers are mostly of one size anyway
+        qsizetype best = -1;
+        for (qsizetype i = 0; i < m_idle.size(); ++i) {
+            if (m_idle.at(i).size() >= size && (best < 0 || m_idle.at(i).size() < m_idle.at(best).size())) {
+                best = i;
+            }
+        }
+        if (best >= 0) {
+            QByteArray data = m_idle.takeAt(best);
+            m_idleBytes -= data.size();
+            locker.unlock();
+            Metrics::instance().increment("buffer_pool_hits");
+            return data;
+        }
+    }
+
+    Metrics::instance().increment("buffer_pool_misses");
+    return QByteArray(size, Qt::Uninitialized);
+}
+
+void BufferPool::give(QByteArray data)
+{
+    QMutexLocker locker(&m_mutex);
+    if (data.isEmpty() || m_idleBytes + data.size() > m_maxIdleBytes) {
+        return;  // Freed when data goes out of scope
+    }
+    m_idleBytes += data.size();
+    m_idle.append(std::move(data));
+}
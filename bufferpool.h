@@ -0,0 +1,52 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <QByteArray>
+#include <QList>
+#include <QMutex>
+
+// Large scratch buffers shared by the tag writers, so moving gigabytes of media
+// data (Mp4Editor growing moov) doesn't allocate and free a fresh buffer for every
+// chunk and every file. Buffers are handed out by BufferPool::Buffer and go back
+// to the pool when it goes out of scope. Idle buffers are kept up to a byte budget,
+// the rest is freed right away. Thread safe, writes run on worker threads.
+class BufferPool
+{
+public:
+    // A buffer of at least size bytes for the lifetime of this object
+    class Buffer
+    {
+    public:
+        explicit Buffer(qsizetype size, BufferPool& pool = BufferPool::instance());
+        ~Buffer();
+
+        Buffer(const Buffer&) = delete;
+        Buffer& operator=(const Buffer&) = delete;
+
+        char *data();
+        qsizetype size() const;
+
+    private:
+        BufferPool& m_pool;
+        QByteArray m_data;
+    };
+
+    static BufferPool& instance();
+
+    // Bytes of idle buffers kept for reuse, 0 frees every buffer once it is returned
+    void setMaxIdleBytes(qint64 bytes);
+    qint64 idleBytes() const;
+
+private:
+    BufferPool() = default;
+
+    QByteArray take(qsizetype size);
+    void give(QByteArray data);
+
+    mutable QMutex m_mutex;
+    QList<QByteArray> m_idle;
+    qint64 m_idleBytes = 0;
+    qint64 m_maxIdleBytes = 16 * 1024 * 1024;
+};
+
+#endif // BUFFERPOOL_H
@@ -0,0 +1,204 @@
+#include "directorywatcher.h"
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDebug>
+#include <limits>
+
+DirectoryWatcher::DirectoryWatcher(QObject *parent)
+    : QObject(parent)
+    , m_settleSeconds(30)
+{
+    m_settleTimer.setSingleShot(true);
+    connect(&m_settleTimer, &QTimer::timeout, this, &DirectoryWatcher::onSettleTimeout);
+    connect(&m_watcher, &QFileSystemWatcher::directoryChanged, this, &DirectoryWatcher::onDirectoryChanged);
+    connect(&m_watcher, &QFileSystemWatcher::fileChanged, this, &DirectoryWatcher::onFileChanged);
+}
+
+void DirectoryWatcher::setSettleSeconds(int seconds)
+{
+    m_settleSeconds = qMax(1, seconds);
+}
+
+void DirectoryWatcher::addRoot(const QString& rootPath)
+{
+    watchTree(QDir(rootPath).absolutePath(), false);
+}
+
+int DirectoryWatcher::pendingCount() const
+{
+    return m_pending.size();
+}
+
+bool DirectoryWatcher::isMediaFile(const QString& fileName)
+{
+    return fileName.endsWith(".mp4", Qt::CaseInsensitive) || fileName.endsWith(".mkv", Qt::CaseInsensitive);
+}
+
+void DirectoryWatcher::watchTree(const QString& directoryPath, bool reportFiles)
+{
+    // The watcher is not recursive, every directory of the tree needs its own watch
+    QStringList directories{ directoryPath };
+    QDirIterator it(directoryPath, QDir::Dirs | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        directories.append(it.next());
+    }
+
+    for (const QString& directory : std::as_const(directories)) {
+        if (m_knownFiles.contains(directory)) {
+            continue;
+        }
+
+        QSet<QString>& known = m_knownFiles[directory];
+        const QStringList fileNames = QDir(directory).entryList(QStringList() << "*.mp4" << "*.mkv", QDir::Files);
+        for (const QString& fileName : fileNames) {
+            known.insert(fileName);
+            // Files of a directory created (or moved in) while running are new as well
+            if (reportFiles) {
+                addPending(directory + '/' + fileName);
+            }
+        }
+
+        if (!m_watcher.addPath(directory)) {
+            qWarning().noquote() << "Can't watch" << directory << "(inotify watch limit reached?)";
+        }
+    }
+}
+
+void DirectoryWatcher::onDirectoryChanged(const QString& directoryPath)
+{
+    QDir directory(directoryPath);
+    if (!directory.exists()) {
+        // The watcher already dropped it, forget its subtree as well
+        const QStringList watched = m_knownFiles.keys();
+        for (const QString& path : watched) {
+            if (path == directoryPath || path.startsWith(directoryPath + '/')) {
+                m_knownFiles.remove(path);
+                m_watcher.removePath(path);
+            }
+        }
+        return;
+    }
+
+    // New subdirectories
+    const QStringList subdirectories = directory.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    for (const QString& name : subdirectories) {
+        QString path = directoryPath + '/' + name;
+        if (!m_knownFiles.contains(path)) {
+            watchTree(path, true);
+        }
+    }
+
+    // New and removed media files, downloads renamed from *.part show up here as new
+    QSet<QString>& known = m_knownFiles[directoryPath];
+    QSet<QString> current;
+    const QStringList fileNames = directory.entryList(QDir::Files);
+    for (const QString& fileName : fileNames) {
+        if (!isMediaFile(fileName)) {
+            continue;
+        }
+        current.insert(fileName);
+        if (!known.contains(fileName)) {
+            addPending(directoryPath + '/' + fileName);
+        }
+    }
+    for (const QString& fileName : std::as_const(known)) {
+        if (!current.contains(fileName)) {
+            removePending(directoryPath + '/' + fileName);
+        }
+    }
+    known = current;
+}
+
+void DirectoryWatcher::addPending(const QString& filePath)
+{
+    QFileInfo fileInfo(filePath);
+    PendingFile pending;
+    pending.size = fileInfo.size();
+    pending.modified = fileInfo.lastModified().toMSecsSinceEpoch();
+    pending.settleDeadline = QDeadlineTimer(m_settleSeconds * 1000LL);
+    m_pending.insert(filePath, pending);
+
+    // Writes to the file push its deadline back
+    m_watcher.addPath(filePath);
+    scheduleSettleTimer();
+}
+
+void DirectoryWatcher::removePending(const QString& filePath)
+{
+    if (m_pending.remove(filePath)) {
+        m_watcher.removePath(filePath);
+        scheduleSettleTimer();
+    }
+}
+
+void DirectoryWatcher::onFileChanged(const QString& filePath)
+{
+    auto it = m_pending.find(filePath);
+    if (it == m_pending.end()) {
+        return;
+    }
+
+    if (!QFileInfo::exists(filePath)) {
+        removePending(filePath);
+        return;
+    }
+
+    // Still being written, only the deadline moves, the timer catches up when it fires
+    it->settleDeadline = QDeadlineTimer(m_settleSeconds * 1000LL);
+}
+
+void DirectoryWatcher::onSettleTimeout()
+{
+    QStringList ready;
+    for (auto it = m_pending.begin(); it != m_pending.end(); ) {
+        if (!it->settleDeadline.hasExpired()) {
+            ++it;
+            continue;
+        }
+
+        QFileInfo fileInfo(it.key());
+        if (!fileInfo.exists()) {
+            m_watcher.removePath(it.key());
+            it = m_pending.erase(it);
+            continue;
+        }
+
+        // Some writers don't trigger change notifications, compare size and time as well
+        qint64 size = fileInfo.size();
+        qint64 modified = fileInfo.lastModified().toMSecsSinceEpoch();
+        if (size != it->size || modified != it->modified) {
+            it->size = size;
+            it->modified = modified;
+            it->settleDeadline = QDeadlineTimer(m_settleSeconds * 1000LL);
+            ++it;
+            continue;
+        }
+
+        ready.append(it.key());
+        m_watcher.removePath(it.key());
+        it = m_pending.erase(it);
+    }
+
+    scheduleSettleTimer();
+
+    for (const QString& filePath : std::as_const(ready)) {
+        emit fileReady(filePath);
+    }
+}
+
+void DirectoryWatcher::scheduleSettleTimer()
+{
+    if (m_pending.isEmpty()) {
+        m_settleTimer.stop();
+        return;
+    }
+
+    // One timer for the earliest deadline
+    qint64 earliest = std::numeric_limits<qint64>::max();
+    for (const PendingFile& pending : std::as_const(m_pending)) {
+        earliest = qMin(earliest, pending.settleDeadline.remainingTime());
+    }
+    m_settleTimer.start(static_cast<int>(qMax<qint64>(0, earliest)));
+}
@@ -0,0 +1,63 @@
+#ifndef DIRECTORYWATCHER_H
+#define DIRECTORYWATCHER_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QSet>
+#include <QTimer>
+#include <QDeadlineTimer>
+#include <QFileSystemWatcher>
+
+// Watches library roots (recursively) for new *.mp4/*.mkv files and reports
+// each one with fileReady() once it stopped changing for settleSeconds, so
+// files still being downloaded or copied are not touched.
+//
+// Entirely event driven (inotify and friends through QFileSystemWatcher): with
+// no file waiting to settle no timer is running and nothing is polled.
+class DirectoryWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DirectoryWatcher(QObject *parent = nullptr);
+
+    void setSettleSeconds(int seconds);
+
+    // Watch rootPath and all its subdirectories. Files already present are not reported.
+    void addRoot(const QString& rootPath);
+
+    // Number of files waiting to settle
+    int pendingCount() const;
+
+signals:
+    void fileReady(const QString& filePath);
+
+private:
+    struct PendingFile {
+        qint64 size = -1;
+        qint64 modified = 0;
+        QDeadlineTimer settleDeadline;
+    };
+
+    void watchTree(const QString& directoryPath, bool reportFiles);
+    void onDirectoryChanged(const QString& directoryPath);
+    void onFileChanged(const QString& filePath);
+    void addPending(const QString& filePath);
+    void removePending(const QString& filePath);
+    void onSettleTimeout();
+    void scheduleSettleTimer();
+    static bool isMediaFile(const QString& fileName);
+
+    QFileSystemWatcher m_watcher;
+    int m_settleSeconds;
+
+    // Media file names last seen in each watched directory, to tell new files apart
+    QHash<QString, QSet<QString>> m_knownFiles;
+
+    QHash<QString, PendingFile> m_pending;
+    QTimer m_settleTimer;
+};
+
+#endif // DIRECTORYWATCHER_H
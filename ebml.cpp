@@ -0,0 +1,163 @@
+#include "ebml.h"
+#include <QIODevice>
+
+namespace Ebml {
+
+// Number of bytes of a variable length integer, from the position of its marker bit
+static int vintLength(quint8 firstByte)
+{
+    for (int length = 1; length <= 8; ++length) {
+        if (firstByte & (0x80 >> (length - 1))) {
+            return length;
+        }
+    }
+    return 0;  // 0x00 is not a valid first byte
+}
+
+bool parseElementHeader(const QByteArray& data, qint64 pos, Element& element)
+{
+    if (pos < 0 || pos >= data.size()) {
+        return false;
+    }
+
+    const quint8 *bytes = reinterpret_cast<const quint8 *>(data.constData());
+
+    // Element ID, 1-4 bytes with the marker bit kept
+    int idLength = vintLength(bytes[pos]);
+    if (idLength == 0 || idLength > 4 || pos + idLength >= data.size()) {
+        return false;
+    }
+    quint32 id = static_cast<quint32>(decodeUInt(data, pos, idLength));
+
+    // Data size, 1-8 bytes with the marker bit removed
+    qint64 sizePos = pos + idLength;
+    int sizeLength = vintLength(bytes[sizePos]);
+    if (sizeLength == 0 || sizePos + sizeLength > data.size()) {
+        return false;
+    }
+
+    quint64 valueMask = (sizeLength == 8) ? ~0ULL >> 8 : (1ULL << (7 * sizeLength)) - 1;
+    quint64 size = decodeUInt(data, sizePos, sizeLength) & valueMask;
+
+    element.id = id;
+    element.offset = pos;
+    element.headerSize = idLength + sizeLength;
+    element.sizeLength = sizeLength;
+    // All value bits set is reserved for "unknown size"
+    element.dataSize = (size == valueMask) ? UnknownSize : size;
+    return true;
+}
+
+bool readElementHeader(QIODevice *device, qint64 offset, Element& element)
+{
+    if (!device->seek(offset)) {
+        return false;
+    }
+
+    QByteArray header = device->read(MaxHeaderSize);
+    if (!parseElementHeader(header, 0, element)) {
+        return false;
+    }
+
+    element.offset = offset;
+    return true;
+}
+
+QByteArray readBytes(QIODevice *device, qint64 offset, qint64 length)
+{
+    if (length < 0 || !device->seek(offset)) {
+        return QByteArray();
+    }
+
+    QByteArray data = device->read(length);
+    return data.size() == length ? data : QByteArray();
+}
+
+quint64 decodeUInt(const QByteArray& data, qint64 pos, int length)
+{
+    quint64 value = 0;
+    for (int i = 0; i < length && pos + i < data.size(); ++i) {
+        value = (value << 8) | static_cast<quint8>(data.at(pos + i));
+    }
+    return value;
+}
+
+QByteArray encodeId(quint32 id)
+{
+    int length = 1;
+    if (id > 0xFFFFFF) {
+        length = 4;
+    } else if (id > 0xFFFF) {
+        length = 3;
+    } else if (id > 0xFF) {
+        length = 2;
+    }
+    return encodeUInt(id, length);
+}
+
+QByteArray encodeSize(quint64 size, int length)
+{
+    if (length == 0) {
+        length = 1;
+        // All value bits set would read back as "unknown size"
+        while (length < 8 && size >= (1ULL << (7 * length)) - 1) {
+            ++length;
+        }
+    }
+
+    if (length < 1 || length > 8) {
+        return QByteArray();
+    }
+
+    quint64 valueMask = (length == 8) ? ~0ULL >> 8 : (1ULL << (7 * length)) - 1;
+    if (size >= valueMask) {
+        return QByteArray();
+    }
+
+    quint64 marker = 1ULL << (7 * length);
+    QByteArray encoded = encodeUInt(size | marker, length);
+    return encoded;
+}
+
+QByteArray encodeUInt(quint64 value, int length)
+{
+    if (length == 0) {
+        length = 1;
+        while (length < 8 && (value >> (8 * length)) != 0) {
+            ++length;
+        }
+    }
+
+    QByteArray encoded(length, '\0');
+    for (int i = length - 1; i >= 0; --i) {
+        encoded[i] = static_cast<char>(value & 0xFF);
+        value >>= 8;
+    }
+    return encoded;
+}
+
+QByteArray element(quint32 id, const QByteArray& payload)
+{
+    return encodeId(id) + encodeSize(static_cast<quint64>(payload.size())) + payload;
+}
+
+QByteArray uintElement(quint32 id, quint64 value, int length)
+{
+    return element(id, encodeUInt(value, length));
+}
+
+QByteArray stringElement(quint32 id, const QByteArray& value)
+{
+    return element(id, value);
+}
+
+QByteArray voidHeader(qint64 totalSize)
+{
+    // Small voids use a 1 byte size, everything else a fixed 8 byte size
+    if (totalSize - 2 <= 126) {
+        return encodeId(Void) + encodeSize(static_cast<quint64>(totalSize - 2), 1);
+    }
+    return encodeId(Void) + encodeSize(static_cast<quint64>(totalSize - 9), 8);
+}
+
+} // namespace Ebml
@@ -0,0 +1,97 @@
+#ifndef EBML_H
+#define EBML_H
+
+#include <QByteArray>
+#include <QtGlobal>
+
+class QIODevice;
+
+// Minimal EBML (Matroska) primitives: element IDs, header parsing and encoding
+namespace Ebml {
+
+// Element IDs, marker bits included as they appear in the file
+constexpr quint32 EBMLHeader = 0x1A45DFA3;
+constexpr quint32 Segment = 0x18538067;
+constexpr quint32 SeekHead = 0x114D9B74;
+constexpr quint32 Seek = 0x4DBB;
+constexpr quint32 SeekID = 0x53AB;
+constexpr quint32 SeekPosition = 0x53AC;
+constexpr quint32 Info = 0x1549A966;
+constexpr quint32 TimestampScale = 0x2AD7B1;
+constexpr quint32 Duration = 0x4489;
+constexpr quint32 Tracks = 0x1654AE6B;
+constexpr quint32 Cluster = 0x1F43B675;
+constexpr quint32 Cues = 0x1C53BB6B;
+constexpr quint32 Chapters = 0x1043A770;
+constexpr quint32 Tags = 0x1254C367;
+constexpr quint32 Attachments = 0x1941A469;
+constexpr quint32 AttachedFile = 0x61A7;
+constexpr quint32 FileDescription = 0x467E;
+constexpr quint32 FileName = 0x466E;
+constexpr quint32 FileMimeType = 0x4660;
+constexpr quint32 FileData = 0x465C;
+constexpr quint32 FileUID = 0x46AE;
+constexpr quint32 Tag = 0x7373;
+constexpr quint32 Targets = 0x63C0;
+constexpr quint32 TargetTypeValue = 0x68CA;
+constexpr quint32 TargetType = 0x63CA;
+constexpr quint32 TagTrackUID = 0x63C5;
+constexpr quint32 TagEditionUID = 0x63C9;
+constexpr quint32 TagChapterUID = 0x63C4;
+constexpr quint32 TagAttachmentUID = 0x63C6;
+constexpr quint32 SimpleTag = 0x67C8;
+constexpr quint32 TagName = 0x45A3;
+constexpr quint32 TagLanguage = 0x447A;
+constexpr quint32 TagString = 0x4487;
+constexpr quint32 Void = 0xEC;
+constexpr quint32 Crc32 = 0xBF;
+
+// Size value of elements whose size is not known (live streams, unfinalized files)
+constexpr quint64 UnknownSize = ~0ULL;
+
+// Longest possible element header: 4 byte ID + 8 byte size
+constexpr int MaxHeaderSize = 12;
+
+struct Element {
+    quint32 id = 0;
+    qint64 offset = 0;       // Position of the ID
+    int headerSize = 0;      // ID + size field
+    int sizeLength = 0;      // Length of the size field alone
+    quint64 dataSize = 0;    // UnknownSize if not known
+
+    bool hasUnknownSize() const { return dataSize == UnknownSize; }
+    qint64 dataOffset() const { return offset + headerSize; }
+    qint64 totalSize() const { return headerSize + static_cast<qint64>(dataSize); }
+    qint64 endOffset() const { return offset + totalSize(); }
+};
+
+// Parse the element header at pos in data, element.offset is relative to data
+bool parseElementHeader(const QByteArray& data, qint64 pos, Element& element);
+
+// Read and parse the element header at offset in device
+bool readElementHeader(QIODevice *device, qint64 offset, Element& element);
+
+// Read length bytes at offset, returns an empty array on short reads
+QByteArray readBytes(QIODevice *device, qint64 offset, qint64 length);
+
+// Big-endian unsigned integer of length bytes at pos (IDs and uint elements)
+quint64 decodeUInt(const QByteArray& data, qint64 pos, int length);
+
+QByteArray encodeId(quint32 id);
+// Encode size with exactly length bytes (1-8), or the shortest length if length is 0.
+// Returns an empty array if the value doesn't fit.
+QByteArray encodeSize(quint64 size, int length = 0);
+// Big-endian unsigned integer with exactly length bytes, or the shortest length if 0
+QByteArray encodeUInt(quint64 value, int length = 0);
+
+QByteArray element(quint32 id, const QByteArray& payload);
+QByteArray uintElement(quint32 id, quint64 value, int length = 0);
+QByteArray stringElement(quint32 id, const QByteArray& value);
+
+// Header of a Void element spanning totalSize bytes (at least 2). Only the header
+// needs to be written, the previous content of the region becomes the void payload.
+QByteArray voidHeader(qint64 totalSize);
+
+} // namespace Ebml
+
+#endif // EBML_H
@@ -0,0 +1,249 @@
+#include "fixturegenerator.h"
+#include "mp4atoms.h"
+#include "ebml.h"
+#include <QFile>
+
+namespace {
+
+// Start of every MP4 chunk: "CHNK" + chunk index
+QByteArray chunkMarker(int index)
+{
+    return QByteArray("CHNK") + Mp4::encodeUInt32(static_cast<quint32>(index));
+}
+
+QByteArray encodeUInt64(quint64 value)
+{
+    QByteArray data(8, '\0');
+    Mp4::writeUInt64(data, 0, value);
+    return data;
+}
+
+// moov with one video track whose chunk offset table lists offsets, and an
+// iTunes style udta/meta/ilst with paddingBytes of "free" after the ilst
+QByteArray renderMoov(const QList<qint64>& offsets, bool largeOffsets, qint64 paddingBytes)
+{
+    QByteArray table = Mp4::encodeUInt32(0) + Mp4::encodeUInt32(static_cast<quint32>(offsets.size()));
+    for (qint64 offset : offsets) {
+        table += largeOffsets ? encodeUInt64(static_cast<quint64>(offset))
+                              : Mp4::encodeUInt32(static_cast<quint32>(offset));
+    }
+
+    QByteArray stbl = Mp4::renderAtom("stsd", QByteArray(8, '\0'))
+                      + Mp4::renderAtom(largeOffsets ? "co64" : "stco", table);
+    QByteArray mdia = Mp4::renderAtom("mdhd", QByteArray(24, '\0'))
+                      + Mp4::renderAtom("hdlr", QByteArray(8, '\0') + "vide" + QByteArray(13, '\0'))
+                      + Mp4::renderAtom("minf", Mp4::renderAtom("stbl", stbl));
+    QByteArray trak = Mp4::renderAtom("tkhd", QByteArray(84, '\0'))
+                      + Mp4::renderAtom("mdia", mdia);
+
+    QByteArray meta = Mp4::encodeUInt32(0)
+                      + Mp4::renderAtom("hdlr", QByteArray(8, '\0') + "mdirappl" + QByteArray(9, '\0'))
+                      + Mp4::renderAtom("ilst", QByteArray());
+    if (paddingBytes >= Mp4::HeaderSize) {
+        meta += Mp4::freeAtom(paddingBytes);
+    }
+
+    return Mp4::renderAtom("moov", Mp4::renderAtom("mvhd", QByteArray(100, '\0'))
+                                   + Mp4::renderAtom("trak", trak)
+                                   + Mp4::renderAtom("udta", Mp4::renderAtom("meta", meta)));
+}
+
+QByteArray seekEntry(quint32 id, qint64 position)
+{
+    return Ebml::element(Ebml::Seek, Ebml::element(Ebml::SeekID, Ebml::encodeId(id))
+                                     + Ebml::uintElement(Ebml::SeekPosition, static_cast<quint64>(position), 8));
+}
+
+bool fail(QString *errorString, const QString& message)
+{
+    if (errorString) {
+        *errorString = message;
+    }
+    return false;
+}
+
+} // namespace
+
+bool FixtureGenerator::writeMp4(const QString& filePath, const Mp4Options& options, QString *errorString)
+{
+    int chunkCount = qMax(1, options.chunkCount);
+    qint64 payloadBytes = qMax<qint64>(options.payloadBytes, chunkCount * 8);
+    qint64 chunkSize = payloadBytes / chunkCount;
+
+    // Step 1: Sizes. Beyond 4 GiB mdat needs a 64-bit header and the offsets a co64 table.
+    bool large = payloadBytes + 1024 * 1024 > 0xFFFFFFFFLL;
+    QByteArray ftyp = Mp4::renderAtom("ftyp", QByteArray("isom") + Mp4::encodeUInt32(512) + "isomiso2mp41");
+    QByteArray mdatHeader = large ? Mp4::encodeUInt32(1) + "mdat" + encodeUInt64(static_cast<quint64>(payloadBytes + Mp4::LargeHeaderSize))
+                                  : Mp4::encodeUInt32(static_cast<quint32>(payloadBytes + Mp4::HeaderSize)) + "mdat";
+    qint64 moovSize = renderMoov(QList<qint64>(chunkCount, 0), large, options.paddingBytes).size();
+
+    bool moovFirst = options.layout == Mp4Layout::MoovFirst;
+    qint64 mdatOffset = ftyp.size() + (moovFirst ? moovSize : 0);
+    qint64 payloadOffset = mdatOffset + mdatHeader.size();
+    qint64 mdatEnd = payloadOffset + payloadBytes;
+
+    // Step 2: Chunk offsets into the payload
+    QList<qint64> offsets;
+    for (int i = 0; i < chunkCount; ++i) {
+        offsets.append(payloadOffset + i * chunkSize);
+    }
+    QByteArray moov = renderMoov(offsets, large, options.paddingBytes);
+
+    // Step 3: Write the headers and chunk markers, the payload in between stays a hole
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return fail(errorString, file.errorString());
+    }
+
+    bool ok = file.write(ftyp) == ftyp.size();
+    if (moovFirst) {
+        ok = ok && file.write(moov) == moov.size();
+    }
+    ok = ok && file.seek(mdatOffset) && file.write(mdatHeader) == mdatHeader.size();
+    for (int i = 0; ok && i < chunkCount; ++i) {
+        QByteArray marker = chunkMarker(i);
+        ok = file.seek(offsets.at(i)) && file.write(marker) == marker.size();
+    }
+    if (moovFirst) {
+        ok = ok && file.resize(mdatEnd);
+    } else {
+        ok = ok && file.seek(mdatEnd) && file.write(moov) == moov.size();
+    }
+
+    if (!ok) {
+        return fail(errorString, file.errorString());
+    }
+    return true;
+}
+
+bool FixtureGenerator::writeMkv(const QString& filePath, const MkvOptions& options, QString *errorString)
+{
+    int clusterCount = qMax(1, options.clusterCount);
+    qint64 blockSize = qMax<qint64>(4, options.payloadBytes / clusterCount);
+
+    // Step 1: Elements in front of the clusters
+    QByteArray ebmlHeader = Ebml::element(Ebml::EBMLHeader,
+                                          Ebml::uintElement(0x4286, 1)        // EBMLVersion
+                                          + Ebml::uintElement(0x42F7, 1)      // EBMLReadVersion
+                                          + Ebml::uintElement(0x42F2, 4)      // EBMLMaxIDLength
+                                          + Ebml::uintElement(0x42F3, 8)      // EBMLMaxSizeLength
+                                          + Ebml::stringElement(0x4282, "matroska")
+                                          + Ebml::uintElement(0x4287, 4)      // DocTypeVersion
+                                          + Ebml::uintElement(0x4285, 2));    // DocTypeReadVersion
+    QByteArray info = Ebml::element(Ebml::Info,
+                                    Ebml::uintElement(0x2AD7B1, 1000000)      // TimestampScale
+                                    + Ebml::stringElement(0x4D80, "MovieTagBench")
+                                    + Ebml::stringElement(0x5741, "MovieTagBench"));
+    QByteArray tracks = Ebml::element(Ebml::Tracks,
+                                      Ebml::element(0xAE,                     // TrackEntry
+                                                    Ebml::uintElement(0xD7, 1)            // TrackNumber
+                                                    + Ebml::uintElement(0x73C5, 1)        // TrackUID
+                                                    + Ebml::uintElement(0x83, 1)          // TrackType: video
+                                                    + Ebml::stringElement(0x86, "V_MPEG4/ISO/AVC")));
+
+    // Step 2: Segment layout, positions are relative to the segment data. The SeekHead
+    // has 8-byte positions, so its size doesn't depend on them.
+    qint64 seekHeadSize = Ebml::element(Ebml::SeekHead, seekEntry(Ebml::Info, 0) + seekEntry(Ebml::Tracks, 0)).size();
+    qint64 voidBytes = options.voidBytes >= 2 ? options.voidBytes : 0;
+    qint64 infoPosition = seekHeadSize + voidBytes;
+    qint64 tracksPosition = infoPosition + info.size();
+    qint64 clustersPosition = tracksPosition + tracks.size();
+    QByteArray seekHead = Ebml::element(Ebml::SeekHead, seekEntry(Ebml::Info, infoPosition)
+                                                        + seekEntry(Ebml::Tracks, tracksPosition));
+
+    // Every cluster: Timestamp, then one SimpleBlock whose data is left as a hole
+    // apart from its track number, timecode and flags
+    QByteArray blockStart = QByteArray::fromHex("81000080");
+    auto clusterHead = [blockSize](int index) {
+        QByteArray timestamp = Ebml::uintElement(0xE7, static_cast<quint64>(index) * 1000);
+        QByteArray blockHeader = Ebml::encodeId(0xA3) + Ebml::encodeSize(static_cast<quint64>(blockSize), 8);
+        quint64 dataSize = static_cast<quint64>(timestamp.size() + blockHeader.size() + blockSize);
+        return Ebml::encodeId(Ebml::Cluster) + Ebml::encodeSize(dataSize, 8) + timestamp + blockHeader;
+    };
+    qint64 clusterSize = clusterHead(0).size() + blockSize;
+    qint64 segmentSize = clustersPosition + clusterCount * clusterSize;
+    QByteArray segmentHeader = Ebml::encodeId(Ebml::Segment) + Ebml::encodeSize(static_cast<quint64>(segmentSize), 8);
+    qint64 segmentData = ebmlHeader.size() + segmentHeader.size();
+
+    // Step 3: Write
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return fail(errorString, file.errorString());
+    }
+
+    bool ok = file.write(ebmlHeader) == ebmlHeader.size()
+              && file.write(segmentHeader) == segmentHeader.size()
+              && file.write(seekHead) == seekHead.size();
+    if (ok && voidBytes > 0) {
+        QByteArray header = Ebml::voidHeader(voidBytes);
+        ok = file.write(header) == header.size();
+    }
+    ok = ok && file.seek(segmentData + infoPosition)
+         && file.write(info) == info.size()
+         && file.write(tracks) == tracks.size();
+    for (int i = 0; ok && i < clusterCount; ++i) {
+        QByteArray head = clusterHead(i) + blockStart;
+        ok = file.seek(segmentData + clustersPosition + i * clusterSize) && file.write(head) == head.size();
+    }
+    ok = ok && file.resize(segmentData + segmentSize);
+
+    if (!ok) {
+        return fail(errorString, file.errorString());
+    }
+    return true;
+}
+
+bool FixtureGenerator::verifyMp4(const QString& filePath, QString *errorString)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return fail(errorString, file.errorString());
+    }
+
+    // Step 1: Find moov among the top level atoms
+    Mp4::Atom moovAtom;
+    bool found = false;
+    for (qint64 offset = 0; offset < file.size() && !found; ) {
+        Mp4::Atom atom;
+        if (!Mp4::readAtomHeader(&file, offset, file.size(), atom)) {
+            return fail(errorString, QString("Malformed atom at offset %1").arg(offset));
+        }
+        found = atom.type == "moov";
+        moovAtom = atom;
+        offset = atom.endOffset();
+    }
+    if (!found) {
+        return fail(errorString, "No moov atom");
+    }
+
+    // Step 2: Walk down to the chunk offset table of the (only) track
+    file.seek(moovAtom.offset);
+    QByteArray moov = file.read(moovAtom.size);
+    moovAtom.offset = 0;
+
+    Mp4::Atom trak, mdia, minf, stbl, table;
+    if (!Mp4::findChild(moov, moovAtom, "trak", trak) || !Mp4::findChild(moov, trak, "mdia", mdia)
+        || !Mp4::findChild(moov, mdia, "minf", minf) || !Mp4::findChild(moov, minf, "stbl", stbl)) {
+        return fail(errorString, "No sample table");
+    }
+    bool large = Mp4::findChild(moov, stbl, "co64", table);
+    if (!large && !Mp4::findChild(moov, stbl, "stco", table)) {
+        return fail(errorString, "No chunk offset table");
+    }
+
+    // Step 3: Every entry must point at the marker of its chunk
+    qint64 entryPos = table.dataOffset() + 8;
+    quint32 count = Mp4::readUInt32(moov, table.dataOffset() + 4);
+    int entrySize = large ? 8 : 4;
+    if (entryPos + static_cast<qint64>(count) * entrySize > table.endOffset()) {
+        return fail(errorString, "Truncated chunk offset table");
+    }
+    for (quint32 i = 0; i < count; ++i, entryPos += entrySize) {
+        qint64 offset = large ? static_cast<qint64>(Mp4::readUInt64(moov, entryPos)) : Mp4::readUInt32(moov, entryPos);
+        QByteArray expected = chunkMarker(static_cast<int>(i));
+        if (!file.seek(offset) || file.read(expected.size()) != expected) {
+            return fail(errorString, QString("Chunk %1 offset %2 doesn't point at its data").arg(i).arg(offset));
+        }
+    }
+    return true;
+}
@@ -0,0 +1,43 @@
+#ifndef FIXTUREGENERATOR_H
+#define FIXTUREGENERATOR_H
+
+#include <QString>
+#include <QtGlobal>
+
+// Synthetic MP4 and MKV files for the benchmarks. The container structure is
+// complete (everything MediaTagWriter and TagProbe look at is there), the media
+// payload is left as a hole, so multi-GB files are created instantly and take
+// no disk space on filesystems with sparse files.
+class FixtureGenerator
+{
+public:
+    enum class Mp4Layout {
+        MoovFirst,      // ftyp, moov, mdat: "fast start", tagging shifts the media data
+        MoovLast        // ftyp, mdat, moov: moov can grow at the end of the file
+    };
+
+    struct Mp4Options {
+        Mp4Layout layout = Mp4Layout::MoovFirst;
+        qint64 payloadBytes = 4 * 1024 * 1024;
+        // Size of the "free" atom after ilst, 0 for none. A cover that fits is written in place.
+        qint64 paddingBytes = 0;
+        // Chunks in mdat, each starts with a marker verifyMp4() checks
+        int chunkCount = 16;
+    };
+
+    struct MkvOptions {
+        qint64 payloadBytes = 4 * 1024 * 1024;
+        // Void element after the SeekHead, 0 for none. Room for the attachments in front of the clusters.
+        qint64 voidBytes = 0;
+        int clusterCount = 16;
+    };
+
+    static bool writeMp4(const QString& filePath, const Mp4Options& options, QString *errorString = nullptr);
+    static bool writeMkv(const QString& filePath, const MkvOptions& options, QString *errorString = nullptr);
+
+    // True if every stco/co64 entry still points at the marker of its chunk, i.e. a
+    // tag write that moved the media data updated the chunk offsets correctly
+    static bool verifyMp4(const QString& filePath, QString *errorString = nullptr);
+};
+
+#endif // FIXTUREGENERATOR_H
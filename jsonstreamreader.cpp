@@ -0,0 +1,334 @@
+#include "jsonstreamreader.h"
+
+JsonStreamReader::JsonStreamReader()
+    : m_pos(0)
+    , m_state(State::ExpectValue)
+{
+}
+
+JsonStreamReader::~JsonStreamReader()
+{
+}
+
+bool JsonStreamReader::addData(const QByteArray& data)
+{
+    if (hasError()) {
+        return false;
+    }
+
+    m_buffer += data;
+    return parse(false);
+}
+
+bool JsonStreamReader::finish()
+{
+    if (hasError() || !parse(true)) {
+        return false;
+    }
+
+    if (m_state != State::Done) {
+        return fail("Unexpected end of JSON data");
+    }
+    return true;
+}
+
+bool JsonStreamReader::hasError() const
+{
+    return !m_errorString.isEmpty();
+}
+
+QString JsonStreamReader::errorString() const
+{
+    return m_errorString;
+}
+
+int JsonStreamReader::depth() const
+{
+    return static_cast<int>(m_levels.size());
+}
+
+QString JsonStreamReader::keyAt(int level) const
+{
+    if (level < 0 || level >= m_levels.size() || !m_levels.at(level).isObject) {
+        return QString();
+    }
+    return m_levels.at(level).key;
+}
+
+QString JsonStreamReader::key() const
+{
+    return keyAt(depth() - 1);
+}
+
+bool JsonStreamReader::fail(const QString& message)
+{
+    m_errorString = message;
+    return false;
+}
+
+bool JsonStreamReader::parse(bool atEnd)
+{
+    bool needMoreData = false;
+    while (!needMoreData) {
+        // Skip whitespace between tokens
+        while (m_pos < m_buffer.size() && (m_buffer.at(m_pos) == ' ' || m_buffer.at(m_pos) == '\n'
+                                           || m_buffer.at(m_pos) == '\r' || m_buffer.at(m_pos) == '\t')) {
+            ++m_pos;
+        }
+        if (m_pos >= m_buffer.size()) {
+            break;
+        }
+
+        char c = m_buffer.at(m_pos);
+        switch (m_state) {
+        case State::Done:
+            return fail("Unexpected data after the JSON document");
+
+        case State::ExpectColon:
+            if (c != ':') {
+                return fail("Expected ':' after object key");
+            }
+            ++m_pos;
+            m_state = State::ExpectValue;
+            break;
+
+        case State::ExpectCommaOrEnd:
+            if (c == ',') {
+                ++m_pos;
+                m_state = m_levels.last().isObject ? State::ExpectKey : State::ExpectValue;
+            } else if (!close(c)) {
+                return false;
+            }
+            break;
+
+        case State::ExpectKeyOrEnd:
+            if (c == '}') {
+                if (!close(c)) {
+                    return false;
+                }
+                break;
+            }
+            Q_FALLTHROUGH();
+
+        case State::ExpectKey: {
+            if (c != '"') {
+                return fail("Expected object key");
+            }
+            QString key;
+            bool complete = false;
+            if (!readString(key, complete)) {
+                return false;
+            }
+            if (!complete) {
+                needMoreData = true;
+                break;
+            }
+            m_levels.last().key = key;
+            m_state = State::ExpectColon;
+            break;
+        }
+
+        case State::ExpectValueOrEnd:
+            if (c == ']') {
+                if (!close(c)) {
+                    return false;
+                }
+                break;
+            }
+            Q_FALLTHROUGH();
+
+        case State::ExpectValue: {
+            if (c == '{' || c == '[') {
+                ++m_pos;
+                open(c == '{');
+                break;
+            }
+
+            // Scalars are only reported once complete, a partial token waits for more data
+            QJsonValue scalar;
+            bool complete = false;
+            bool ok = false;
+            if (c == '"') {
+                QString string;
+                ok = readString(string, complete);
+                scalar = string;
+            } else if (c == '-' || (c >= '0' && c <= '9')) {
+                double number = 0;
+                ok = readNumber(atEnd, number, complete);
+                scalar = number;
+            } else {
+                ok = readLiteral(scalar, complete);
+            }
+
+            if (!ok) {
+                return false;
+            }
+            if (!complete) {
+                needMoreData = true;
+                break;
+            }
+            value(scalar);
+            afterValue();
+            break;
+        }
+        }
+    }
+
+    // Drop what has been consumed, only an incomplete token stays buffered
+    m_buffer.remove(0, m_pos);
+    m_pos = 0;
+    return true;
+}
+
+bool JsonStreamReader::readString(QString& string, bool& complete)
+{
+    complete = false;
+    QByteArray utf8;
+    qsizetype pos = m_pos + 1;
+
+    while (pos < m_buffer.size()) {
+        char c = m_buffer.at(pos);
+        if (c == '"') {
+            string += QString::fromUtf8(utf8);
+            m_pos = pos + 1;
+            complete = true;
+            return true;
+        }
+
+        if (c != '\\') {
+            utf8 += c;
+            ++pos;
+            continue;
+        }
+
+        // Escape sequence, may be cut off at the end of the buffer
+        if (pos + 1 >= m_buffer.size()) {
+            return true;
+        }
+        char escaped = m_buffer.at(pos + 1);
+        switch (escaped) {
+        case '"': utf8 += '"'; break;
+        case '\\': utf8 += '\\'; break;
+        case '/': utf8 += '/'; break;
+        case 'b': utf8 += '\b'; break;
+        case 'f': utf8 += '\f'; break;
+        case 'n': utf8 += '\n'; break;
+        case 'r': utf8 += '\r'; break;
+        case 't': utf8 += '\t'; break;
+        case 'u': {
+            if (pos + 6 > m_buffer.size()) {
+                return true;
+            }
+            bool ok = false;
+            ushort unit = m_buffer.mid(pos + 2, 4).toUShort(&ok, 16);
+            if (!ok) {
+                return fail("Invalid \\u escape in JSON string");
+            }
+            // Surrogate pairs arrive as two escapes, UTF-16 code units can be appended as they are
+            string += QString::fromUtf8(utf8);
+            utf8.clear();
+            string += QChar(unit);
+            pos += 4;
+            break;
+        }
+        default:
+            return fail("Invalid escape in JSON string");
+        }
+        pos += 2;
+    }
+
+    return true;
+}
+
+bool JsonStreamReader::readNumber(bool atEnd, double& number, bool& complete)
+{
+    complete = false;
+    qsizetype pos = m_pos;
+    while (pos < m_buffer.size()) {
+        char c = m_buffer.at(pos);
+        if (!((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E')) {
+            break;
+        }
+        ++pos;
+    }
+
+    // A number running up to the end of the buffer may continue in the next chunk
+    if (pos == m_buffer.size() && !atEnd) {
+        return true;
+    }
+
+    bool ok = false;
+    number = m_buffer.mid(m_pos, pos - m_pos).toDouble(&ok);
+    if (!ok) {
+        return fail("Invalid number in JSON data");
+    }
+    m_pos = pos;
+    complete = true;
+    return true;
+}
+
+bool JsonStreamReader::readLiteral(QJsonValue& literal, bool& complete)
+{
+    static const struct {
+        const char *text;
+        QJsonValue value;
+    } literals[] = {
+        { "true", QJsonValue(true) },
+        { "false", QJsonValue(false) },
+        { "null", QJsonValue(QJsonValue::Null) },
+    };
+
+    complete = false;
+    QByteArray rest = m_buffer.mid(m_pos, 5);
+    for (const auto& candidate : literals) {
+        QByteArray text(candidate.text);
+        if (rest.startsWith(text)) {
+            literal = candidate.value;
+            m_pos += text.size();
+            complete = true;
+            return true;
+        }
+        // Cut off at the end of the buffer
+        if (text.startsWith(rest) && m_pos + rest.size() == m_buffer.size()) {
+            return true;
+        }
+    }
+
+    return fail("Unexpected character in JSON data");
+}
+
+void JsonStreamReader::open(bool isObject)
+{
+    // Handlers see the container from its parent's point of view
+    if (isObject) {
+        startObject();
+    } else {
+        startArray();
+    }
+
+    m_levels.append(Level{isObject, QString()});
+    m_state = isObject ? State::ExpectKeyOrEnd : State::ExpectValueOrEnd;
+}
+
+bool JsonStreamReader::close(char bracket)
+{
+    bool isObject = bracket == '}';
+    if ((bracket != '}' && bracket != ']') || m_levels.isEmpty() || m_levels.last().isObject != isObject) {
+        return fail("Unexpected character in JSON data");
+    }
+
+    ++m_pos;
+    m_levels.removeLast();
+    if (isObject) {
+        endObject();
+    } else {
+        endArray();
+    }
+    afterValue();
+    return true;
+}
+
+void JsonStreamReader::afterValue()
+{
+    m_state = m_levels.isEmpty() ? State::Done : State::ExpectCommaOrEnd;
+}
@@ -0,0 +1,74 @@
+#ifndef JSONSTREAMREADER_H
+#define JSONSTREAMREADER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QList>
+#include <QJsonValue>
+
+// Incremental (SAX style) JSON reader. Data can be added in arbitrary chunks as it
+// arrives from the network, events are reported to the virtual handlers as soon as
+// a token is complete. Nothing but the current nesting is kept in memory.
+//
+// In every handler depth() is the number of containers enclosing the item and
+// keyAt(depth() - 1) (or key()) the key of the item in its innermost object.
+class JsonStreamReader
+{
+public:
+    JsonStreamReader();
+    virtual ~JsonStreamReader();
+
+    // Returns false once the data is not valid JSON
+    bool addData(const QByteArray& data);
+    // End of input, returns true if exactly one complete document was read
+    bool finish();
+
+    bool hasError() const;
+    QString errorString() const;
+
+protected:
+    virtual void startObject() {}
+    virtual void endObject() {}
+    virtual void startArray() {}
+    virtual void endArray() {}
+    // Strings, numbers, booleans and null
+    virtual void value(const QJsonValue& value) { Q_UNUSED(value) }
+
+    int depth() const;
+    // Current key of the object at level (0 is the root), empty for arrays
+    QString keyAt(int level) const;
+    QString key() const;
+
+private:
+    enum class State {
+        ExpectValue,
+        ExpectValueOrEnd,   // Right after '['
+        ExpectKeyOrEnd,     // Right after '{'
+        ExpectKey,
+        ExpectColon,
+        ExpectCommaOrEnd,
+        Done
+    };
+
+    struct Level {
+        bool isObject;
+        QString key;
+    };
+
+    bool parse(bool atEnd);
+    bool readString(QString& string, bool& complete);
+    bool readNumber(bool atEnd, double& number, bool& complete);
+    bool readLiteral(QJsonValue& literal, bool& complete);
+    void open(bool isObject);
+    bool close(char bracket);
+    void afterValue();
+    bool fail(const QString& message);
+
+    QByteArray m_buffer;
+    qsizetype m_pos;
+    State m_state;
+    QList<Level> m_levels;
+    QString m_errorString;
+};
+
+#endif // JSONSTREAMREADER_H
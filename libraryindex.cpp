@@ -0,0 +1,198 @@
+#include "libraryindex.h"
+#include <QStandardPaths>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QFile>
+#include <QDir>
+#include <QSqlError>
+#include <QVariant>
+#include <QDebug>
+
+// Bytes hashed at the start and at the end of a file
+static const qint64 PARTIAL_HASH_BYTES = 64 * 1024;
+
+LibraryIndex::LibraryIndex(const QString& databasePath)
+    : m_databasePath(databasePath)
+{
+    // Connection names are process wide, every instance gets its own
+    m_connectionName = QString("LibraryIndex-%1").arg(reinterpret_cast<quintptr>(this), 0, 16);
+}
+
+LibraryIndex::~LibraryIndex()
+{
+    // Queries must be gone before the connection can be removed
+    m_selectQuery = QSqlQuery();
+    m_upsertQuery = QSqlQuery();
+    m_touchQuery = QSqlQuery();
+    if (m_database.isValid()) {
+        m_database.close();
+        m_database = QSqlDatabase();
+        QSqlDatabase::removeDatabase(m_connectionName);
+    }
+}
+
+QString LibraryIndex::defaultDatabasePath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) + "/MovieTag/library-index.sqlite";
+}
+
+bool LibraryIndex::open()
+{
+    if (isOpen()) {
+        return true;
+    }
+
+    // Step 1: Open (or create) the database file
+    QDir().mkpath(QFileInfo(m_databasePath).absolutePath());
+    m_database = QSqlDatabase::addDatabase("QSQLITE", m_connectionName);
+    m_database.setDatabaseName(m_databasePath);
+    if (!m_database.open()) {
+        return fail(QString("Couldn't open library index %1: %2").arg(m_databasePath, m_database.lastError().text()));
+    }
+
+    // Step 2: Cheap commits, one per tagged file. WAL keeps the index consistent if we crash.
+    QSqlQuery pragma(m_database);
+    pragma.exec("PRAGMA journal_mode=WAL");
+    pragma.exec("PRAGMA synchronous=NORMAL");
+
+    // Step 3: Schema
+    QSqlQuery create(m_database);
+    if (!create.exec("CREATE TABLE IF NOT EXISTS files ("
+                     " path TEXT PRIMARY KEY,"
+                     " size INTEGER NOT NULL,"
+                     " mtime INTEGER NOT NULL,"
+                     " content_hash BLOB NOT NULL,"
+                     " tmdb_id INTEGER,"
+                     " cover_hash BLOB,"
+                     " tagged_at INTEGER NOT NULL)")) {
+        return fail("Couldn't create library index: " + create.lastError().text());
+    }
+
+    // Step 4: Statements used per file are prepared once
+    m_selectQuery = QSqlQuery(m_database);
+    m_upsertQuery = QSqlQuery(m_database);
+    m_touchQuery = QSqlQuery(m_database);
+    if (!m_selectQuery.prepare("SELECT size, mtime, content_hash FROM files WHERE path = ?")
+        || !m_upsertQuery.prepare("INSERT OR REPLACE INTO files"
+                                  " (path, size, mtime, content_hash, tmdb_id, cover_hash, tagged_at)"
+                                  " VALUES (?, ?, ?, ?, ?, ?, ?)")
+        || !m_touchQuery.prepare("UPDATE files SET mtime = ? WHERE path = ?")) {
+        return fail("Couldn't prepare library index queries: " + m_database.lastError().text());
+    }
+    m_selectQuery.setForwardOnly(true);
+
+    return true;
+}
+
+bool LibraryIndex::isOpen() const
+{
+    return m_database.isValid() && m_database.isOpen();
+}
+
+QString LibraryIndex::errorString() const
+{
+    return m_errorString;
+}
+
+bool LibraryIndex::fail(const QString& message)
+{
+    m_errorString = message;
+    qWarning().noquote() << message;
+    return false;
+}
+
+bool LibraryIndex::isUpToDate(const QFileInfo& fileInfo)
+{
+    if (!isOpen()) {
+        return false;
+    }
+
+    QString filePath = fileInfo.absoluteFilePath();
+    m_selectQuery.addBindValue(filePath);
+    if (!m_selectQuery.exec() || !m_selectQuery.next()) {
+        m_selectQuery.finish();
+        return false;
+    }
+
+    qint64 size = m_selectQuery.value(0).toLongLong();
+    qint64 mtime = m_selectQuery.value(1).toLongLong();
+    QByteArray contentHash = m_selectQuery.value(2).toByteArray();
+    m_selectQuery.finish();
+
+    // Common case: nothing changed, decided without reading the file
+    qint64 currentMtime = fileInfo.lastModified().toMSecsSinceEpoch();
+    if (size != fileInfo.size()) {
+        return false;
+    }
+    if (mtime == currentMtime) {
+        return true;
+    }
+
+    // Only touched (copied, restored from backup, ...), check the content
+    if (partialContentHash(filePath, size) != contentHash) {
+        return false;
+    }
+
+    m_touchQuery.addBindValue(currentMtime);
+    m_touchQuery.addBindValue(filePath);
+    m_touchQuery.exec();
+    return true;
+}
+
+bool LibraryIndex::recordTagged(const QString& filePath, int tmdbId, const QByteArray& coverData)
+{
+    if (!isOpen()) {
+        return false;
+    }
+
+    // Stat again, writing the tags changed size and time
+    QFileInfo fileInfo(filePath);
+    if (!fileInfo.exists()) {
+        return false;
+    }
+
+    m_upsertQuery.addBindValue(fileInfo.absoluteFilePath());
+    m_upsertQuery.addBindValue(fileInfo.size());
+    m_upsertQuery.addBindValue(fileInfo.lastModified().toMSecsSinceEpoch());
+    m_upsertQuery.addBindValue(partialContentHash(fileInfo.absoluteFilePath(), fileInfo.size()));
+    m_upsertQuery.addBindValue(tmdbId > 0 ? QVariant(tmdbId) : QVariant());
+    m_upsertQuery.addBindValue(coverData.isEmpty() ? QVariant()
+                                                   : QVariant(QCryptographicHash::hash(coverData, QCryptographicHash::Sha1)));
+    m_upsertQuery.addBindValue(QDateTime::currentSecsSinceEpoch());
+    if (!m_upsertQuery.exec()) {
+        return fail(QString("Couldn't record %1 in library index: %2").arg(filePath, m_upsertQuery.lastError().text()));
+    }
+    return true;
+}
+
+void LibraryIndex::remove(const QString& filePath)
+{
+    if (!isOpen()) {
+        return;
+    }
+
+    QSqlQuery query(m_database);
+    query.prepare("DELETE FROM files WHERE path = ?");
+    query.addBindValue(QFileInfo(filePath).absoluteFilePath());
+    query.exec();
+}
+
+QByteArray LibraryIndex::partialContentHash(const QString& filePath, qint64 size)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(QByteArray::number(size));
+    hash.addData(file.read(PARTIAL_HASH_BYTES));
+
+    // Small files are covered by the head alone
+    if (size > 2 * PARTIAL_HASH_BYTES && file.seek(size - PARTIAL_HASH_BYTES)) {
+        hash.addData(file.read(PARTIAL_HASH_BYTES));
+    } else if (size > PARTIAL_HASH_BYTES) {
+        hash.addData(file.readAll());
+    }
+    return hash.result();
+}
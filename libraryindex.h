@@ -0,0 +1,55 @@
+#ifndef LIBRARYINDEX_H
+#define LIBRARYINDEX_H
+
+#include <QString>
+#include <QByteArray>
+#include <QFileInfo>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+
+// SQLite index of the files tagged so far, so rescans only touch new or changed
+// files. Files are keyed by path and compared by size and modification time;
+// when only the time differs a hash of the first and last 64 KiB decides.
+// Every entry also records the TMDb id and a hash of the embedded cover.
+//
+// Uses one database connection per instance, only use it from one thread.
+class LibraryIndex
+{
+public:
+    explicit LibraryIndex(const QString& databasePath = defaultDatabasePath());
+    ~LibraryIndex();
+
+    // Used by the batch tagger and its watch mode, files tagged in the GUI aren't recorded
+    static QString defaultDatabasePath();
+
+    // Create or open the database, false (see errorString()) if it can't be used
+    bool open();
+    bool isOpen() const;
+    QString errorString() const;
+
+    // True if the file was tagged before and has not changed since. fileInfo
+    // should come from the directory scan, so no extra stat is needed.
+    bool isUpToDate(const QFileInfo& fileInfo);
+
+    // Remember a tagged file, call after the write so size and time are current
+    bool recordTagged(const QString& filePath, int tmdbId, const QByteArray& coverData);
+
+    // Drop a file, e.g. after a failed write
+    void remove(const QString& filePath);
+
+    // Hash of size, head and tail of the file, cheap even for huge files
+    static QByteArray partialContentHash(const QString& filePath, qint64 size);
+
+private:
+    bool fail(const QString& message);
+
+    QString m_databasePath;
+    QString m_connectionName;
+    QSqlDatabase m_database;
+    QSqlQuery m_selectQuery;
+    QSqlQuery m_upsertQuery;
+    QSqlQuery m_touchQuery;
+    QString m_errorString;
+};
+
+#endif // LIBRARYINDEX_H
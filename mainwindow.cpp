@@ -1,7 +1,8 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
-#include "movieitemwidget.h"
-#include "mediatagwriter.h"
+#include "movieitemdelegate.h"
+#include "releasenameparser.h"
+#include "moviematcher.h"
 #include <QFileDialog>
 #include <QString>
 #include <QFile>
@@ -9,11 +10,16 @@
 #include <QSettings>
 #include <QDebug>
 #include <QMessageBox>
+#include <QScrollBar>
+#include <QTimer>
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
     , tmdbClient(nullptr)
+    , searchResultsModel(nullptr)
+    , tagWriteQueue(nullptr)
+    , metricsExporter(nullptr)
 {
     ui->setupUi(this);
 
@@ -46,7 +52,15 @@ MainWindow::MainWindow(QWidget *parent)
     readConfigFile();
 
     // Create the client with your API key
-    tmdbClient = new TmdbClient(tmdbApiKey, this);
+    tmdbClient = new TmdbClient(config.tmdbApiKey, this);
+    tmdbClient->setApiBaseUrl(config.tmdbApiBaseUrl);
+    tmdbClient->posterCache().setMaxDiskBytes(config.posterCacheBytes);
+    tmdbClient->posterCache().setMaxMemoryBytes(config.posterMemoryCacheBytes);
+    tmdbClient->setSearchCacheTtl(config.searchCacheTtlSeconds);
+    tmdbClient->setConfigurationCacheTtl(config.configurationCacheTtlSeconds);
+    tmdbClient->requestScheduler().setRequestsPerSecond(config.tmdbRequestsPerSecond);
+    tmdbClient->requestScheduler().setMaxInFlight(config.tmdbMaxInFlight);
+    tmdbClient->requestScheduler().setMaxRetries(config.tmdbMaxRetries);
 
     connect(tmdbClient, &TmdbClient::configurationComplete,
             this, []() {
@@ -69,27 +83,73 @@ MainWindow::MainWindow(QWidget *parent)
                 case TmdbClient::ErrorSource::PosterDownload:
                     sourceStr = "Poster Download";
                     break;
+                case TmdbClient::ErrorSource::MovieDetails:
+                    sourceStr = "Movie Details";
+                    break;
                 }
                 qDebug() << "TMDB Error in" << sourceStr << ":" << message;
             });
 
-    // Get configuration
+    // Get configuration, instantly from the copy saved by a previous run if there is one
     tmdbClient->getConfiguration();
 
-    // Connect the signal for search
-    connect(tmdbClient, &TmdbClient::searchCompleted,
-            this, &MainWindow::onSearchCompleted);
+    // Search results, the view only paints (and fetches posters for) the visible rows
+    searchResultsModel = new MovieListModel(tmdbClient, this);
+    ui->searchResults->setModel(searchResultsModel);
+    ui->searchResults->setItemDelegate(new MovieItemDelegate(ui->searchResults));
+    ui->searchResults->setUniformItemSizes(true);
+    ui->searchResults->setVerticalScrollMode(QAbstractItemView::ScrollPerPixel);
+
+    connect(searchResultsModel, &MovieListModel::searchFinished,
+            this, &MainWindow::onSearchFinished);
+
+    // Rows become visible by scrolling, resizing or new rows arriving
+    connect(ui->searchResults->verticalScrollBar(), &QScrollBar::valueChanged,
+            this, &MainWindow::scheduleVisiblePosters);
+    connect(ui->searchResults->verticalScrollBar(), &QScrollBar::rangeChanged,
+            this, &MainWindow::scheduleVisiblePosters);
+    connect(searchResultsModel, &MovieListModel::rowsInserted,
+            this, &MainWindow::scheduleVisiblePosters);
+
+    // Tag writer, signals arrive queued from its worker threads
+    tagWriteQueue = new TagWriteQueue(this);
+    tagWriteQueue->setMaxThreadCount(config.maxConcurrentWrites);
+    tagWriteQueue->setMaxConcurrentWritesPerDevice(config.maxWritesPerDevice);
+    tagWriteQueue->setSafeWrites(config.safeWrites);
+
+    connect(tagWriteQueue, &TagWriteQueue::progressUpdate, this,
+            [this](const QString& message) {
+                showMessageInStatusBar(message, MessageType::Info);
+            });
+
+    connect(tagWriteQueue, &TagWriteQueue::error, this,
+            [this](const QString& message) {
+                showMessageInStatusBar(message, MessageType::Error);
+            });
+
+    connect(tagWriteQueue, &TagWriteQueue::success, this,
+            [this](const QString& message) {
+                showMessageInStatusBar(message, MessageType::Info);
+            });
+
+    // Timings of searches, poster downloads and tag writes, exported if config.ini names a file
+    metricsExporter = new MetricsExporter(this);
+    metricsExporter->setFilePath(config.metricsFile);
+    metricsExporter->setFormat(MetricsExporter::formatFromString(config.metricsFormat));
+    metricsExporter->start(config.metricsIntervalSeconds);
 
     // Connect button signals to slot
     connect(ui->btnOpenMovie, &QPushButton::clicked, this, &MainWindow::onOpenMovieButtonClick);
     connect(ui->btnSearch, &QPushButton::clicked, this, &MainWindow::onSearchButtonClick);
     connect(ui->btnWriteTags, &QPushButton::clicked, this, &MainWindow::onWriteTagsButtonClick);
-    connect(ui->searchResults, &QListWidget::itemSelectionChanged,
+    connect(ui->searchResults->selectionModel(), &QItemSelectionModel::selectionChanged,
            this, &MainWindow::onSearchResultSelectionChanged);
 }
 
 MainWindow::~MainWindow()
 {
+    // Last snapshot, samples since the previous export would be lost otherwise
+    metricsExporter->exportNow();
     delete ui;
 }
 
@@ -106,11 +166,11 @@ void MainWindow::readConfigFile()
     // If the file exists, attempt to read it
     QSettings settings(configFilePath, QSettings::IniFormat);
 
-    // Read TMDb API key
-    tmdbApiKey = settings.value("Settings/tmdb_api_key").toString();
+    // Read TMDb API key and the remaining settings
+    config = AppConfig::fromSettings(settings);
 
     // Check if the key is valid
-    if (tmdbApiKey.isEmpty()) {
+    if (config.tmdbApiKey.isEmpty()) {
         showMessageInStatusBar("Error: Failed to read TMDb API key from config.ini!", MessageType::Error);
         return;
     }
@@ -166,32 +226,18 @@ void MainWindow::onOpenMovieButtonClick()
     movieFile = QFileDialog::getOpenFileName(nullptr, "Open Movie File", videoFolder, "Movies (*.mp4 *.mkv)");
     if (movieFile.isEmpty()) return;
 
-    // Clear the selection in the list widget
+    // Clear the selection and the results of the previous file
     ui->searchResults->clearSelection();
-    ui->searchResults->clear();
+    searchResultsModel->clear();
 
     // Enable or disable the buttons and text fields
     ui->movieSearch->setEnabled(true);
     ui->btnSearch->setEnabled(true);
     ui->btnWriteTags->setEnabled(false);
 
-    // Set the initial search text (filename without extension)
-    QString searchText = QFileInfo(movieFile).baseName();
-
-    // Regular expression pattern for movie name extraction
-    QRegularExpression movieRegex("([ .\\w']+?)(\\W\\d{4}\\W?.*)");
-    QRegularExpressionMatch match = movieRegex.match(movieFile);
-
-    if (match.hasMatch()) {
-        // Extract movie name and format it
-        QString movieName = match.captured(1).replace(".", " ");
-        QStringList words = movieName.split("\\s+");
-        for (int i = 0; i < words.size(); ++i) {
-            words[i] = words[i].at(0).toUpper() + words[i].mid(1);
-        }
-        movieName = words.join(" ");
-        searchText = movieName;
-    }
+    // Set the initial search text (movie title parsed from the filename)
+    movieRelease = ReleaseNameParser::parse(movieFile);
+    QString searchText = movieRelease.title;
 
     // Set the search text in the text field
     ui->movieSearch->setText(searchText);
@@ -216,102 +262,139 @@ void MainWindow::onSearchButtonClick()
         return;
     }
 
-    tmdbClient->searchMovie(query);
+    // The year from the file name narrows the results, unless the user typed another title
+    int year = query.compare(movieRelease.title, Qt::CaseInsensitive) == 0 ? movieRelease.year : 0;
+    searchTimer.start();
+    searchResultsModel->search(query, year);
 }
 
-void MainWindow::onSearchCompleted(const QJsonArray &results)
+void MainWindow::onSearchFinished(bool ok, int resultCount)
 {
-    // Clear previous results in the QListWidget
-    ui->searchResults->clear();
+    // Click to results shown, more pages loaded while scrolling aren't timed
+    bool firstPage = searchTimer.isValid();
+    if (firstPage) {
+        Metrics::instance().observeElapsed("search_results_seconds", searchTimer);
+        searchTimer.invalidate();
+    }
 
-    // Disconnect any existing connections to avoid duplicate slots
-    disconnect(tmdbClient, &TmdbClient::posterDownloaded, nullptr, nullptr);
+    if (!ok) {
+        showMessageInStatusBar("Search failed, please try again", MessageType::Error);
+        return;
+    }
 
-    if (results.isEmpty()) {
+    if (resultCount == 0) {
         // No results found - update the status bar
         showMessageInStatusBar("No movies found for the search criteria", MessageType::Warning);
         return;
     }
 
-    for (const QJsonValue &resultValue : results) {
-        QJsonObject result = resultValue.toObject();
-
-        QString title = result["title"].toString();
-        QString year = result["release_date"].toString().left(4);
-        QString description = result["overview"].toString();
-        QString posterPath = result["poster_path"].toString();
-
-        // Create the custom movie item widget
-        MovieItemWidget *itemWidget = new MovieItemWidget(title, year, description);
-
-        // Create a QListWidgetItem and set its associated widget
-        QListWidgetItem *item = new QListWidgetItem();
-        item->setSizeHint(itemWidget->sizeHint());
-        ui->searchResults->addItem(item);
-        ui->searchResults->setItemWidget(item, itemWidget);
-
-        // Download the poster image if the path is valid
-        if (!posterPath.isEmpty() && posterPath.startsWith("/")) {
-            // Connect the posterDownloaded signal for this specific poster path
-            connect(tmdbClient, &TmdbClient::posterDownloaded, this,
-                    [itemWidget, posterPath](const QByteArray &imageData, const QString &movieCoverPath) {
-                        if (movieCoverPath == posterPath) {
-                            if (imageData.isEmpty()) {
-                                qDebug() << "Failed to download image:" << posterPath;
-                                itemWidget->setCoverImage(QPixmap(":images/no-cover.png")); // Optionally set a default image
-                                return;
-                            }
-
-                            QPixmap pixmap;
-                            if (pixmap.loadFromData(imageData)) {
-                                itemWidget->setCoverImage(pixmap);
-                            } else {
-                                qDebug() << "Failed to load pixmap";
-                                itemWidget->setCoverImage(QPixmap(":images/no-cover.png")); // Optionally set a default image
-                            }
-                        }
-                    });
-
-            // Initiate the poster download
-            tmdbClient->downloadMoviePoster(posterPath, this);
-        } else {
-            qDebug() << "Poster path not found";
-            itemWidget->setCoverImage(QPixmap(":images/no-cover.png")); // Optionally set a default image
+    // Preselect a confident match, writing the tags is still up to the user
+    if (firstPage) {
+        preselectBestMatch();
+    }
+}
+
+void MainWindow::preselectBestMatch()
+{
+    MovieResults movies;
+    for (int row = 0; row < searchResultsModel->rowCount(); ++row) {
+        movies.append(searchResultsModel->movie(row));
+    }
+
+    // Against what was searched for, with the year only if the search used it
+    QString query = ui->movieSearch->text().trimmed();
+    int year = query.compare(movieRelease.title, Qt::CaseInsensitive) == 0 ? movieRelease.year : 0;
+
+    MovieMatcher matcher;
+    matcher.setThreshold(config.matchThreshold);
+    matcher.setMinimumMargin(config.matchMinimumMargin);
+    MovieMatcher::Match match = matcher.match(query, year, 0, movies);
+    if (!match.accepted) {
+        return;
+    }
+
+    // Rows are in TMDb order, find the best candidate's
+    for (int row = 0; row < movies.size(); ++row) {
+        if (movies.at(row).id == match.best().movie.id) {
+            QModelIndex index = searchResultsModel->index(row, 0);
+            ui->searchResults->selectionModel()->select(index, QItemSelectionModel::ClearAndSelect);
+            ui->searchResults->scrollTo(index);
+            showMessageInStatusBar(QString("Best match: %1, press 'Write Tags' button or select another movie")
+                                       .arg(match.best().movie.title), MessageType::Info);
+            return;
         }
     }
 }
 
-void MainWindow::onSearchResultSelectionChanged()
+void MainWindow::scheduleVisiblePosters()
 {
-    // Enable the Write Tags button only if an item is selected
-    ui->btnWriteTags->setEnabled(!ui->searchResults->selectedItems().isEmpty());
+    if (visiblePostersScheduled) {
+        return;
+    }
+
+    visiblePostersScheduled = true;
+    QTimer::singleShot(0, this, &MainWindow::loadVisiblePosters);
 }
 
-void MainWindow::onWriteTagsButtonClick()
+void MainWindow::loadVisiblePosters()
 {
-    QListWidgetItem* selectedItem = ui->searchResults->selectedItems().first();
-    MovieItemWidget* movieWidget = qobject_cast<MovieItemWidget*>(
-        ui->searchResults->itemWidget(selectedItem)
-        );
+    visiblePostersScheduled = false;
 
-    if (movieWidget) {
-        MediaTagWriter* tagWriter = new MediaTagWriter(this);
+    if (searchResultsModel->rowCount() == 0) {
+        return;
+    }
+
+    // Rows under the top and bottom edge of the viewport, rows are all the same height
+    QRect viewport = ui->searchResults->viewport()->rect();
+    QModelIndex first = ui->searchResults->indexAt(viewport.topLeft());
+    QModelIndex last = ui->searchResults->indexAt(viewport.bottomLeft());
+
+    int firstRow = first.isValid() ? first.row() : 0;
+    int lastRow = last.isValid() ? last.row() : searchResultsModel->rowCount() - 1;
 
-        connect(tagWriter, &MediaTagWriter::progressUpdate, this,
-                [this](const QString& message) {
-                    showMessageInStatusBar(message, MessageType::Info);
-                });
+    // One row of look-ahead on either side so scrolling doesn't reveal empty covers
+    searchResultsModel->loadPosters(firstRow - 1, lastRow + 1);
+}
+
+void MainWindow::onSearchResultSelectionChanged()
+{
+    // Enable the Write Tags button only if an item is selected
+    ui->btnWriteTags->setEnabled(ui->searchResults->selectionModel()->hasSelection());
+}
 
-        connect(tagWriter, &MediaTagWriter::error, this,
-                [this](const QString& message) {
-                    showMessageInStatusBar(message, MessageType::Error);
-                });
+void MainWindow::onWriteTagsButtonClick()
+{
+    QModelIndexList selected = ui->searchResults->selectionModel()->selectedRows();
+    if (selected.isEmpty()) {
+        return;
+    }
 
-        connect(tagWriter, &MediaTagWriter::success, this,
-                [this](const QString& message) {
-                    showMessageInStatusBar(message, MessageType::Info);
-                });
+    // Genres and credits aren't part of the search results, fetch them first. Without
+    // them the tags are written from the search result alone.
+    MovieResult movie = searchResultsModel->movie(selected.first().row());
+    QString filePath = movieFile;
+    tmdbClient->getMovieDetails(movie.id, this, [this, filePath, movie](bool ok, const MovieResult& details) {
+        writeTags(filePath, ok ? details : movie);
+    });
+}
 
-        tagWriter->writeTagsToFile(movieFile, movieWidget->coverImage());
+void MainWindow::writeTags(const QString& filePath, const MovieResult& movie)
+{
+    QString posterPath = movie.posterPath;
+    if (posterPath.isEmpty() || !posterPath.startsWith("/")) {
+        // No poster available, embed the placeholder cover. QPixmap is GUI thread only so hand the worker a QImage
+        tagWriteQueue->submit(filePath, QImage(":images/no-cover.png"), movie);
+        return;
     }
+
+    // The list only keeps thumbnails, the original full resolution poster comes from the poster cache
+    tmdbClient->downloadMoviePoster(posterPath, this,
+            [this, filePath, posterPath, movie](const QByteArray &imageData) {
+                if (imageData.isEmpty()) {
+                    qDebug() << "Failed to download image:" << posterPath;
+                    showMessageInStatusBar("Couldn't download the poster, tags not written", MessageType::Error);
+                    return;
+                }
+                tagWriteQueue->submit(filePath, imageData, movie);
+            });
 }
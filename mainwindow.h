@@ -5,7 +5,13 @@
 #include <QString>
 #include <QLabel>
 #include <QProcess>
+#include <QElapsedTimer>
 #include "tmdbclient.h"
+#include "appconfig.h"
+#include "tagwritequeue.h"
+#include "movielistmodel.h"
+#include "releasenameparser.h"
+#include "metrics.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui {
@@ -25,8 +31,9 @@ private slots:
     void onOpenMovieButtonClick();
     void onSearchButtonClick();
     void onWriteTagsButtonClick();
-    void onSearchCompleted(const QJsonArray& results);
+    void onSearchFinished(bool ok, int resultCount);
     void onSearchResultSelectionChanged();
+    void loadVisiblePosters();
 
 private:
     // Enum to define message types
@@ -39,6 +46,15 @@ private:
     // Function to read the configuration file
     void readConfigFile();
 
+    // Selects the search result MovieMatcher is confident about, if any
+    void preselectBestMatch();
+
+    // Embeds the poster of movie, and its details, into filePath on the tag write queue
+    void writeTags(const QString& filePath, const MovieResult& movie);
+
+    // Coalesces scrolling and resizing into one poster load per event loop iteration
+    void scheduleVisiblePosters();
+
     // Function to show messages in the status bar with color based on message type
     void showMessageInStatusBar(const QString &message, MessageType type);
 
@@ -51,14 +67,30 @@ private:
     // Member variable for storing the selected movie file path
     QString movieFile;
 
+    // Title, year, ... parsed from the movie file name
+    ReleaseInfo movieRelease;
+
     // QLabel for status bar message
     QLabel *statusLabel = nullptr;  // New member to hold the QLabel widget
 
-    // TMDb api key
-    QString tmdbApiKey;
+    // Settings read from config.ini (TMDb api key, ...)
+    AppConfig config;
 
     // TMDb client
     TmdbClient* tmdbClient;
+
+    // Search results shown in the list view, posters are loaded for visible rows only
+    MovieListModel* searchResultsModel;
+    bool visiblePostersScheduled = false;
+
+    // Writes tags on worker threads so large files don't freeze the window
+    TagWriteQueue* tagWriteQueue;
+
+    // Time since the last search was started, invalid once its results are shown
+    QElapsedTimer searchTimer;
+
+    // Writes the pipeline metrics to the file named in config.ini
+    MetricsExporter* metricsExporter;
 };
 
 #endif // MAINWINDOW_H
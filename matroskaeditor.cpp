@@ -0,0 +1,765 @@
+#include "matroskaeditor.h"
+#include "writejournal.h"
+#include <QRandomGenerator>
+#include <limits>
+#include <utility>
+
+// Attachments are read into memory, refuse anything unreasonably large
+static const qint64 MAX_ATTACHMENTS_SIZE = 512 * 1024 * 1024;
+
+// SeekHeads only hold a handful of entries
+static const qint64 MAX_SEEKHEAD_SIZE = 64 * 1024;
+
+// Tags are text, even files with statistics tags for every track stay far below this
+static const qint64 MAX_TAGS_SIZE = 16 * 1024 * 1024;
+
+// TargetTypeValue of a movie (or album), the default when Targets don't say
+static const quint64 MOVIE_TARGET_TYPE_VALUE = 50;
+
+MatroskaEditor::MatroskaEditor(const QString& filePath)
+    : m_filePath(filePath)
+    , m_file(filePath)
+{
+}
+
+void MatroskaEditor::setCover(const QByteArray& imageData, const QString& fileName, const QString& mimeType)
+{
+    m_coverData = imageData;
+    m_coverFileName = fileName;
+    m_coverMimeType = mimeType;
+}
+
+void MatroskaEditor::addSimpleTag(const QString& name, const QString& value)
+{
+    m_simpleTags.append(qMakePair(name, value));
+}
+
+bool MatroskaEditor::writesTags() const
+{
+    return !m_simpleTags.isEmpty();
+}
+
+void MatroskaEditor::setJournal(WriteJournal *journal)
+{
+    m_journal = journal;
+}
+
+QString MatroskaEditor::errorString() const
+{
+    return m_errorString;
+}
+
+qint64 MatroskaEditor::bytesWritten() const
+{
+    return m_bytesWritten;
+}
+
+bool MatroskaEditor::fail(const QString& message)
+{
+    m_errorString = message;
+    return false;
+}
+
+bool MatroskaEditor::save()
+{
+    m_errorString.clear();
+    m_bytesWritten = 0;
+    m_seekHeads.clear();
+    m_hasAttachments = false;
+    m_keptAttachedFiles.clear();
+    m_hasTags = false;
+    m_keptTags.clear();
+    m_voids.clear();
+
+    if (m_coverData.isEmpty()) {
+        return fail("No cover to write");
+    }
+
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        return fail(QString("Can't open file: %1").arg(m_file.errorString()));
+    }
+
+    if (m_journal && !m_journal->begin(m_file.size())) {
+        m_file.close();
+        return fail(m_journal->errorString());
+    }
+
+    bool ok = apply() && finish();
+    if (ok) {
+        m_file.close();
+        return true;
+    }
+
+    if (m_errorString.isEmpty()) {
+        m_errorString = m_file.errorString();
+    }
+    m_file.close();
+    return false;
+}
+
+bool MatroskaEditor::parseLayout()
+{
+    m_fileSize = m_file.size();
+
+    Ebml::Element header;
+    if (!Ebml::readElementHeader(&m_file, 0, header) || header.id != Ebml::EBMLHeader || header.hasUnknownSize()) {
+        return fail("Not a Matroska file");
+    }
+
+    if (!Ebml::readElementHeader(&m_file, header.endOffset(), m_segment) || m_segment.id != Ebml::Segment) {
+        return fail("Missing Matroska Segment");
+    }
+    m_segmentEnd = m_segment.hasUnknownSize() ? m_fileSize : qMin(m_segment.endOffset(), m_fileSize);
+
+    // Walk the level 1 elements in front of the first Cluster, only their headers are read
+    qint64 pos = m_segment.dataOffset();
+    while (pos < m_segmentEnd) {
+        Ebml::Element child;
+        if (!Ebml::readElementHeader(&m_file, pos, child) || child.id == Ebml::Cluster || child.hasUnknownSize()) {
+            break;
+        }
+
+        if (child.id == Ebml::SeekHead && m_seekHeads.isEmpty()) {
+            if (!readSeekHead(child)) {
+                return false;
+            }
+        } else if (child.id == Ebml::Attachments && !m_hasAttachments) {
+            m_hasAttachments = true;
+            m_attachments = child;
+        } else if (child.id == Ebml::Tags && !m_hasTags) {
+            m_hasTags = true;
+            m_tags = child;
+        } else if (child.id == Ebml::Void) {
+            m_voids.append(child);
+        }
+
+        pos = child.endOffset();
+    }
+
+    // Follow references to further SeekHeads (e.g. one written behind the Clusters)
+    if (!m_seekHeads.isEmpty()) {
+        const QList<SeekEntry> primaryEntries = m_seekHeads.first().entries;
+        for (const SeekEntry& entry : primaryEntries) {
+            if (entry.id != Ebml::SeekHead) {
+                continue;
+            }
+            Ebml::Element element;
+            qint64 offset = m_segment.dataOffset() + static_cast<qint64>(entry.position);
+            if (offset != m_seekHeads.first().element.offset
+                && Ebml::readElementHeader(&m_file, offset, element) && element.id == Ebml::SeekHead) {
+                if (!readSeekHead(element)) {
+                    return false;
+                }
+            }
+        }
+    }
+
+    // Attachments and Tags behind the Clusters are only reachable through a SeekHead
+    for (const SeekHeadInfo& seekHead : std::as_const(m_seekHeads)) {
+        for (const SeekEntry& entry : seekHead.entries) {
+            bool wanted = (entry.id == Ebml::Attachments && !m_hasAttachments)
+                          || (entry.id == Ebml::Tags && !m_hasTags);
+            if (!wanted) {
+                continue;
+            }
+            Ebml::Element element;
+            qint64 offset = m_segment.dataOffset() + static_cast<qint64>(entry.position);
+            if (Ebml::readElementHeader(&m_file, offset, element)
+                && element.id == entry.id && !element.hasUnknownSize()) {
+                if (entry.id == Ebml::Attachments) {
+                    m_hasAttachments = true;
+                    m_attachments = element;
+                } else {
+                    m_hasTags = true;
+                    m_tags = element;
+                }
+            }
+        }
+    }
+
+    if (m_hasAttachments && !readAttachments()) {
+        return false;
+    }
+
+    // Tags are left alone unless there are new ones to write
+    if (!writesTags()) {
+        m_hasTags = false;
+    } else if (m_hasTags && !readTags()) {
+        return false;
+    }
+
+    return true;
+}
+
+bool MatroskaEditor::readSeekHead(const Ebml::Element& element)
+{
+    if (element.hasUnknownSize() || static_cast<qint64>(element.dataSize) > MAX_SEEKHEAD_SIZE) {
+        return fail("Invalid SeekHead");
+    }
+
+    QByteArray data = Ebml::readBytes(&m_file, element.dataOffset(), static_cast<qint64>(element.dataSize));
+    if (data.size() != static_cast<qint64>(element.dataSize)) {
+        return fail("Truncated SeekHead");
+    }
+
+    SeekHeadInfo seekHead;
+    seekHead.element = element;
+
+    qint64 pos = 0;
+    while (pos < data.size()) {
+        Ebml::Element seek;
+        if (!Ebml::parseElementHeader(data, pos, seek) || seek.hasUnknownSize() || seek.endOffset() > data.size()) {
+            return fail("Invalid SeekHead entry");
+        }
+
+        if (seek.id == Ebml::Seek) {
+            SeekEntry entry{0, 0};
+            bool hasPosition = false;
+            qint64 childPos = seek.dataOffset();
+            while (childPos < seek.endOffset()) {
+                Ebml::Element child;
+                if (!Ebml::parseElementHeader(data, childPos, child) || child.hasUnknownSize()
+                    || child.endOffset() > seek.endOffset() || child.dataSize > 8) {
+                    return fail("Invalid SeekHead entry");
+                }
+                if (child.id == Ebml::SeekID) {
+                    entry.id = static_cast<quint32>(Ebml::decodeUInt(data, child.dataOffset(), static_cast<int>(child.dataSize)));
+                } else if (child.id == Ebml::SeekPosition) {
+                    entry.position = Ebml::decodeUInt(data, child.dataOffset(), static_cast<int>(child.dataSize));
+                    hasPosition = true;
+                }
+                childPos = child.endOffset();
+            }
+            if (entry.id != 0 && hasPosition) {
+                seekHead.entries.append(entry);
+            }
+        }
+
+        pos = seek.endOffset();
+    }
+
+    // A Void right behind the SeekHead lets it grow in place
+    Ebml::Element next;
+    if (Ebml::readElementHeader(&m_file, element.endOffset(), next) && next.id == Ebml::Void && !next.hasUnknownSize()) {
+        seekHead.hasFollowingVoid = true;
+        seekHead.followingVoid = next;
+    }
+
+    m_seekHeads.append(seekHead);
+    return true;
+}
+
+bool MatroskaEditor::readAttachments()
+{
+    qint64 size = static_cast<qint64>(m_attachments.dataSize);
+    if (size > MAX_ATTACHMENTS_SIZE || m_attachments.endOffset() > m_fileSize) {
+        return fail("Invalid Attachments element");
+    }
+
+    QByteArray data = Ebml::readBytes(&m_file, m_attachments.dataOffset(), size);
+    if (data.size() != size) {
+        return fail("Truncated Attachments element");
+    }
+
+    qint64 pos = 0;
+    while (pos < data.size()) {
+        Ebml::Element attachedFile;
+        if (!Ebml::parseElementHeader(data, pos, attachedFile) || attachedFile.hasUnknownSize()
+            || attachedFile.endOffset() > data.size()) {
+            return fail("Invalid AttachedFile element");
+        }
+
+        // Only AttachedFile children are kept, CRC-32 and Void are dropped
+        if (attachedFile.id == Ebml::AttachedFile) {
+            QByteArray mimeType;
+            qint64 childPos = attachedFile.dataOffset();
+            while (childPos < attachedFile.endOffset()) {
+                Ebml::Element child;
+                if (!Ebml::parseElementHeader(data, childPos, child) || child.hasUnknownSize()
+                    || child.endOffset() > attachedFile.endOffset()) {
+                    return fail("Invalid AttachedFile element");
+                }
+                if (child.id == Ebml::FileMimeType) {
+                    mimeType = data.mid(child.dataOffset(), static_cast<qint64>(child.dataSize));
+                }
+                childPos = child.endOffset();
+            }
+
+            // Same selection as "--delete-attachment mime-type:image/jpeg/png"
+            if (mimeType != "image/jpeg" && mimeType != "image/png") {
+                m_keptAttachedFiles.append(data.mid(attachedFile.offset, attachedFile.totalSize()));
+            }
+        }
+
+        pos = attachedFile.endOffset();
+    }
+
+    return true;
+}
+
+bool MatroskaEditor::readTags()
+{
+    qint64 size = static_cast<qint64>(m_tags.dataSize);
+    if (size > MAX_TAGS_SIZE || m_tags.endOffset() > m_fileSize) {
+        return fail("Invalid Tags element");
+    }
+
+    QByteArray data = Ebml::readBytes(&m_file, m_tags.dataOffset(), size);
+    if (data.size() != size) {
+        return fail("Truncated Tags element");
+    }
+
+    qint64 pos = 0;
+    while (pos < data.size()) {
+        Ebml::Element tag;
+        if (!Ebml::parseElementHeader(data, pos, tag) || tag.hasUnknownSize() || tag.endOffset() > data.size()) {
+            return fail("Invalid Tag element");
+        }
+
+        // Only Tag children are kept, CRC-32 and Void are dropped
+        if (tag.id == Ebml::Tag) {
+            quint64 targetTypeValue = MOVIE_TARGET_TYPE_VALUE;
+            bool hasUid = false;
+            qint64 childPos = tag.dataOffset();
+            while (childPos < tag.endOffset()) {
+                Ebml::Element child;
+                if (!Ebml::parseElementHeader(data, childPos, child) || child.hasUnknownSize()
+                    || child.endOffset() > tag.endOffset()) {
+                    return fail("Invalid Tag element");
+                }
+
+                if (child.id == Ebml::Targets) {
+                    qint64 targetPos = child.dataOffset();
+                    while (targetPos < child.endOffset()) {
+                        Ebml::Element target;
+                        if (!Ebml::parseElementHeader(data, targetPos, target) || target.hasUnknownSize()
+                            || target.endOffset() > child.endOffset() || target.dataSize > 8) {
+                            return fail("Invalid Targets element");
+                        }
+                        quint64 value = Ebml::decodeUInt(data, target.dataOffset(), static_cast<int>(target.dataSize));
+                        if (target.id == Ebml::TargetTypeValue) {
+                            targetTypeValue = value;
+                        } else if ((target.id == Ebml::TagTrackUID || target.id == Ebml::TagEditionUID
+                                    || target.id == Ebml::TagChapterUID || target.id == Ebml::TagAttachmentUID)
+                                   && value != 0) {
+                            hasUid = true;
+                        }
+                        targetPos = target.endOffset();
+                    }
+                }
+                childPos = child.endOffset();
+            }
+
+            // Same selection as "--tags global:", the movie level tag is replaced
+            if (hasUid || targetTypeValue != MOVIE_TARGET_TYPE_VALUE) {
+                m_keptTags.append(data.mid(tag.offset, tag.totalSize()));
+            }
+        }
+
+        pos = tag.endOffset();
+    }
+
+    return true;
+}
+
+QByteArray MatroskaEditor::buildTagsPayload() const
+{
+    QByteArray payload;
+    for (const QByteArray& tag : m_keptTags) {
+        payload += tag;
+    }
+
+    QByteArray tag = Ebml::element(Ebml::Targets,
+                                   Ebml::uintElement(Ebml::TargetTypeValue, MOVIE_TARGET_TYPE_VALUE)
+                                   + Ebml::stringElement(Ebml::TargetType, "MOVIE"));
+    for (const auto& simpleTag : m_simpleTags) {
+        tag += Ebml::element(Ebml::SimpleTag,
+                             Ebml::stringElement(Ebml::TagName, simpleTag.first.toUtf8())
+                             + Ebml::stringElement(Ebml::TagLanguage, "und")
+                             + Ebml::stringElement(Ebml::TagString, simpleTag.second.toUtf8()));
+    }
+    payload += Ebml::element(Ebml::Tag, tag);
+
+    return payload;
+}
+
+QByteArray MatroskaEditor::buildAttachmentsPayload() const
+{
+    QByteArray payload;
+    for (const QByteArray& attachedFile : m_keptAttachedFiles) {
+        payload += attachedFile;
+    }
+
+    quint64 uid = 0;
+    while (uid == 0) {
+        uid = QRandomGenerator::global()->generate64();
+    }
+
+    QByteArray cover;
+    cover += Ebml::stringElement(Ebml::FileName, m_coverFileName.toUtf8());
+    cover += Ebml::stringElement(Ebml::FileMimeType, m_coverMimeType.toUtf8());
+    cover += Ebml::element(Ebml::FileData, m_coverData);
+    cover += Ebml::uintElement(Ebml::FileUID, uid);
+    payload += Ebml::element(Ebml::AttachedFile, cover);
+
+    return payload;
+}
+
+QByteArray MatroskaEditor::buildSeekHeadPayload(const SeekHeadInfo& seekHead, qint64 attachmentsPosition,
+                                                qint64 tagsPosition) const
+{
+    auto seekElement = [](quint32 id, quint64 position, int positionLength) {
+        return Ebml::element(Ebml::Seek,
+                             Ebml::element(Ebml::SeekID, Ebml::encodeId(id))
+                             + Ebml::uintElement(Ebml::SeekPosition, position, positionLength));
+    };
+
+    // Entries pointing at what this pass writes, tagsPosition -1 if Tags aren't written
+    QList<QPair<quint32, qint64>> updated;
+    updated.append(qMakePair(Ebml::Attachments, attachmentsPosition));
+    if (tagsPosition >= 0) {
+        updated.append(qMakePair(Ebml::Tags, tagsPosition));
+    }
+    QList<bool> written(updated.size(), false);
+
+    // Updated positions always take 8 bytes, so the size doesn't depend on them
+    QByteArray payload;
+    for (const SeekEntry& entry : seekHead.entries) {
+        qsizetype index = -1;
+        for (qsizetype i = 0; i < updated.size() && index < 0; ++i) {
+            if (updated.at(i).first == entry.id) {
+                index = i;
+            }
+        }
+
+        if (index < 0) {
+            payload += seekElement(entry.id, entry.position, 0);
+        } else if (!written.at(index)) {
+            payload += seekElement(entry.id, static_cast<quint64>(updated.at(index).second), 8);
+            written[index] = true;
+        }
+    }
+
+    for (qsizetype i = 0; i < updated.size(); ++i) {
+        if (!written.at(i)) {
+            payload += seekElement(updated.at(i).first, static_cast<quint64>(updated.at(i).second), 8);
+        }
+    }
+
+    return payload;
+}
+
+bool MatroskaEditor::fits(qint64 available, qint64 needed)
+{
+    // Any leftover must be able to hold a Void element (at least 2 bytes)
+    return available == needed || available >= needed + 2;
+}
+
+QByteArray MatroskaEditor::fitElement(quint32 id, const QByteArray& payload, qint64 available)
+{
+    // A longer size field absorbs a leftover that is too small for a Void
+    QByteArray encodedId = Ebml::encodeId(id);
+    QByteArray minimalSize = Ebml::encodeSize(static_cast<quint64>(payload.size()));
+    for (int sizeLength = minimalSize.size(); sizeLength <= 8; ++sizeLength) {
+        qint64 total = encodedId.size() + sizeLength + payload.size();
+        if (fits(available, total)) {
+            return encodedId + Ebml::encodeSize(static_cast<quint64>(payload.size()), sizeLength) + payload;
+        }
+        if (total > available) {
+            break;
+        }
+    }
+    return QByteArray();
+}
+
+QByteArray MatroskaEditor::fitBlock(const QByteArray& attachmentsPayload, const QByteArray& tagsPayload,
+                                    qint64 available, qint64& attachmentsSize) const
+{
+    if (!writesTags()) {
+        QByteArray attachments = fitElement(Ebml::Attachments, attachmentsPayload, available);
+        attachmentsSize = attachments.size();
+        return attachments;
+    }
+
+    // Attachments with the minimal header, the Tags behind them absorb the leftover
+    QByteArray attachments = Ebml::element(Ebml::Attachments, attachmentsPayload);
+    if (attachments.size() > available) {
+        return QByteArray();
+    }
+    QByteArray tags = fitElement(Ebml::Tags, tagsPayload, available - attachments.size());
+    if (tags.isEmpty()) {
+        return QByteArray();
+    }
+    attachmentsSize = attachments.size();
+    return attachments + tags;
+}
+
+bool MatroskaEditor::findOldRegion(qint64& offset, qint64& size)
+{
+    // Starts at the first of the elements this pass replaces
+    offset = -1;
+    if (m_hasAttachments) {
+        offset = m_attachments.offset;
+    }
+    if (m_hasTags && (offset < 0 || m_tags.offset < offset)) {
+        offset = m_tags.offset;
+    }
+    if (offset < 0) {
+        return false;
+    }
+
+    // ...and takes in the other one and any Voids as long as they are contiguous
+    qint64 pos = offset;
+    while (pos < m_segmentEnd) {
+        if (m_hasAttachments && pos == m_attachments.offset) {
+            pos = m_attachments.endOffset();
+            continue;
+        }
+        if (m_hasTags && pos == m_tags.offset) {
+            pos = m_tags.endOffset();
+            continue;
+        }
+        Ebml::Element element;
+        if (!Ebml::readElementHeader(&m_file, pos, element) || element.id != Ebml::Void
+            || element.hasUnknownSize() || element.endOffset() > m_segmentEnd) {
+            break;
+        }
+        pos = element.endOffset();
+    }
+
+    size = pos - offset;
+    return true;
+}
+
+bool MatroskaEditor::finish()
+{
+    // Journaled writes are only final once the file is synced and the journal is gone
+    if (m_journal) {
+        return m_journal->commit(m_file) || fail(m_journal->errorString());
+    }
+    return m_file.flush();
+}
+
+bool MatroskaEditor::writeAt(qint64 offset, const QByteArray& data)
+{
+    if (m_journal && !m_journal->saveRegion(m_file, offset, data.size())) {
+        return fail(m_journal->errorString());
+    }
+    if (!m_file.seek(offset)) {
+        return fail(QString("Write failed: %1").arg(m_file.errorString()));
+    }
+    // Counted before writing, a write that fails halfway may still have changed the file
+    m_bytesWritten += data.size();
+    if (m_file.write(data) != data.size()) {
+        return fail(QString("Write failed: %1").arg(m_file.errorString()));
+    }
+    return true;
+}
+
+bool MatroskaEditor::writeVoid(qint64 offset, qint64 totalSize)
+{
+    if (totalSize == 0) {
+        return true;
+    }
+    return writeAt(offset, Ebml::voidHeader(totalSize));
+}
+
+bool MatroskaEditor::apply()
+{
+    if (!parseLayout()) {
+        return false;
+    }
+
+    const qint64 unlimited = std::numeric_limits<qint64>::max();
+    QByteArray attachmentsPayload = buildAttachmentsPayload();
+    QByteArray tagsPayload = writesTags() ? buildTagsPayload() : QByteArray();
+    // The new Attachments, followed by the new Tags if there are any
+    QByteArray block;
+    qint64 attachmentsSize = 0;
+    qint64 targetOffset = -1;
+    qint64 targetSpace = 0;
+    bool append = false;
+
+    // 1. Rewrite the old Attachments (and Tags) in place, together with any Voids right behind them
+    qint64 regionOffset = -1;
+    qint64 regionSize = 0;
+    bool hasRegion = findOldRegion(regionOffset, regionSize);
+    if (hasRegion) {
+        block = fitBlock(attachmentsPayload, tagsPayload, regionSize, attachmentsSize);
+        if (!block.isEmpty()) {
+            targetOffset = regionOffset;
+            targetSpace = regionSize;
+        }
+    }
+
+    bool needsSpace = targetOffset < 0;
+
+    // The SeekHead holding the Attachments/Tags entries (or the primary one) must follow a move
+    int seekHeadIndex = -1;
+    bool hasStaleEntry = false;
+    for (int i = 0; i < m_seekHeads.size(); ++i) {
+        for (const SeekEntry& entry : m_seekHeads.at(i).entries) {
+            if (entry.id == Ebml::Attachments || (writesTags() && entry.id == Ebml::Tags)) {
+                if (seekHeadIndex >= 0 && seekHeadIndex != i) {
+                    return fail("Attachments and Tags are indexed by different SeekHeads");
+                }
+                seekHeadIndex = i;
+                hasStaleEntry = true;
+            }
+        }
+    }
+    if (seekHeadIndex < 0 && !m_seekHeads.isEmpty()) {
+        seekHeadIndex = 0;
+    }
+
+    QByteArray seekHeadPayload;
+    qint64 seekHeadSpace = 0;
+    QList<FreeSpace> candidates;
+
+    if (seekHeadIndex >= 0) {
+        const SeekHeadInfo& seekHead = m_seekHeads.at(seekHeadIndex);
+        seekHeadSpace = seekHead.element.totalSize();
+        if (seekHead.hasFollowingVoid) {
+            seekHeadSpace += seekHead.followingVoid.totalSize();
+        }
+    }
+
+    if (needsSpace && seekHeadIndex >= 0) {
+        const SeekHeadInfo& seekHead = m_seekHeads.at(seekHeadIndex);
+        seekHeadPayload = buildSeekHeadPayload(seekHead, 0, writesTags() ? 0 : -1);
+
+        // Whatever the grown SeekHead leaves of the Void behind it is still free
+        QByteArray sizedSeekHead = fitElement(Ebml::SeekHead, seekHeadPayload, seekHeadSpace);
+        if (!sizedSeekHead.isEmpty() && seekHead.hasFollowingVoid) {
+            qint64 seekHeadEnd = seekHead.element.offset + sizedSeekHead.size();
+            qint64 spaceEnd = seekHead.element.offset + seekHeadSpace;
+            if (spaceEnd - seekHeadEnd > 0) {
+                candidates.append(FreeSpace{seekHeadEnd, spaceEnd - seekHeadEnd});
+            }
+        }
+    }
+
+    if (needsSpace) {
+        // 2. Any other Void in front of the first Cluster
+        for (const Ebml::Element& voidElement : std::as_const(m_voids)) {
+            bool behindSeekHead = seekHeadIndex >= 0 && m_seekHeads.at(seekHeadIndex).hasFollowingVoid
+                                  && m_seekHeads.at(seekHeadIndex).followingVoid.offset == voidElement.offset;
+            if (!behindSeekHead) {
+                candidates.append(FreeSpace{voidElement.offset, voidElement.totalSize()});
+            }
+        }
+
+        for (const FreeSpace& space : std::as_const(candidates)) {
+            block = fitBlock(attachmentsPayload, tagsPayload, space.size, attachmentsSize);
+            if (!block.isEmpty()) {
+                targetOffset = space.offset;
+                targetSpace = space.size;
+                break;
+            }
+        }
+    }
+
+    // 3. Append at the end of the Segment, reusing the old elements if they are last
+    if (targetOffset < 0) {
+        if (m_segmentEnd != m_fileSize) {
+            return fail("Data behind the Matroska Segment, can't append attachments");
+        }
+        if (m_seekHeads.isEmpty()) {
+            return fail("No SeekHead to reference appended attachments");
+        }
+
+        append = true;
+        block = fitBlock(attachmentsPayload, tagsPayload, unlimited, attachmentsSize);
+        targetOffset = (hasRegion && regionOffset + regionSize == m_segmentEnd) ? regionOffset : m_segmentEnd;
+        targetSpace = block.size();
+    }
+
+    qint64 attachmentsPosition = targetOffset - m_segment.dataOffset();
+    qint64 tagsPosition = writesTags() ? attachmentsPosition + attachmentsSize : -1;
+    bool moved = !m_hasAttachments || targetOffset != m_attachments.offset
+                 || (writesTags() && (!m_hasTags || targetOffset + attachmentsSize != m_tags.offset));
+
+    // Validate everything before the first byte is written
+    QByteArray seekHead;
+    if (moved && seekHeadIndex >= 0) {
+        seekHeadPayload = buildSeekHeadPayload(m_seekHeads.at(seekHeadIndex), attachmentsPosition, tagsPosition);
+        seekHead = fitElement(Ebml::SeekHead, seekHeadPayload, seekHeadSpace);
+        if (seekHead.isEmpty()) {
+            // Elements in front of the Clusters are found without SeekHead, unless a stale entry exists
+            if (append || hasStaleEntry) {
+                return fail("No room to update the SeekHead");
+            }
+        }
+    }
+
+    QByteArray segmentSize;
+    qint64 newFileSize = m_fileSize;
+    if (append) {
+        newFileSize = targetOffset + block.size();
+        if (!m_segment.hasUnknownSize()) {
+            quint64 segmentDataSize = static_cast<quint64>(newFileSize - m_segment.dataOffset());
+            segmentSize = Ebml::encodeSize(segmentDataSize, m_segment.sizeLength);
+            if (segmentSize.isEmpty()) {
+                return fail("Segment size field too short for appended attachments");
+            }
+        }
+    }
+
+    // New elements first, so a failure later never loses the old cover's replacement
+    if (!writeAt(targetOffset, block)) {
+        return false;
+    }
+    if (!append && !writeVoid(targetOffset + block.size(), targetSpace - block.size())) {
+        return false;
+    }
+
+    if (append) {
+        if (newFileSize < m_fileSize && m_journal
+            && !m_journal->saveRegion(m_file, newFileSize, m_fileSize - newFileSize)) {
+            return fail(m_journal->errorString());
+        }
+        if (newFileSize < m_fileSize && !m_file.resize(newFileSize)) {
+            return fail(QString("Failed to truncate file: %1").arg(m_file.errorString()));
+        }
+        if (!segmentSize.isEmpty()) {
+            qint64 sizeOffset = m_segment.offset + m_segment.headerSize - m_segment.sizeLength;
+            if (!writeAt(sizeOffset, segmentSize)) {
+                return false;
+            }
+        }
+    }
+
+    if (moved && !seekHead.isEmpty()) {
+        const SeekHeadInfo& info = m_seekHeads.at(seekHeadIndex);
+        if (!writeAt(info.element.offset, seekHead)) {
+            return false;
+        }
+
+        // The new elements may already occupy the space right behind the new SeekHead
+        qint64 seekHeadEnd = info.element.offset + seekHead.size();
+        qint64 spaceEnd = info.element.offset + seekHeadSpace;
+        if (targetOffset == seekHeadEnd) {
+            spaceEnd = seekHeadEnd;
+        }
+        if (!writeVoid(seekHeadEnd, spaceEnd - seekHeadEnd)) {
+            return false;
+        }
+    }
+
+    // Finally blank the old elements, unless the new ones were written over them
+    auto overwritten = [&](const Ebml::Element& element) {
+        return element.offset >= targetOffset && (append || element.endOffset() <= targetOffset + targetSpace);
+    };
+    if (m_hasAttachments && !overwritten(m_attachments)) {
+        if (!writeVoid(m_attachments.offset, m_attachments.totalSize())) {
+            return false;
+        }
+    }
+    if (m_hasTags && !overwritten(m_tags)) {
+        if (!writeVoid(m_tags.offset, m_tags.totalSize())) {
+            return false;
+        }
+    }
+
+    return true;
+}
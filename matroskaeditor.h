@@ -0,0 +1,107 @@
+#ifndef MATROSKAEDITOR_H
+#define MATROSKAEDITOR_H
+
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QPair>
+#include <QFile>
+#include "ebml.h"
+
+class WriteJournal;
+
+// In-process replacement for "mkvpropedit --delete-attachment ... --add-attachment ...".
+//
+// Removes the image/jpeg and image/png attachments and adds the new cover in a
+// single pass. Only the Attachments element, the SeekHead and Void elements are
+// written: the new Attachments reuse the old element or a Void when they fit,
+// otherwise they are appended at the end of the Segment. Clusters are never
+// read or moved.
+//
+// With simple tags set, the movie level Tag is replaced in the same pass (like
+// "mkvpropedit --tags global:..."): the new Tags element is written right behind
+// the new Attachments, track and chapter tags are kept.
+class MatroskaEditor
+{
+public:
+    explicit MatroskaEditor(const QString& filePath);
+
+    void setCover(const QByteArray& imageData, const QString& fileName, const QString& mimeType);
+
+    // Add a SimpleTag (e.g. "TITLE") to the movie level Tag, names may repeat ("ACTOR")
+    void addSimpleTag(const QString& name, const QString& value);
+
+    // Save every region to journal before it is overwritten or truncated
+    void setJournal(WriteJournal *journal);
+
+    bool save();
+
+    QString errorString() const;
+    // Number of bytes written by the last save(). After a failed save(), 0 means
+    // the file wasn't changed.
+    qint64 bytesWritten() const;
+
+private:
+    struct SeekEntry {
+        quint32 id;
+        quint64 position;  // Relative to the Segment data
+    };
+
+    struct SeekHeadInfo {
+        Ebml::Element element;
+        QList<SeekEntry> entries;
+        bool hasFollowingVoid = false;
+        Ebml::Element followingVoid;  // Void right behind the SeekHead, room to grow
+    };
+
+    // A region of the file that may be overwritten
+    struct FreeSpace {
+        qint64 offset;
+        qint64 size;
+    };
+
+    bool apply();
+    bool parseLayout();
+    bool readSeekHead(const Ebml::Element& element);
+    bool readAttachments();
+    bool readTags();
+    bool findOldRegion(qint64& offset, qint64& size);
+    QByteArray buildAttachmentsPayload() const;
+    QByteArray buildTagsPayload() const;
+    QByteArray fitBlock(const QByteArray& attachmentsPayload, const QByteArray& tagsPayload, qint64 available,
+                        qint64& attachmentsSize) const;
+    QByteArray buildSeekHeadPayload(const SeekHeadInfo& seekHead, qint64 attachmentsPosition, qint64 tagsPosition) const;
+    bool writesTags() const;
+    static QByteArray fitElement(quint32 id, const QByteArray& payload, qint64 available);
+    static bool fits(qint64 available, qint64 needed);
+    bool writeAt(qint64 offset, const QByteArray& data);
+    bool writeVoid(qint64 offset, qint64 totalSize);
+    bool finish();
+    bool fail(const QString& message);
+
+    QString m_filePath;
+    QFile m_file;
+    QString m_errorString;
+    WriteJournal *m_journal = nullptr;
+    qint64 m_bytesWritten = 0;
+
+    QByteArray m_coverData;
+    QString m_coverFileName;
+    QString m_coverMimeType;
+    QList<QPair<QString, QString>> m_simpleTags;
+
+    // Layout of the file, filled by parseLayout()
+    qint64 m_fileSize = 0;
+    Ebml::Element m_segment;
+    qint64 m_segmentEnd = 0;
+    QList<SeekHeadInfo> m_seekHeads;        // Primary SeekHead first
+    bool m_hasAttachments = false;
+    Ebml::Element m_attachments;
+    QList<QByteArray> m_keptAttachedFiles;  // Raw AttachedFile elements that are not covers
+    bool m_hasTags = false;
+    Ebml::Element m_tags;
+    QList<QByteArray> m_keptTags;           // Raw Tag elements that are not movie level
+    QList<Ebml::Element> m_voids;           // Void elements in front of the first Cluster
+};
+
+#endif // MATROSKAEDITOR_H
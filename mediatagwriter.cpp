@@ -1,44 +1,319 @@
 #include "mediatagwriter.h"
+#include "matroskaeditor.h"
+#include "mp4editor.h"
+#include "writejournal.h"
+#include "reflink.h"
+#include "metrics.h"
 #include <QBuffer>
+#include <QElapsedTimer>
 #include <QFileInfo>
 #include <QProcess>
 #include <QTemporaryFile>
 #include <QResource>
 #include <QPixmap>
 #include <QImage>
+#include <QXmlStreamWriter>
 #include <QDebug>
 
+// TMDb lists the whole cast, only the top billed actors are worth a tag
+static const int MAX_CAST = 10;
+
+// Apple's short description item holds at most this many characters, "ldes" has the rest
+static const int SHORT_DESCRIPTION_LENGTH = 255;
+
+// MP4 items written from the metadata. All of them are removed before a re-tag, so a
+// field the new movie lacks doesn't keep the old movie's value (MKV replaces the whole Tag).
+static QList<QByteArray> managedMp4Keys()
+{
+    return { "\xA9nam", "\xA9" "day", "\xA9gen", "desc", "ldes",
+             "----:" + QByteArray(Mp4::ItunesMean) + ":iTunMOVI",
+             "----:" + QByteArray(Mp4::ItunesMean) + ":TMDB" };
+}
+
+// Cast and directors the way iTunes stores them, a property list in the iTunMOVI item
+static QString itunesMoviePlist(const MovieResult& movie)
+{
+    QString plist;
+    QXmlStreamWriter writer(&plist);
+    writer.writeStartDocument();
+    writer.writeDTD("<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">");
+    writer.writeStartElement("plist");
+    writer.writeAttribute("version", "1.0");
+    writer.writeStartElement("dict");
+
+    auto writeNames = [&writer](const QString& key, const QStringList& names) {
+        if (names.isEmpty()) {
+            return;
+        }
+        writer.writeTextElement("key", key);
+        writer.writeStartElement("array");
+        for (const QString& name : names) {
+            writer.writeStartElement("dict");
+            writer.writeTextElement("key", "name");
+            writer.writeTextElement("string", name);
+            writer.writeEndElement();
+        }
+        writer.writeEndElement();
+    };
+    writeNames("cast", movie.cast.mid(0, MAX_CAST));
+    writeNames("directors", movie.directors);
+
+    writer.writeEndElement();
+    writer.writeEndElement();
+    writer.writeEndDocument();
+    return plist;
+}
+
 MediaTagWriter::MediaTagWriter(QObject *parent) : QObject(parent)
 {
 }
 
+void MediaTagWriter::setSafeWrites(bool enabled)
+{
+    m_safeWrites = enabled;
+}
+
+void MediaTagWriter::setMetadata(const MovieResult& movie)
+{
+    m_metadata = movie;
+}
+
+QList<QPair<QByteArray, QString>> MediaTagWriter::mp4Items() const
+{
+    QList<QPair<QByteArray, QString>> items;
+    if (m_metadata.id == 0) {
+        return items;
+    }
+
+    const MovieResult& movie = m_metadata;
+    auto add = [&items](const QByteArray& key, const QString& value) {
+        if (!value.isEmpty()) {
+            items.append(qMakePair(key, value));
+        }
+    };
+    add("\xA9nam", movie.title);
+    add("\xA9" "day", movie.year > 0 ? QString::number(movie.year) : QString());
+    add("\xA9gen", movie.genres.join(", "));
+    add("desc", movie.overview.left(SHORT_DESCRIPTION_LENGTH));
+    add("ldes", movie.overview);
+    if (!movie.cast.isEmpty() || !movie.directors.isEmpty()) {
+        add("----:" + QByteArray(Mp4::ItunesMean) + ":iTunMOVI", itunesMoviePlist(movie));
+    }
+    add("----:" + QByteArray(Mp4::ItunesMean) + ":TMDB", QString("movie/%1").arg(movie.id));
+    return items;
+}
+
+QList<QPair<QString, QString>> MediaTagWriter::mkvSimpleTags() const
+{
+    // Official Matroska tag names, one SimpleTag per genre/person
+    QList<QPair<QString, QString>> tags;
+    if (m_metadata.id == 0) {
+        return tags;
+    }
+
+    const MovieResult& movie = m_metadata;
+    auto add = [&tags](const QString& name, const QString& value) {
+        if (!value.isEmpty()) {
+            tags.append(qMakePair(name, value));
+        }
+    };
+    add("TITLE", movie.title);
+    add("DATE_RELEASED", movie.year > 0 ? QString::number(movie.year) : QString());
+    for (const QString& genre : movie.genres) {
+        add("GENRE", genre);
+    }
+    add("SYNOPSIS", movie.overview);
+    add("TMDB", QString("movie/%1").arg(movie.id));
+    for (const QString& director : movie.directors) {
+        add("DIRECTOR", director);
+    }
+    for (const QString& actor : movie.cast.mid(0, MAX_CAST)) {
+        add("ACTOR", actor);
+    }
+    return tags;
+}
+
+void MediaTagWriter::applyMetadata(Mp4Editor& editor) const
+{
+    if (m_metadata.id == 0) {
+        return;
+    }
+    for (const QByteArray& key : managedMp4Keys()) {
+        editor.removeItem(key);
+    }
+
+    const QList<QPair<QByteArray, QString>> items = mp4Items();
+    for (const auto& item : items) {
+        if (item.first.startsWith("----:")) {
+            // "----:mean:name", the editor only writes Apple's mean
+            editor.setFreeformItem(item.first.mid(item.first.lastIndexOf(':') + 1), item.second);
+        } else {
+            editor.setTextItem(item.first.constData(), item.second);
+        }
+    }
+}
+
+void MediaTagWriter::applyMetadata(MatroskaEditor& editor) const
+{
+    const QList<QPair<QString, QString>> tags = mkvSimpleTags();
+    for (const auto& tag : tags) {
+        editor.addSimpleTag(tag.first, tag.second);
+    }
+}
+
+bool MediaTagWriter::writeTagsXml(QIODevice& device) const
+{
+    // mkvpropedit's tag file format, one movie level Tag
+    QXmlStreamWriter writer(&device);
+    writer.setAutoFormatting(true);
+    writer.writeStartDocument();
+    writer.writeDTD("<!DOCTYPE Tags SYSTEM \"matroskatags.dtd\">");
+    writer.writeStartElement("Tags");
+    writer.writeStartElement("Tag");
+    writer.writeStartElement("Targets");
+    writer.writeTextElement("TargetTypeValue", "50");
+    writer.writeEndElement();
+    const QList<QPair<QString, QString>> tags = mkvSimpleTags();
+    for (const auto& tag : tags) {
+        writer.writeStartElement("Simple");
+        writer.writeTextElement("Name", tag.first);
+        writer.writeTextElement("String", tag.second);
+        writer.writeEndElement();
+    }
+    writer.writeEndElement();
+    writer.writeEndElement();
+    writer.writeEndDocument();
+    return !writer.hasError();
+}
+
 bool MediaTagWriter::writeTagsToFile(const QString& filePath, const QPixmap& coverArt)
 {
+    return writeTagsToFile(filePath, coverArt.toImage());
+}
+
+bool MediaTagWriter::writeTagsToFile(const QString& filePath, const QImage& coverArt)
+{
+    if (coverArt.isNull()) {
+        emit error("No cover image to write");
+        return false;
+    }
+
+    return writeTagsToFile(filePath, imageToByteArray(coverArt));
+}
+
+bool MediaTagWriter::writeTagsToFile(const QString& filePath, const QByteArray& imageData)
+{
+    if (isJpegData(imageData)) {
+        return writeTagsToFile(filePath, imageData, CoverFormat::Jpeg);
+    }
+    if (isPngData(imageData)) {
+        return writeTagsToFile(filePath, imageData, CoverFormat::Png);
+    }
+
+    // Anything but JPEG/PNG can't be stored as cover art, convert it once
+    QImage coverArt = QImage::fromData(imageData);
+    if (coverArt.isNull()) {
+        emit error("Unsupported cover image format");
+        return false;
+    }
+    return writeTagsToFile(filePath, coverArt);
+}
+
+bool MediaTagWriter::writeTagsToFile(const QString& filePath, const QByteArray& imageData, CoverFormat format)
+{
+    if (imageData.isEmpty()) {
+        emit error("No cover image to write");
+        return false;
+    }
+
     QString extension = QFileInfo(filePath).suffix().toLower();
+    if (extension != "mp4" && extension != "mkv") {
+        emit error("Unsupported file format");
+        return false;
+    }
 
     emit progressUpdate("Starting to write tags...");
 
-    if (extension == "mp4") {
-        return writeMp4Tags(filePath, coverArt);
-    } else if (extension == "mkv") {
-        return writeMkvTags(filePath, coverArt);
-    } else {
-        emit error("Unsupported file format");
+    QElapsedTimer timer;
+    timer.start();
+
+    // Roll back a journaled write interrupted earlier, with or without safe writes. Editing
+    // the half-written file would leave a journal that later restores bytes over the new tags.
+    QString recoveryError;
+    if (!WriteJournal::recover(filePath, &recoveryError)) {
+        Metrics::instance().increment("tag_write_failures");
+        emit error(QString("Tags not written, an interrupted write can't be rolled back: %1").arg(recoveryError));
         return false;
     }
+
+    bool written = false;
+    if (m_safeWrites) {
+        written = writeTagsSafely(filePath, imageData, format, extension == "mkv");
+    } else if (extension == "mp4") {
+        written = writeMp4Tags(filePath, imageData, format);
+    } else {
+        written = writeMkvTags(filePath, imageData, format);
+    }
+
+    Metrics::instance().observeElapsed("tag_write_seconds", timer);
+    if (!written) {
+        Metrics::instance().increment("tag_write_failures");
+    }
+    return written;
 }
 
-QByteArray MediaTagWriter::pixmapToByteArray(const QPixmap& pixmap)
+QByteArray MediaTagWriter::imageToByteArray(const QImage& image)
 {
     QByteArray imageData;
     QBuffer buffer(&imageData);
     buffer.open(QIODevice::WriteOnly);
-    pixmap.save(&buffer, "JPEG");
+    image.save(&buffer, "JPEG");
     return imageData;
 }
 
-bool MediaTagWriter::writeMp4Tags(const QString& filePath, const QPixmap& coverArt)
+bool MediaTagWriter::isJpegData(const QByteArray& imageData)
+{
+    return imageData.startsWith("\xFF\xD8\xFF");
+}
+
+bool MediaTagWriter::isPngData(const QByteArray& imageData)
 {
+    return imageData.startsWith("\x89PNG\r\n\x1A\n");
+}
+
+bool MediaTagWriter::writeMp4Tags(const QString& filePath, const QByteArray& imageData, CoverFormat format)
+{
+    emit progressUpdate("Saving MP4 tags...");
+
+    // Step 1: Replace the covr item and the metadata items in-process, in place when
+    // the ilst padding has room for them
+    QElapsedTimer timer;
+    timer.start();
+    Mp4Editor editor(filePath);
+    editor.setCover(imageData, format == CoverFormat::Png ? Mp4::PngDataType : Mp4::JpegDataType);
+    applyMetadata(editor);
+    bool saved = editor.save();
+    Metrics::instance().observeElapsed("mp4_edit_seconds", timer);
+    if (saved) {
+        Metrics::instance().observeBytes("tag_write_bytes", editor.bytesWritten());
+        if (editor.saveMode() == Mp4Editor::SaveMode::InPlace) {
+            emit success("MP4 tags written in place");
+        } else {
+            emit success(QString("MP4 tags written, %1 bytes moved").arg(editor.bytesMoved()));
+        }
+        return true;
+    }
+    qWarning() << "In-process MP4 editing failed:" << editor.errorString();
+
+    // A save that failed after writing may have moved the media data without updating
+    // moov. TagLib would "repair" a file whose chunk offsets are wrong, so stop here.
+    if (editor.bytesWritten() > 0) {
+        emit error(QString("Failed to write MP4 tags, the file may be damaged: %1").arg(editor.errorString()));
+        return false;
+    }
+
+    // Step 2: Fall back to TagLib (nothing was written yet), which may rewrite the whole file
+    timer.restart();
     try {
         TagLib::MP4::File file(filePath.toStdString().c_str());
         if (!file.isValid()) {
@@ -48,29 +323,40 @@ bool MediaTagWriter::writeMp4Tags(const QString& filePath, const QPixmap& coverA
 
         TagLib::MP4::Tag *tag = file.tag();
         if (tag) {
-            // Add cover art
-            QByteArray imageData = pixmapToByteArray(coverArt);
-            TagLib::MP4::CoverArt::Format format = TagLib::MP4::CoverArt::JPEG;
-            TagLib::ByteVector byteVector(imageData.data(), imageData.size());
-            TagLib::MP4::CoverArt art(format, byteVector);
+            // Add cover art. The ByteVector copies the image once, TagLib then shares
+            // that one copy between the CoverArt, the list and the item.
+            TagLib::MP4::CoverArt::Format mp4Format = format == CoverFormat::Png ? TagLib::MP4::CoverArt::PNG
+                                                                                 : TagLib::MP4::CoverArt::JPEG;
+            TagLib::ByteVector byteVector(imageData.constData(), static_cast<unsigned int>(imageData.size()));
+            TagLib::MP4::CoverArt art(mp4Format, byteVector);
 
             // Create cover art list
             TagLib::MP4::CoverArtList coverArtList;
             coverArtList.append(art);
 
-            // Get the current item list map and modify it
-            TagLib::MP4::ItemMap items = tag->itemMap();
-            // Remove existing cover art if present
-            if (items.contains("covr")) {
-                tag->removeItem("covr");
-            }
-
             // Add new cover art
             tag->setItem("covr", coverArtList);  // Add or replace cover art
 
-            emit progressUpdate("Saving MP4 tags...");
-            if (file.save()) {
-                emit success("MP4 tags written successfully");
+            // Metadata items go into the same save, the file is rewritten at most once.
+            // TagLib names items like the editor does, freeform ones as "----:mean:name".
+            if (m_metadata.id != 0) {
+                for (const QByteArray& managedKey : managedMp4Keys()) {
+                    tag->removeItem(TagLib::String(managedKey.constData(), TagLib::String::Latin1));
+                }
+            }
+            const QList<QPair<QByteArray, QString>> items = mp4Items();
+            for (const auto& item : items) {
+                TagLib::String key(item.first.constData(), TagLib::String::Latin1);
+                TagLib::String value(item.second.toStdString(), TagLib::String::UTF8);
+                tag->setItem(key, TagLib::MP4::Item(TagLib::StringList(value)));
+            }
+
+            bool rewritten = file.save();
+            Metrics::instance().observeElapsed("taglib_save_seconds", timer);
+            if (rewritten) {
+                // TagLib doesn't tell how much it wrote, count the whole file
+                Metrics::instance().observeBytes("tag_write_bytes", QFileInfo(filePath).size());
+                emit success("MP4 tags written, file rewritten");
                 return true;
             }
         }
@@ -83,19 +369,47 @@ bool MediaTagWriter::writeMp4Tags(const QString& filePath, const QPixmap& coverA
     }
 }
 
-bool MediaTagWriter::writeMkvTags(const QString& filePath, const QPixmap& coverArt)
+bool MediaTagWriter::writeMkvTags(const QString& filePath, const QByteArray& imageData, CoverFormat format)
 {
-    QString mkvpropeditPath;
+    bool isPng = format == CoverFormat::Png;
+    QString attachmentName = isPng ? "cover.png" : "cover.jpg";
+    QString mimeType = isPng ? "image/png" : "image/jpeg";
+
+    emit progressUpdate("Saving MKV tags...");
 
-    // Step 1: Check if mkvpropedit is available in the system
+    // Step 1: Replace the cover attachment and the movie tags in-process, only the
+    // Attachments/Tags/SeekHead are written
+    QElapsedTimer timer;
+    timer.start();
+    MatroskaEditor editor(filePath);
+    editor.setCover(imageData, attachmentName, mimeType);
+    applyMetadata(editor);
+    bool saved = editor.save();
+    Metrics::instance().observeElapsed("mkv_edit_seconds", timer);
+    if (saved) {
+        Metrics::instance().observeBytes("tag_write_bytes", editor.bytesWritten());
+        emit success("MKV tags written successfully");
+        return true;
+    }
+    qWarning() << "In-process MKV editing failed:" << editor.errorString();
+
+    // A save that failed after writing may have left a new block behind without the
+    // SeekHead or the old Attachments updated. mkvpropedit isn't let loose on that.
+    if (editor.bytesWritten() > 0) {
+        emit error(QString("Failed to write MKV tags, the file may be damaged: %1").arg(editor.errorString()));
+        return false;
+    }
+
+    // Step 2: Fall back to mkvpropedit for layouts the native editor can't update in place
+    QString mkvpropeditPath;
     if (isMkvpropeditAvailable()) {
         mkvpropeditPath = "mkvpropedit";  // System's mkvpropedit
     } else {
-        emit error("mkvpropedit program not found. Please install it.");
+        emit error(QString("Failed to write MKV tags: %1").arg(editor.errorString()));
         return false;
     }
 
-    // Step 2: Convert QPixmap to a temporary image file (e.g., JPG)
+    // Step 3: Save the encoded cover as-is to a temporary image file
     QTemporaryFile tempImageFile;
     tempImageFile.setAutoRemove(true);
     if (!tempImageFile.open()) {
@@ -103,20 +417,33 @@ bool MediaTagWriter::writeMkvTags(const QString& filePath, const QPixmap& coverA
         return false;
     }
 
-    // Convert QPixmap to QImage, then save to file
-    QImage image = coverArt.toImage();
-    if (!image.save(&tempImageFile, "JPEG")) {
-        emit error("Failed to save image to temporary file in JPEG format");
+    if (tempImageFile.write(imageData) != imageData.size()) {
+        emit error("Failed to save image to temporary file");
         return false;
     }
     tempImageFile.flush();
     tempImageFile.close();
 
+    // Step 4: The metadata as a tag file, so mkvpropedit writes it in the same run
+    QTemporaryFile tempTagsFile;
+    tempTagsFile.setAutoRemove(true);
+    QString tagsFilePath;
+    if (!mkvSimpleTags().isEmpty()) {
+        if (!tempTagsFile.open() || !writeTagsXml(tempTagsFile)) {
+            emit error("Failed to save tags to temporary file");
+            return false;
+        }
+        tempTagsFile.close();
+        tagsFilePath = tempTagsFile.fileName();
+    }
 
-    emit progressUpdate("Saving MKV tags...");
-
-    // Step 3: Run mkvpropedit to modify the MKV file
-    if (!runMkvpropedit(mkvpropeditPath, filePath, tempImageFile.fileName())) {
+    // Step 5: Run mkvpropedit to modify the MKV file. Only its runtime is recorded,
+    // how much of the file it rewrote isn't known.
+    timer.restart();
+    bool edited = runMkvpropedit(mkvpropeditPath, filePath, tempImageFile.fileName(), attachmentName, mimeType,
+                                 tagsFilePath);
+    Metrics::instance().observeElapsed("mkvpropedit_seconds", timer);
+    if (!edited) {
         emit error("Failed to write MKV tags");
         return false;
     }
@@ -125,6 +452,90 @@ bool MediaTagWriter::writeMkvTags(const QString& filePath, const QPixmap& coverA
     return true;
 }
 
+QString MediaTagWriter::clonePathFor(const QString& filePath)
+{
+    QFileInfo fileInfo(filePath);
+    return fileInfo.absolutePath() + "/." + fileInfo.fileName() + ".movietag-clone";
+}
+
+bool MediaTagWriter::writeTagsSafely(const QString& filePath, const QByteArray& imageData, CoverFormat format, bool isMkv)
+{
+    bool isPng = format == CoverFormat::Png;
+
+    // Step 1: writeTagsToFile() rolled back an interrupted journaled edit. A clone left
+    // behind by an interrupted rewrite is dropped, the original is intact.
+    QString clonePath = clonePathFor(filePath);
+    QFile::remove(clonePath);
+
+    // Step 2: Edit in place, every region is saved to the journal before it's overwritten
+    emit progressUpdate(isMkv ? "Saving MKV tags (journaled)..." : "Saving MP4 tags (journaled)...");
+    QString editError;
+    {
+        // Scoped, the journal file must be closed before it is recovered below
+        WriteJournal journal(filePath);
+        if (isMkv) {
+            MatroskaEditor editor(filePath);
+            editor.setCover(imageData, isPng ? "cover.png" : "cover.jpg", isPng ? "image/png" : "image/jpeg");
+            applyMetadata(editor);
+            editor.setJournal(&journal);
+            if (editor.save()) {
+                Metrics::instance().observeBytes("tag_write_bytes", editor.bytesWritten());
+                emit success("MKV tags written in place, journaled");
+                return true;
+            }
+            editError = editor.errorString();
+        } else {
+            Mp4Editor editor(filePath);
+            editor.setCover(imageData, isPng ? Mp4::PngDataType : Mp4::JpegDataType);
+            applyMetadata(editor);
+            editor.setJournal(&journal);
+            if (editor.save()) {
+                Metrics::instance().observeBytes("tag_write_bytes", editor.bytesWritten());
+                emit success("MP4 tags written in place, journaled");
+                return true;
+            }
+            editError = editor.errorString();
+        }
+    }
+    qWarning() << "Journaled editing not possible:" << editError;
+
+    // The edit may have stopped halfway, put the original bytes back
+    QString recoveryError;
+    if (!WriteJournal::recover(filePath, &recoveryError)) {
+        emit error(recoveryError);
+        return false;
+    }
+
+    // Step 3: Rewrite a copy-on-write clone, the original stays untouched until the atomic rename
+    QString cloneError;
+    if (!Reflink::clone(filePath, clonePath, &cloneError)) {
+        emit error(QString("Tags not written: the file needs a rewrite and can't be cloned safely (%1)").arg(cloneError));
+        return false;
+    }
+
+    bool written = isMkv ? writeMkvTags(clonePath, imageData, format) : writeMp4Tags(clonePath, imageData, format);
+    QFile clone(clonePath);
+    if (!written || !clone.open(QIODevice::ReadWrite) || !WriteJournal::syncFile(clone)) {
+        clone.close();
+        QFile::remove(clonePath);
+        if (written) {
+            emit error(QString("Failed to sync the rewritten file: %1").arg(clone.errorString()));
+        }
+        return false;
+    }
+    clone.close();
+
+    // Step 4: Swap the clone in
+    QString replaceError;
+    if (!Reflink::replace(clonePath, filePath, &replaceError)) {
+        QFile::remove(clonePath);
+        emit error(replaceError);
+        return false;
+    }
+    WriteJournal::syncDirectory(QFileInfo(filePath).absolutePath());
+    return true;
+}
+
 bool MediaTagWriter::isMkvpropeditAvailable() {
     QProcess process;
     process.start("which", QStringList() << "mkvpropedit");
@@ -132,35 +543,30 @@ bool MediaTagWriter::isMkvpropeditAvailable() {
     return process.exitCode() == 0;
 }
 
-bool MediaTagWriter::runMkvpropedit(const QString &mkvpropeditPath, const QString &movieFilePath, const QString &attachmentFilePath) {
+bool MediaTagWriter::runMkvpropedit(const QString &mkvpropeditPath, const QString &movieFilePath, const QString &attachmentFilePath,
+                                    const QString &attachmentName, const QString &mimeType, const QString &tagsFilePath) {
     QProcess process;
 
-    // Step 1: Delete existing attachments with MIME type "image/jpeg"
-    QStringList deleteArgs;
-    deleteArgs << movieFilePath << "--delete-attachment" << "mime-type:image/jpeg";
-    process.start(mkvpropeditPath, deleteArgs);
-    if (!process.waitForFinished()) {
-        qWarning() << "Failed to execute mkvpropedit for deleting attachments:" << process.errorString();
-        return false;
+    // Delete existing cover attachments (MIME type "image/jpeg" or "image/png"), add
+    // the new one and replace the tags in a single run, mkvpropedit applies the actions in order
+    QStringList args;
+    args << movieFilePath
+         << "--delete-attachment" << "mime-type:image/jpeg"
+         << "--delete-attachment" << "mime-type:image/png"
+         << "--attachment-name" << attachmentName
+         << "--attachment-mime-type" << mimeType
+         << "--add-attachment" << attachmentFilePath;
+    if (!tagsFilePath.isEmpty()) {
+        // Replaces the global tags, tags of tracks are kept
+        args << "--tags" << "global:" + tagsFilePath;
     }
-    if (process.exitCode() == 2) {
-        qWarning() << "Error occurred when trying to delete attachments.";
-        return false;
-    }
-
-    // Step 2: Add new attachment
-    QStringList addArgs;
-    addArgs << movieFilePath
-            << "--attachment-name" << "cover.jpg"
-            << "--attachment-mime-type" << "image/jpeg"
-            << "--add-attachment" << attachmentFilePath;
-    process.start(mkvpropeditPath, addArgs);
+    process.start(mkvpropeditPath, args);
     if (!process.waitForFinished()) {
-        qWarning() << "Failed to execute mkvpropedit for adding attachment:" << process.errorString();
+        qWarning() << "Failed to execute mkvpropedit:" << process.errorString();
         return false;
     }
     if (process.exitCode() == 2) {
-        qWarning() << "Error occurred when trying to add attachment.";
+        qWarning() << "Error occurred when trying to replace attachments.";
         return false;
     }
 
@@ -3,7 +3,11 @@
 
 #include <QString>
 #include <QPixmap>
+#include <QImage>
 #include <QObject>
+#include <QList>
+#include <QPair>
+#include "movieresult.h"
 #include <taglib/taglib.h>
 #include <taglib/mp4file.h>
 #include <taglib/tfile.h>
@@ -13,13 +17,40 @@
 #include <taglib/mp4tag.h>
 #include <taglib/mp4coverart.h>
 
+class Mp4Editor;
+class MatroskaEditor;
+class QIODevice;
+
 class MediaTagWriter : public QObject
 {
     Q_OBJECT
 
 public:
+    // Encodings that can be embedded without transcoding
+    enum class CoverFormat {
+        Jpeg,
+        Png
+    };
+
     explicit MediaTagWriter(QObject *parent = nullptr);
+
+    // Crash-safe mode: in-place edits are journaled (see WriteJournal), edits that
+    // have to move media data are done on a reflink clone that atomically replaces
+    // the file. Files that would need a rewrite on filesystems without reflinks are
+    // not written. Off by default.
+    void setSafeWrites(bool enabled);
+    // Movie written along with the cover, in the same save: title, year, genres,
+    // overview, TMDb id, directors and cast (see TmdbClient::getMovieDetails()).
+    // A default MovieResult (id 0) writes the cover only.
+    void setMetadata(const MovieResult& movie);
     bool writeTagsToFile(const QString& filePath, const QPixmap& coverArt);
+    // QImage overload, safe to call outside the GUI thread (batch mode)
+    bool writeTagsToFile(const QString& filePath, const QImage& coverArt);
+    // Embed encoded JPEG/PNG data as-is, without decoding or scaling it.
+    // Data in any other image format is re-encoded to JPEG.
+    bool writeTagsToFile(const QString& filePath, const QByteArray& imageData);
+    // Embed imageData, already encoded as format, without transcoding or copying it more than needed
+    bool writeTagsToFile(const QString& filePath, const QByteArray& imageData, CoverFormat format);
 
 signals:
     void progressUpdate(const QString& message);
@@ -27,11 +58,25 @@ signals:
     void success(const QString& message);
 
 private:
-    bool writeMp4Tags(const QString& filePath, const QPixmap& coverArt);
-    bool writeMkvTags(const QString& filePath, const QPixmap& coverArt);
-    QByteArray pixmapToByteArray(const QPixmap& pixmap);
+    bool writeMp4Tags(const QString& filePath, const QByteArray& imageData, CoverFormat format);
+    bool writeMkvTags(const QString& filePath, const QByteArray& imageData, CoverFormat format);
+    bool writeTagsSafely(const QString& filePath, const QByteArray& imageData, CoverFormat format, bool isMkv);
+    static QString clonePathFor(const QString& filePath);
+    // The metadata as ilst items ("----:mean:name" for freeform ones) and as Matroska SimpleTags
+    QList<QPair<QByteArray, QString>> mp4Items() const;
+    QList<QPair<QString, QString>> mkvSimpleTags() const;
+    void applyMetadata(Mp4Editor& editor) const;
+    void applyMetadata(MatroskaEditor& editor) const;
+    bool writeTagsXml(QIODevice& device) const;
+    QByteArray imageToByteArray(const QImage& image);
+    static bool isJpegData(const QByteArray& imageData);
+    static bool isPngData(const QByteArray& imageData);
     bool isMkvpropeditAvailable();
-    bool runMkvpropedit(const QString &mkvpropeditPath, const QString &movieFilePath, const QString &attachmentFilePath);
+    bool runMkvpropedit(const QString &mkvpropeditPath, const QString &movieFilePath, const QString &attachmentFilePath,
+                        const QString &attachmentName, const QString &mimeType, const QString &tagsFilePath);
+
+    bool m_safeWrites = false;
+    MovieResult m_metadata;
 };
 
 #endif // MEDIATAGWRITER_H
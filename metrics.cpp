@@ -0,0 +1,320 @@
+#include "metrics.h"
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QSaveFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QDebug>
+#include <algorithm>
+
+#if defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#endif
+
+Metrics& Metrics::instance()
+{
+    static Metrics metrics;
+    return metrics;
+}
+
+const QVector<double>& Metrics::upperBounds(Unit unit)
+{
+    // 1 ms .. 1 min, TMDb requests and tag writes both fall in this range
+    static const QVector<double> seconds = {
+        0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60
+    };
+
+    // 1 KiB .. 1 GiB in steps of 4, posters are tens of KiB, TagLib rewrites whole files
+    static const QVector<double> bytes = [] {
+        QVector<double> bounds;
+        for (double bound = 1024; bound <= 1024.0 * 1024 * 1024; bound *= 4) {
+            bounds.append(bound);
+        }
+        return bounds;
+    }();
+
+    return unit == Unit::Seconds ? seconds : bytes;
+}
+
+void Metrics::increment(const QString& name, qint64 delta)
+{
+    QMutexLocker locker(&m_mutex);
+    m_counters[name] += delta;
+}
+
+void Metrics::observeSeconds(const QString& name, double seconds)
+{
+    observe(name, Unit::Seconds, seconds);
+}
+
+void Metrics::observeBytes(const QString& name, qint64 bytes)
+{
+    observe(name, Unit::Bytes, static_cast<double>(bytes));
+}
+
+void Metrics::observeElapsed(const QString& name, const QElapsedTimer& timer)
+{
+    observe(name, Unit::Seconds, timer.nsecsElapsed() / 1e9);
+}
+
+void Metrics::observe(const QString& name, Unit unit, double value)
+{
+    const QVector<double>& bounds = upperBounds(unit);
+
+    // Bounds are sorted, the first one not below the value takes the sample
+    int bucket = static_cast<int>(std::lower_bound(bounds.begin(), bounds.end(), value) - bounds.begin());
+
+    QMutexLocker locker(&m_mutex);
+    Histogram& histogram = m_histograms[name];
+    if (histogram.buckets.isEmpty()) {
+        histogram.unit = unit;
+        histogram.buckets.fill(0, bounds.size() + 1);
+    }
+    ++histogram.buckets[bucket];
+    ++histogram.count;
+    histogram.sum += value;
+    histogram.max = qMax(histogram.max, value);
+}
+
+qint64 Metrics::counter(const QString& name) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_counters.value(name);
+}
+
+qint64 Metrics::count(const QString& name) const
+{
+    QMutexLocker locker(&m_mutex);
+    auto it = m_histograms.constFind(name);
+    return it != m_histograms.constEnd() ? it->count : 0;
+}
+
+double Metrics::quantile(const QString& name, double q) const
+{
+    QMutexLocker locker(&m_mutex);
+    auto it = m_histograms.constFind(name);
+    return it != m_histograms.constEnd() ? quantile(*it, q) : 0;
+}
+
+double Metrics::quantile(const Histogram& histogram, double q)
+{
+    if (histogram.count == 0) {
+        return 0;
+    }
+
+    // Find the bucket holding the sample of rank q * count and interpolate linearly in it
+    const QVector<double>& bounds = upperBounds(histogram.unit);
+    double rank = qBound(0.0, q, 1.0) * histogram.count;
+    qint64 cumulative = 0;
+    for (int i = 0; i < histogram.buckets.size(); ++i) {
+        qint64 inBucket = histogram.buckets.at(i);
+        if (inBucket == 0 || cumulative + inBucket < rank) {
+            cumulative += inBucket;
+            continue;
+        }
+
+        double lower = i == 0 ? 0 : bounds.at(i - 1);
+        double upper = i < bounds.size() ? bounds.at(i) : histogram.max;
+        double value = lower + (upper - lower) * (rank - cumulative) / inBucket;
+        return qMin(value, histogram.max);
+    }
+    return histogram.max;
+}
+
+QByteArray Metrics::toJsonLine() const
+{
+    QJsonObject counters;
+    QJsonObject histograms;
+    {
+        QMutexLocker locker(&m_mutex);
+        for (auto it = m_counters.constBegin(); it != m_counters.constEnd(); ++it) {
+            counters.insert(it.key(), it.value());
+        }
+        for (auto it = m_histograms.constBegin(); it != m_histograms.constEnd(); ++it) {
+            const Histogram& histogram = it.value();
+            QJsonObject object;
+            object.insert("unit", histogram.unit == Unit::Seconds ? "seconds" : "bytes");
+            object.insert("count", histogram.count);
+            object.insert("sum", histogram.sum);
+            object.insert("max", histogram.max);
+            object.insert("p50", quantile(histogram, 0.5));
+            object.insert("p90", quantile(histogram, 0.9));
+            object.insert("p99", quantile(histogram, 0.99));
+            histograms.insert(it.key(), object);
+        }
+    }
+
+    QJsonObject line;
+    line.insert("time", QDateTime::currentDateTimeUtc().toString(Qt::ISODateWithMs));
+    line.insert("counters", counters);
+    line.insert("histograms", histograms);
+    return QJsonDocument(line).toJson(QJsonDocument::Compact) + '\n';
+}
+
+QByteArray Metrics::toPrometheusText() const
+{
+    QByteArray text;
+    QMutexLocker locker(&m_mutex);
+
+    for (auto it = m_counters.constBegin(); it != m_counters.constEnd(); ++it) {
+        QByteArray name = "movietag_" + it.key().toUtf8() + "_total";
+        text += "# TYPE " + name + " counter\n";
+        text += name + ' ' + QByteArray::number(it.value()) + '\n';
+    }
+
+    for (auto it = m_histograms.constBegin(); it != m_histograms.constEnd(); ++it) {
+        const Histogram& histogram = it.value();
+        const QVector<double>& bounds = upperBounds(histogram.unit);
+        QByteArray name = "movietag_" + it.key().toUtf8();
+        text += "# TYPE " + name + " histogram\n";
+
+        // Prometheus buckets are cumulative
+        qint64 cumulative = 0;
+        for (int i = 0; i < histogram.buckets.size(); ++i) {
+            cumulative += histogram.buckets.at(i);
+            QByteArray bound = i < bounds.size() ? QByteArray::number(bounds.at(i), 'g', 12) : "+Inf";
+            text += name + "_bucket{le=\"" + bound + "\"} " + QByteArray::number(cumulative) + '\n';
+        }
+        text += name + "_sum " + QByteArray::number(histogram.sum, 'g', 12) + '\n';
+        text += name + "_count " + QByteArray::number(histogram.count) + '\n';
+    }
+    return text;
+}
+
+QString Metrics::formatValue(Unit unit, double value)
+{
+    if (unit == Unit::Seconds) {
+        return value < 1 ? QString("%1 ms").arg(value * 1000, 0, 'f', 1)
+                         : QString("%1 s").arg(value, 0, 'f', 2);
+    }
+    if (value < 1024 * 1024) {
+        return QString("%1 KiB").arg(value / 1024, 0, 'f', 1);
+    }
+    return QString("%1 MiB").arg(value / (1024 * 1024), 0, 'f', 1);
+}
+
+QStringList Metrics::summaryLines() const
+{
+    QStringList lines;
+    QMutexLocker locker(&m_mutex);
+
+    for (auto it = m_histograms.constBegin(); it != m_histograms.constEnd(); ++it) {
+        const Histogram& histogram = it.value();
+        if (histogram.count == 0) {
+            continue;
+        }
+        lines << QString("%1: %2 x, avg %3, p50 %4, p99 %5, max %6")
+                     .arg(it.key())
+                     .arg(histogram.count)
+                     .arg(formatValue(histogram.unit, histogram.sum / histogram.count))
+                     .arg(formatValue(histogram.unit, quantile(histogram, 0.5)))
+                     .arg(formatValue(histogram.unit, quantile(histogram, 0.99)))
+                     .arg(formatValue(histogram.unit, histogram.max));
+    }
+
+    for (auto it = m_counters.constBegin(); it != m_counters.constEnd(); ++it) {
+        lines << QString("%1: %2").arg(it.key()).arg(it.value());
+    }
+    return lines;
+}
+
+void Metrics::reset()
+{
+    QMutexLocker locker(&m_mutex);
+    m_counters.clear();
+    m_histograms.clear();
+}
+
+qint64 Metrics::peakResidentBytes()
+{
+#if defined(Q_OS_UNIX)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return -1;
+    }
+#if defined(Q_OS_MACOS)
+    return usage.ru_maxrss;  // Bytes on macOS
+#else
+    return static_cast<qint64>(usage.ru_maxrss) * 1024;  // KiB on Linux and the BSDs
+#endif
+#else
+    return -1;
+#endif
+}
+
+MetricsExporter::MetricsExporter(QObject *parent) : QObject(parent)
+{
+    connect(&m_timer, &QTimer::timeout, this, [this]() {
+        if (!exportNow()) {
+            qWarning().noquote() << "Couldn't export metrics:" << m_errorString;
+        }
+    });
+}
+
+MetricsExporter::Format MetricsExporter::formatFromString(const QString& format)
+{
+    return format.compare("prometheus", Qt::CaseInsensitive) == 0 ? Format::Prometheus : Format::JsonLines;
+}
+
+void MetricsExporter::setFilePath(const QString& filePath)
+{
+    m_filePath = filePath;
+}
+
+void MetricsExporter::setFormat(Format format)
+{
+    m_format = format;
+}
+
+void MetricsExporter::start(int intervalSeconds)
+{
+    if (m_filePath.isEmpty()) {
+        return;
+    }
+    m_timer.start(qMax(1, intervalSeconds) * 1000);
+}
+
+void MetricsExporter::stop()
+{
+    m_timer.stop();
+}
+
+bool MetricsExporter::exportNow()
+{
+    if (m_filePath.isEmpty()) {
+        return true;
+    }
+    QDir().mkpath(QFileInfo(m_filePath).absolutePath());
+
+    // JSON lines: one snapshot appended per export
+    if (m_format == Format::JsonLines) {
+        QFile file(m_filePath);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Append) || file.write(Metrics::instance().toJsonLine()) < 0) {
+            m_errorString = file.errorString();
+            return false;
+        }
+        return true;
+    }
+
+    // Prometheus: the file is replaced atomically, a scraper never sees half of it
+    QSaveFile file(m_filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        m_errorString = file.errorString();
+        return false;
+    }
+    file.write(Metrics::instance().toPrometheusText());
+    if (!file.commit()) {
+        m_errorString = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+QString MetricsExporter::errorString() const
+{
+    return m_errorString;
+}
@@ -0,0 +1,110 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QVector>
+#include <QMap>
+#include <QMutex>
+#include <QTimer>
+
+class QElapsedTimer;
+
+// Counters and histograms of the tagging pipeline (TMDb requests, poster decoding,
+// tag writes), shared by the whole process. Thread safe, tag writes record from
+// worker threads.
+//
+// Histograms have fixed buckets, so recording is cheap and the memory use doesn't
+// grow with the number of samples. Quantiles are estimated from the buckets.
+class Metrics
+{
+public:
+    enum class Unit {
+        Seconds,
+        Bytes
+    };
+
+    static Metrics& instance();
+
+    void increment(const QString& name, qint64 delta = 1);
+    void observeSeconds(const QString& name, double seconds);
+    void observeBytes(const QString& name, qint64 bytes);
+    // Time since timer was started
+    void observeElapsed(const QString& name, const QElapsedTimer& timer);
+
+    qint64 counter(const QString& name) const;
+    qint64 count(const QString& name) const;
+    // Estimated value below which fraction q (0..1) of the samples are, 0 without samples
+    double quantile(const QString& name, double q) const;
+
+    // One JSON object per call, for appending to a JSON lines file
+    QByteArray toJsonLine() const;
+    // Prometheus text exposition format, metric names get a "movietag_" prefix
+    QByteArray toPrometheusText() const;
+    // One human readable line per metric with samples
+    QStringList summaryLines() const;
+
+    void reset();
+
+    // Largest resident set size of this process so far, -1 where it isn't known
+    static qint64 peakResidentBytes();
+
+private:
+    Metrics() = default;
+
+    struct Histogram {
+        Unit unit = Unit::Seconds;
+        QVector<qint64> buckets;  // Samples per upper bound, the last one is +Inf
+        qint64 count = 0;
+        double sum = 0;
+        double max = 0;
+    };
+
+    static const QVector<double>& upperBounds(Unit unit);
+    static double quantile(const Histogram& histogram, double q);
+    static QString formatValue(Unit unit, double value);
+    void observe(const QString& name, Unit unit, double value);
+
+    mutable QMutex m_mutex;
+    // Sorted, the exports list metrics in the same order every time
+    QMap<QString, qint64> m_counters;
+    QMap<QString, Histogram> m_histograms;
+};
+
+// Writes Metrics::instance() to a file every few seconds, either appending JSON
+// lines or replacing a Prometheus text file (for node_exporter's textfile collector)
+class MetricsExporter : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum class Format {
+        JsonLines,
+        Prometheus
+    };
+
+    explicit MetricsExporter(QObject *parent = nullptr);
+
+    // "jsonl" or "prometheus", anything else is JSON lines
+    static Format formatFromString(const QString& format);
+
+    void setFilePath(const QString& filePath);
+    void setFormat(Format format);
+
+    // Export every intervalSeconds, nothing is exported without a file path
+    void start(int intervalSeconds);
+    void stop();
+
+    bool exportNow();
+    QString errorString() const;
+
+private:
+    QTimer m_timer;
+    QString m_filePath;
+    Format m_format = Format::JsonLines;
+    QString m_errorString;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,79 @@
+#include "movieitemdelegate.h"
+#include "movielistmodel.h"
+#include <QPainter>
+#include <QApplication>
+
+// Space around the row content and between cover and text
+static const int MARGIN = 9;
+static const int SPACING = 6;
+
+MovieItemDelegate::MovieItemDelegate(QObject *parent)
+    : QStyledItemDelegate(parent)
+{
+}
+
+void MovieItemDelegate::paint(QPainter *painter, const QStyleOptionViewItem& option, const QModelIndex& index) const
+{
+    QStyleOptionViewItem opt = option;
+    initStyleOption(&opt, index);
+
+    // Selection and hover background as the style draws it
+    const QWidget *widget = opt.widget;
+    QStyle *style = widget ? widget->style() : QApplication::style();
+    style->drawPrimitive(QStyle::PE_PanelItemViewItem, &opt, painter, widget);
+
+    painter->save();
+    painter->setClipRect(opt.rect);
+
+    QRect content = opt.rect.adjusted(MARGIN, MARGIN, -MARGIN, -MARGIN);
+    QRect coverRect(content.topLeft(), MovieListModel::THUMBNAIL_SIZE);
+
+    bool isSelected = opt.state & QStyle::State_Selected;
+    painter->setPen(opt.palette.color(isSelected ? QPalette::HighlightedText : QPalette::Text));
+
+    // Cover, placeholder text while the poster is loading
+    QPixmap cover = index.data(Qt::DecorationRole).value<QPixmap>();
+    if (cover.isNull()) {
+        painter->drawText(coverRect, Qt::AlignLeft | Qt::AlignVCenter, "Loading...");
+    } else {
+        QRect target(QPoint(0, 0), cover.size());
+        target.moveCenter(coverRect.center());
+        painter->drawPixmap(target, cover);
+    }
+
+    QRect textRect = content.adjusted(coverRect.width() + SPACING, 0, 0, 0);
+
+    // Title, wrapped if too long
+    QFont titleFont = opt.font;
+    titleFont.setPixelSize(24);
+    titleFont.setBold(true);
+    painter->setFont(titleFont);
+    QRect titleRect = painter->boundingRect(textRect, Qt::TextWordWrap, index.data(Qt::DisplayRole).toString());
+    painter->drawText(titleRect, Qt::TextWordWrap, index.data(Qt::DisplayRole).toString());
+    textRect.setTop(titleRect.bottom() + SPACING);
+
+    // Release year
+    QFont yearFont = opt.font;
+    yearFont.setPixelSize(18);
+    yearFont.setBold(true);
+    painter->setFont(yearFont);
+    QString year = index.data(MovieListModel::YearRole).toString();
+    if (!year.isEmpty()) {
+        QRect yearRect = painter->boundingRect(textRect, Qt::TextSingleLine, year);
+        painter->drawText(yearRect, Qt::TextSingleLine, year);
+        textRect.setTop(yearRect.bottom() + SPACING);
+    }
+
+    // Description, whatever fits in the remaining height
+    painter->setFont(opt.font);
+    painter->drawText(textRect, Qt::TextWordWrap, index.data(MovieListModel::OverviewRole).toString());
+
+    painter->restore();
+}
+
+QSize MovieItemDelegate::sizeHint(const QStyleOptionViewItem& option, const QModelIndex& index) const
+{
+    Q_UNUSED(index)
+    // Same height for every row, the width follows the view
+    return QSize(option.rect.width(), MovieListModel::THUMBNAIL_SIZE.height() + 2 * MARGIN);
+}
@@ -0,0 +1,19 @@
+#ifndef MOVIEITEMDELEGATE_H
+#define MOVIEITEMDELEGATE_H
+
+#include <QStyledItemDelegate>
+
+// Paints a MovieListModel row: cover on the left, title, year and description next
+// to it. Rows have a fixed height so the view can lay out thousands of them cheaply.
+class MovieItemDelegate : public QStyledItemDelegate
+{
+    Q_OBJECT
+
+public:
+    explicit MovieItemDelegate(QObject *parent = nullptr);
+
+    void paint(QPainter *painter, const QStyleOptionViewItem& option, const QModelIndex& index) const override;
+    QSize sizeHint(const QStyleOptionViewItem& option, const QModelIndex& index) const override;
+};
+
+#endif // MOVIEITEMDELEGATE_H
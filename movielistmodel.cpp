@@ -0,0 +1,209 @@
+#include "movielistmodel.h"
+#include <QDebug>
+
+const QSize MovieListModel::THUMBNAIL_SIZE(100, 150);
+
+// Thumbnails kept in memory, a few screens worth of rows
+static const int MAX_THUMBNAILS = 200;
+
+MovieListModel::MovieListModel(TmdbClient *tmdbClient, QObject *parent)
+    : QAbstractListModel(parent)
+    , m_tmdbClient(tmdbClient)
+    , m_year(0)
+    , m_page(0)
+    , m_totalPages(0)
+    , m_isFetching(false)
+    , m_generation(0)
+    , m_thumbnailer(THUMBNAIL_SIZE)
+    , m_nextDecodeId(1)
+{
+    m_thumbnails.setMaxCost(MAX_THUMBNAILS);
+    m_placeholder = QPixmap(":images/no-cover.png").scaled(THUMBNAIL_SIZE, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+
+    // Emitted from the decoder threads, arrives queued on the GUI thread
+    connect(&m_thumbnailer, &PosterThumbnailer::thumbnailReady, this, &MovieListModel::onThumbnailReady);
+}
+
+int MovieListModel::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : m_movies.size();
+}
+
+QVariant MovieListModel::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_movies.size()) {
+        return QVariant();
+    }
+
+    const MovieResult& movie = m_movies.at(index.row());
+    switch (role) {
+    case Qt::DisplayRole:
+        return movie.title;
+    case Qt::DecorationRole:
+        // Null until loadPosters() got the row's poster, the delegate shows a placeholder
+        if (QPixmap *thumbnail = m_thumbnails.object(index.row())) {
+            return *thumbnail;
+        }
+        return QVariant();
+    case YearRole:
+        return movie.year > 0 ? QString::number(movie.year) : QString();
+    case OverviewRole:
+        return movie.overview;
+    case PosterPathRole:
+        return movie.posterPath;
+    default:
+        return QVariant();
+    }
+}
+
+bool MovieListModel::canFetchMore(const QModelIndex& parent) const
+{
+    return !parent.isValid() && !m_isFetching && m_page > 0 && m_page < m_totalPages;
+}
+
+void MovieListModel::fetchMore(const QModelIndex& parent)
+{
+    if (!canFetchMore(parent)) {
+        return;
+    }
+
+    m_isFetching = true;
+    int generation = m_generation;
+    m_tmdbClient->searchMovie(m_query, m_year, m_page + 1, this,
+            [this, generation](bool ok, const TmdbClient::SearchPage& page) {
+                if (generation != m_generation) {
+                    return;
+                }
+                m_isFetching = false;
+                if (!ok) {
+                    // Stop paging, the view would just ask again
+                    m_totalPages = m_page;
+                    return;
+                }
+                appendPage(page);
+            });
+}
+
+void MovieListModel::search(const QString& query, int year)
+{
+    clear();
+    m_query = query;
+    m_year = year;
+    m_isFetching = true;
+
+    int generation = m_generation;
+    m_tmdbClient->searchMovie(query, year, 1, this,
+            [this, generation](bool ok, const TmdbClient::SearchPage& page) {
+                if (generation != m_generation) {
+                    return;
+                }
+                m_isFetching = false;
+                if (ok) {
+                    appendPage(page);
+                }
+                emit searchFinished(ok, m_movies.size());
+            });
+}
+
+void MovieListModel::clear()
+{
+    beginResetModel();
+    ++m_generation;
+    m_movies.clear();
+    m_thumbnails.clear();
+    m_loadingPosters.clear();
+    m_thumbnailer.cancelAll();
+    m_decodingRows.clear();
+    m_query.clear();
+    m_year = 0;
+    m_page = 0;
+    m_totalPages = 0;
+    m_isFetching = false;
+    endResetModel();
+}
+
+MovieResult MovieListModel::movie(int row) const
+{
+    return m_movies.value(row);
+}
+
+void MovieListModel::appendPage(const TmdbClient::SearchPage& page)
+{
+    m_page = page.page;
+    m_totalPages = page.totalPages;
+    if (page.movies.isEmpty()) {
+        return;
+    }
+
+    beginInsertRows(QModelIndex(), m_movies.size(), m_movies.size() + page.movies.size() - 1);
+    m_movies.append(page.movies);
+    endInsertRows();
+}
+
+void MovieListModel::loadPosters(int first, int last)
+{
+    first = qMax(0, first);
+    last = qMin(last, m_movies.size() - 1);
+
+    for (int row = first; row <= last; ++row) {
+        if (m_thumbnails.contains(row) || m_loadingPosters.contains(row)) {
+            continue;
+        }
+
+        QString posterPath = m_movies.at(row).posterPath;
+        if (posterPath.isEmpty() || !posterPath.startsWith("/")) {
+            setThumbnail(row, m_placeholder);
+            continue;
+        }
+
+        // Evicted rows come back here when scrolled into view again, then the
+        // poster cache answers without touching the network
+        m_loadingPosters.insert(row);
+        int generation = m_generation;
+        m_tmdbClient->downloadMoviePoster(posterPath, this,
+                [this, generation, row, posterPath](const QByteArray& imageData) {
+                    if (generation != m_generation) {
+                        return;
+                    }
+                    if (imageData.isEmpty()) {
+                        qDebug() << "Failed to download poster:" << posterPath;
+                        m_loadingPosters.remove(row);
+                        setThumbnail(row, m_placeholder);
+                        return;
+                    }
+
+                    // Decode and scale on a worker, only the thumbnail comes back
+                    quint64 id = m_nextDecodeId++;
+                    m_decodingRows.insert(id, row);
+                    m_thumbnailer.submit(id, imageData);
+                });
+    }
+}
+
+void MovieListModel::onThumbnailReady(quint64 id, const QImage& image)
+{
+    // Results of a previous search were dropped by clear()
+    auto it = m_decodingRows.find(id);
+    if (it == m_decodingRows.end()) {
+        return;
+    }
+    int row = it.value();
+    m_decodingRows.erase(it);
+    m_loadingPosters.remove(row);
+
+    if (image.isNull()) {
+        qDebug() << "Failed to decode poster of row" << row;
+        setThumbnail(row, m_placeholder);
+        return;
+    }
+    setThumbnail(row, QPixmap::fromImage(image));
+}
+
+void MovieListModel::setThumbnail(int row, const QPixmap& thumbnail)
+{
+    // Only the thumbnail is kept, the full poster is fetched again (from the cache) when writing tags
+    m_thumbnails.insert(row, new QPixmap(thumbnail));
+
+    QModelIndex changed = index(row);
+    emit dataChanged(changed, changed, {Qt::DecorationRole});
+}
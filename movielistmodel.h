@@ -0,0 +1,79 @@
+#ifndef MOVIELISTMODEL_H
+#define MOVIELISTMODEL_H
+
+#include <QAbstractListModel>
+#include <QPixmap>
+#include <QCache>
+#include <QSet>
+#include <QHash>
+#include "tmdbclient.h"
+#include "posterthumbnailer.h"
+#include "movieresult.h"
+
+// Search results of one TMDb query. Further result pages are fetched when the view
+// scrolls to the end (fetchMore), posters only for rows the view asks for (loadPosters).
+class MovieListModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    enum Role {
+        YearRole = Qt::UserRole + 1,
+        OverviewRole,
+        PosterPathRole
+    };
+
+    // Size of the poster thumbnails returned for Qt::DecorationRole
+    static const QSize THUMBNAIL_SIZE;
+
+    explicit MovieListModel(TmdbClient *tmdbClient, QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    bool canFetchMore(const QModelIndex& parent) const override;
+    void fetchMore(const QModelIndex& parent) override;
+
+    // Replace the results with the first page of query, searchFinished follows.
+    // A year > 0 restricts the results to movies released that year.
+    void search(const QString& query, int year = 0);
+    void clear();
+
+    MovieResult movie(int row) const;
+
+    // Download the posters of rows first..last that aren't loaded yet
+    void loadPosters(int first, int last);
+
+signals:
+    // First page of a search arrived (or failed)
+    void searchFinished(bool ok, int rowCount);
+
+private:
+    void appendPage(const TmdbClient::SearchPage& page);
+    void setThumbnail(int row, const QPixmap& thumbnail);
+    void onThumbnailReady(quint64 id, const QImage& image);
+
+    TmdbClient *m_tmdbClient;
+    MovieResults m_movies;
+    QString m_query;
+    int m_year;
+    int m_page;
+    int m_totalPages;
+    bool m_isFetching;
+
+    // Bumped on every new search, callbacks of older searches are dropped
+    int m_generation;
+
+    // Thumbnails of recently shown rows, others are reloaded (from the poster cache) on demand
+    QCache<int, QPixmap> m_thumbnails;
+    QSet<int> m_loadingPosters;
+
+    // Posters being decoded off the GUI thread, by decode job id
+    PosterThumbnailer m_thumbnailer;
+    QHash<quint64, int> m_decodingRows;
+    quint64 m_nextDecodeId;
+
+    // Shown for movies without (or with a broken) poster
+    QPixmap m_placeholder;
+};
+
+#endif // MOVIELISTMODEL_H
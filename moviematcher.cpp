@@ -0,0 +1,171 @@
+#include "moviematcher.h"
+#include <QVarLengthArray>
+#include <algorithm>
+#include <cmath>
+
+// Share of each component in the score, when all of them are known
+static const double TITLE_WEIGHT = 0.6;
+static const double YEAR_WEIGHT = 0.2;
+static const double RUNTIME_WEIGHT = 0.1;
+static const double POPULARITY_WEIGHT = 0.1;
+
+// Runtimes within this many minutes are a full match (cuts, credits, PAL speed-up),
+// the runtime score drops to 0 at RUNTIME_MISMATCH_MINUTES
+static const int RUNTIME_TOLERANCE_MINUTES = 3;
+static const int RUNTIME_MISMATCH_MINUTES = 15;
+
+void MovieMatcher::setThreshold(double threshold)
+{
+    m_threshold = qBound(0.0, threshold, 1.0);
+}
+
+void MovieMatcher::setMinimumMargin(double margin)
+{
+    m_minimumMargin = qBound(0.0, margin, 1.0);
+}
+
+double MovieMatcher::threshold() const
+{
+    return m_threshold;
+}
+
+double MovieMatcher::minimumMargin() const
+{
+    return m_minimumMargin;
+}
+
+QString MovieMatcher::normalizeTitle(const QString& title)
+{
+    // Step 1: "Amélie" and "Amelie" are the same title, drop the accents
+    QString decomposed = title.normalized(QString::NormalizationForm_KD);
+
+    // Step 2: Letters and digits only, everything else separates words
+    QString normalized;
+    normalized.reserve(decomposed.size());
+    for (QChar c : decomposed) {
+        if (c.category() == QChar::Mark_NonSpacing) {
+            continue;
+        }
+        if (c == '&') {
+            normalized += " and ";
+        } else if (c == '\'') {
+            // "Schindler's" and "Schindlers" as one word
+            continue;
+        } else if (c.isLetterOrNumber()) {
+            normalized += c.toLower();
+        } else {
+            normalized += ' ';
+        }
+    }
+    normalized = normalized.simplified();
+
+    // Step 3: Release names and TMDb disagree on the article ("Matrix" vs "The Matrix")
+    if (normalized.startsWith("the ")) {
+        normalized.remove(0, 4);
+    }
+    return normalized;
+}
+
+double MovieMatcher::titleSimilarity(const QString& a, const QString& b)
+{
+    QString first = normalizeTitle(a);
+    QString second = normalizeTitle(b);
+    if (first.isEmpty() || second.isEmpty()) {
+        return first == second ? 1.0 : 0.0;
+    }
+
+    // Levenshtein distance, two rows of the matrix are enough
+    QVarLengthArray<int, 64> previous(second.size() + 1);
+    QVarLengthArray<int, 64> current(second.size() + 1);
+    for (qsizetype j = 0; j <= second.size(); ++j) {
+        previous[j] = static_cast<int>(j);
+    }
+    for (qsizetype i = 1; i <= first.size(); ++i) {
+        current[0] = static_cast<int>(i);
+        for (qsizetype j = 1; j <= second.size(); ++j) {
+            int substitution = previous[j - 1] + (first.at(i - 1) == second.at(j - 1) ? 0 : 1);
+            current[j] = std::min({ previous[j] + 1, current[j - 1] + 1, substitution });
+        }
+        std::swap(previous, current);
+    }
+
+    int distance = previous[second.size()];
+    return 1.0 - static_cast<double>(distance) / std::max(first.size(), second.size());
+}
+
+MovieMatcher::Match MovieMatcher::match(const QString& title, int year, int runtimeMinutes, const MovieResults& movies) const
+{
+    Match result;
+    if (movies.isEmpty()) {
+        result.reason = "No candidates";
+        return result;
+    }
+
+    // Popularity only means something relative to the other results of the search
+    double maxPopularity = 0;
+    for (const MovieResult& movie : movies) {
+        maxPopularity = std::max(maxPopularity, movie.popularity);
+    }
+
+    for (const MovieResult& movie : movies) {
+        Candidate candidate;
+        candidate.movie = movie;
+
+        // Step 1: Title, the original title counts as well (foreign releases)
+        candidate.titleScore = titleSimilarity(title, movie.title);
+        if (!movie.originalTitle.isEmpty()) {
+            candidate.titleScore = std::max(candidate.titleScore, titleSimilarity(title, movie.originalTitle));
+        }
+        double weighted = TITLE_WEIGHT * candidate.titleScore;
+        double weights = TITLE_WEIGHT;
+
+        // Step 2: Year, regional releases are often a year apart
+        candidate.yearScore = -1;
+        if (year > 0 && movie.year > 0) {
+            int yearDistance = std::abs(year - movie.year);
+            candidate.yearScore = yearDistance == 0 ? 1.0 : yearDistance == 1 ? 0.8 : yearDistance == 2 ? 0.4 : 0.0;
+            weighted += YEAR_WEIGHT * candidate.yearScore;
+            weights += YEAR_WEIGHT;
+        }
+
+        // Step 3: Runtime, only known for candidates whose details were fetched
+        candidate.runtimeScore = -1;
+        if (runtimeMinutes > 0 && movie.runtime > 0) {
+            int runtimeDistance = std::abs(runtimeMinutes - movie.runtime);
+            candidate.runtimeScore = qBound(0.0,
+                                            1.0 - static_cast<double>(runtimeDistance - RUNTIME_TOLERANCE_MINUTES)
+                                                      / (RUNTIME_MISMATCH_MINUTES - RUNTIME_TOLERANCE_MINUTES),
+                                            1.0);
+            weighted += RUNTIME_WEIGHT * candidate.runtimeScore;
+            weights += RUNTIME_WEIGHT;
+        }
+
+        // Step 4: Popularity, on a log scale since it spans orders of magnitude
+        if (maxPopularity > 0) {
+            candidate.popularityScore = std::log1p(movie.popularity) / std::log1p(maxPopularity);
+            weighted += POPULARITY_WEIGHT * candidate.popularityScore;
+            weights += POPULARITY_WEIGHT;
+        }
+
+        candidate.score = weighted / weights;
+        result.candidates.append(candidate);
+    }
+
+    // Equal scores keep the TMDb order
+    std::stable_sort(result.candidates.begin(), result.candidates.end(),
+                     [](const Candidate& a, const Candidate& b) { return a.score > b.score; });
+
+    const Candidate& best = result.candidates.first();
+    double runnerUp = result.candidates.size() > 1 ? result.candidates.at(1).score : 0.0;
+    if (best.score < m_threshold) {
+        result.reason = QString("Best match '%1' scores %2, below %3")
+                            .arg(best.movie.title).arg(best.score, 0, 'f', 2).arg(m_threshold, 0, 'f', 2);
+    } else if (best.score - runnerUp < m_minimumMargin) {
+        result.reason = QString("'%1' (%2) and '%3' (%4) are too close")
+                            .arg(best.movie.title).arg(best.score, 0, 'f', 2)
+                            .arg(result.candidates.at(1).movie.title).arg(runnerUp, 0, 'f', 2);
+    } else {
+        result.accepted = true;
+    }
+    return result;
+}
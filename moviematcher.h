@@ -0,0 +1,58 @@
+#ifndef MOVIEMATCHER_H
+#define MOVIEMATCHER_H
+
+#include <QString>
+#include <QList>
+#include "movieresult.h"
+
+// Ranks TMDb search results against what the file tells about the movie (title
+// and year from the release name, runtime from the container) and decides
+// whether the best one is safe to tag without asking anyone.
+//
+// Each candidate gets a score in 0..1 from
+//   title      - normalized edit distance to the title or the original title
+//   year       - 1 for the same year, less for a year or two off
+//   runtime    - 1 within a few minutes of the file's duration
+//   popularity - relative to the most popular candidate, breaks ties between namesakes
+// Components the file doesn't know (no year, no duration) are left out and
+// the others weighted up, so a missing year neither helps nor hurts.
+class MovieMatcher
+{
+public:
+    struct Candidate {
+        MovieResult movie;
+        double score = 0;
+        double titleScore = 0;
+        double yearScore = 0;       // -1 if the file or the movie has no year
+        double runtimeScore = 0;    // -1 if the file or the movie has no runtime
+        double popularityScore = 0;
+    };
+
+    struct Match {
+        QList<Candidate> candidates;    // Best first
+        bool accepted = false;
+        QString reason;                 // Why the best candidate wasn't accepted, empty if it was
+
+        const Candidate& best() const { return candidates.first(); }
+    };
+
+    // Lowest score and lowest lead over the runner-up for an automatic match
+    void setThreshold(double threshold);
+    void setMinimumMargin(double margin);
+    double threshold() const;
+    double minimumMargin() const;
+
+    // runtimeMinutes 0 and year 0 mean unknown
+    Match match(const QString& title, int year, int runtimeMinutes, const MovieResults& movies) const;
+
+    // Lower case, no accents or punctuation, "&" spelled out, no leading article
+    static QString normalizeTitle(const QString& title);
+    // 1 - edit distance / length of the longer title, of the normalized titles
+    static double titleSimilarity(const QString& a, const QString& b);
+
+private:
+    double m_threshold = 0.75;
+    double m_minimumMargin = 0.1;
+};
+
+#endif // MOVIEMATCHER_H
@@ -0,0 +1,31 @@
+#ifndef MOVIERESULT_H
+#define MOVIERESULT_H
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QMetaType>
+
+// One movie of a TMDb search, only the fields MovieTag uses
+struct MovieResult
+{
+    int id = 0;
+    QString title;
+    int year = 0;  // Release year, 0 if unknown
+    QString overview;
+    QString posterPath;
+    QString originalTitle;  // Title in the original language, often the one release names use
+    double popularity = 0;  // TMDb popularity, only comparable within one search
+    int runtime = 0;        // Minutes, 0 if unknown. Only movie details have it, not searches.
+
+    // Only filled from movie details too
+    QStringList genres;
+    QStringList directors;
+    QStringList cast;       // Top billed first
+};
+
+using MovieResults = QList<MovieResult>;
+
+Q_DECLARE_METATYPE(MovieResult)
+
+#endif // MOVIERESULT_H
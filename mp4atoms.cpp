@@ -0,0 +1,168 @@
+#include "mp4atoms.h"
+#include <QIODevice>
+#include <QtEndian>
+
+namespace Mp4 {
+
+bool parseAtomHeader(const QByteArray& data, qint64 pos, qint64 end, Atom& atom)
+{
+    if (pos < 0 || pos + HeaderSize > data.size() || pos + HeaderSize > end) {
+        return false;
+    }
+
+    quint64 size = readUInt32(data, pos);
+    int headerSize = HeaderSize;
+
+    if (size == 1) {
+        // 64-bit size follows the type
+        if (pos + LargeHeaderSize > data.size()) {
+            return false;
+        }
+        size = readUInt64(data, pos + HeaderSize);
+        headerSize = LargeHeaderSize;
+    } else if (size == 0) {
+        // Last atom, extends to the end of the file or parent
+        size = static_cast<quint64>(end - pos);
+    }
+
+    if (size < static_cast<quint64>(headerSize) || size > static_cast<quint64>(end - pos)) {
+        return false;
+    }
+
+    atom.type = data.mid(pos + 4, 4);
+    atom.offset = pos;
+    atom.headerSize = headerSize;
+    atom.size = static_cast<qint64>(size);
+    return true;
+}
+
+bool readAtomHeader(QIODevice *device, qint64 offset, qint64 end, Atom& atom)
+{
+    if (!device->seek(offset)) {
+        return false;
+    }
+
+    QByteArray header = device->read(LargeHeaderSize);
+    // Parse relative to the header, the end is shifted along with it
+    if (!parseAtomHeader(header, 0, end - offset, atom)) {
+        return false;
+    }
+
+    atom.offset = offset;
+    return true;
+}
+
+qint64 childrenOffset(const Atom& atom)
+{
+    return atom.dataOffset() + (atom.type == "meta" ? 4 : 0);
+}
+
+bool childAtoms(const QByteArray& data, const Atom& parent, QList<Atom>& children)
+{
+    qint64 pos = childrenOffset(parent);
+    while (pos < parent.endOffset()) {
+        Atom child;
+        if (!parseAtomHeader(data, pos, parent.endOffset(), child)) {
+            return false;
+        }
+        children.append(child);
+        pos = child.endOffset();
+    }
+    return true;
+}
+
+bool findChild(const QByteArray& data, const Atom& parent, const char *type, Atom& child)
+{
+    QList<Atom> children;
+    if (!childAtoms(data, parent, children)) {
+        return false;
+    }
+
+    for (const Atom& candidate : children) {
+        if (candidate.type == type) {
+            child = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+quint32 readUInt32(const QByteArray& data, qint64 pos)
+{
+    return qFromBigEndian<quint32>(data.constData() + pos);
+}
+
+quint64 readUInt64(const QByteArray& data, qint64 pos)
+{
+    return qFromBigEndian<quint64>(data.constData() + pos);
+}
+
+void writeUInt32(QByteArray& data, qint64 pos, quint32 value)
+{
+    qToBigEndian<quint32>(value, data.data() + pos);
+}
+
+void writeUInt64(QByteArray& data, qint64 pos, quint64 value)
+{
+    qToBigEndian<quint64>(value, data.data() + pos);
+}
+
+QByteArray encodeUInt32(quint32 value)
+{
+    QByteArray encoded(4, '\0');
+    writeUInt32(encoded, 0, value);
+    return encoded;
+}
+
+QByteArray renderAtom(const char *type, const QByteArray& payload)
+{
+    return encodeUInt32(static_cast<quint32>(HeaderSize + payload.size())) + QByteArray(type, 4) + payload;
+}
+
+QByteArray dataItem(const char *type, quint32 dataType, const QByteArray& value)
+{
+    // Type indicator, then a locale of 0 (none)
+    return renderAtom(type, renderAtom("data", encodeUInt32(dataType) + encodeUInt32(0) + value));
+}
+
+QByteArray textItem(const char *type, const QString& value)
+{
+    return dataItem(type, Utf8DataType, value.toUtf8());
+}
+
+QByteArray freeformItem(const QByteArray& mean, const QByteArray& name, const QString& value)
+{
+    // mean and name are full atoms: version/flags, then the string
+    return renderAtom("----", renderAtom("mean", encodeUInt32(0) + mean)
+                              + renderAtom("name", encodeUInt32(0) + name)
+                              + renderAtom("data", encodeUInt32(Utf8DataType) + encodeUInt32(0) + value.toUtf8()));
+}
+
+QByteArray itemKey(const QByteArray& data, const Atom& item)
+{
+    if (item.type != "----") {
+        return item.type;
+    }
+
+    QByteArray key = item.type;
+    Atom child;
+    for (const char *type : {"mean", "name"}) {
+        key += ':';
+        if (findChild(data, item, type, child) && child.size >= HeaderSize + 4) {
+            key += data.mid(child.dataOffset() + 4, child.endOffset() - child.dataOffset() - 4);
+        }
+    }
+    return key;
+}
+
+QByteArray freeAtom(qint64 totalSize)
+{
+    return renderAtom("free", QByteArray(totalSize - HeaderSize, '\0'));
+}
+
+QByteArray freeHeader(qint64 totalSize)
+{
+    return encodeUInt32(static_cast<quint32>(totalSize)) + QByteArray("free", 4);
+}
+
+} // namespace Mp4
@@ -0,0 +1,73 @@
+#ifndef MP4ATOMS_H
+#define MP4ATOMS_H
+
+#include <QByteArray>
+#include <QString>
+#include <QList>
+#include <QtGlobal>
+
+class QIODevice;
+
+// Minimal ISO base media (MP4) atom primitives: header parsing and rendering
+namespace Mp4 {
+
+// Type indicators of the "data" atom inside ilst items
+constexpr quint32 Utf8DataType = 1;
+constexpr quint32 JpegDataType = 13;
+constexpr quint32 PngDataType = 14;
+
+// Mean of the freeform ("----") items iTunes and most taggers write
+constexpr const char *ItunesMean = "com.apple.iTunes";
+
+// Smallest atom: 32-bit size + type. 64-bit sizes add another 8 bytes.
+constexpr int HeaderSize = 8;
+constexpr int LargeHeaderSize = 16;
+
+struct Atom {
+    QByteArray type;         // Four character code
+    qint64 offset = 0;       // Position of the size field
+    int headerSize = 0;      // HeaderSize or LargeHeaderSize
+    qint64 size = 0;         // Total size, header included
+
+    qint64 dataOffset() const { return offset + headerSize; }
+    qint64 endOffset() const { return offset + size; }
+};
+
+// Parse the atom header at pos in data, the atom must end before end.
+// A size of 0 ("extends to the end") is resolved against end.
+bool parseAtomHeader(const QByteArray& data, qint64 pos, qint64 end, Atom& atom);
+
+// Read and parse the atom header at offset in device
+bool readAtomHeader(QIODevice *device, qint64 offset, qint64 end, Atom& atom);
+
+// Offset of the first child, "meta" has 4 bytes of version/flags in front of its children
+qint64 childrenOffset(const Atom& atom);
+
+// Direct children of parent, parent.offset is relative to data. Returns false on malformed atoms.
+bool childAtoms(const QByteArray& data, const Atom& parent, QList<Atom>& children);
+bool findChild(const QByteArray& data, const Atom& parent, const char *type, Atom& child);
+
+quint32 readUInt32(const QByteArray& data, qint64 pos);
+quint64 readUInt64(const QByteArray& data, qint64 pos);
+void writeUInt32(QByteArray& data, qint64 pos, quint32 value);
+void writeUInt64(QByteArray& data, qint64 pos, quint64 value);
+QByteArray encodeUInt32(quint32 value);
+
+QByteArray renderAtom(const char *type, const QByteArray& payload);
+// ilst item with a single data atom, e.g. dataItem("\xA9nam", Utf8DataType, title)
+QByteArray dataItem(const char *type, quint32 dataType, const QByteArray& value);
+QByteArray textItem(const char *type, const QString& value);
+// "----" item, identified by mean and name instead of its type
+QByteArray freeformItem(const QByteArray& mean, const QByteArray& name, const QString& value);
+// What identifies an item in the ilst: its type, or "----:mean:name" for freeform items
+QByteArray itemKey(const QByteArray& data, const Atom& item);
+
+// "free" atom spanning totalSize bytes (at least HeaderSize), zero filled
+QByteArray freeAtom(qint64 totalSize);
+// Header of a "free" atom spanning totalSize bytes. Only the header needs to be
+// written, the previous content of the region becomes the padding.
+QByteArray freeHeader(qint64 totalSize);
+
+} // namespace Mp4
+
+#endif // MP4ATOMS_H
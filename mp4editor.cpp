@@ -0,0 +1,597 @@
+#include "mp4editor.h"
+#include "writejournal.h"
+#include "bufferpool.h"
+#include <QPair>
+#include <algorithm>
+
+// moov and moof atoms are read into memory, refuse anything unreasonably large
+static const qint64 MAX_MOOV_SIZE = 256 * 1024 * 1024;
+
+// Padding reserved behind the ilst whenever moov has to grow, so the next cover fits in place
+static const qint64 PADDING_SIZE = 256 * 1024;
+
+// Block size used to move the data behind moov
+static const qint64 COPY_BUFFER_SIZE = 4 * 1024 * 1024;
+
+Mp4Editor::Mp4Editor(const QString& filePath)
+    : m_filePath(filePath)
+    , m_file(filePath)
+{
+}
+
+void Mp4Editor::setCover(const QByteArray& imageData, quint32 dataType)
+{
+    m_coverData = imageData;
+    m_coverDataType = dataType;
+}
+
+void Mp4Editor::setTextItem(const char *type, const QString& value)
+{
+    m_items.append(Mp4::textItem(type, value));
+}
+
+void Mp4Editor::setFreeformItem(const QByteArray& name, const QString& value)
+{
+    m_items.append(Mp4::freeformItem(Mp4::ItunesMean, name, value));
+}
+
+void Mp4Editor::removeItem(const QByteArray& key)
+{
+    m_removedKeys.append(key);
+}
+
+void Mp4Editor::setJournal(WriteJournal *journal)
+{
+    m_journal = journal;
+}
+
+QString Mp4Editor::errorString() const
+{
+    return m_errorString;
+}
+
+Mp4Editor::SaveMode Mp4Editor::saveMode() const
+{
+    return m_saveMode;
+}
+
+qint64 Mp4Editor::bytesWritten() const
+{
+    return m_bytesWritten;
+}
+
+qint64 Mp4Editor::bytesMoved() const
+{
+    return m_bytesMoved;
+}
+
+bool Mp4Editor::fail(const QString& message)
+{
+    m_errorString = message;
+    return false;
+}
+
+bool Mp4Editor::save()
+{
+    m_errorString.clear();
+    m_saveMode = SaveMode::InPlace;
+    m_bytesWritten = 0;
+    m_bytesMoved = 0;
+    m_hasFreeAfterMoov = false;
+    m_parents.clear();
+    m_hasIlst = false;
+    m_moofs.clear();
+    m_mfras.clear();
+
+    if (m_coverData.isEmpty()) {
+        return fail("No cover to write");
+    }
+
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        return fail(QString("Can't open file: %1").arg(m_file.errorString()));
+    }
+
+    if (m_journal && !m_journal->begin(m_file.size())) {
+        m_file.close();
+        return fail(m_journal->errorString());
+    }
+
+    bool ok = apply() && finish();
+    if (ok) {
+        m_file.close();
+        return true;
+    }
+
+    if (m_errorString.isEmpty()) {
+        m_errorString = m_file.errorString();
+    }
+    m_file.close();
+    return false;
+}
+
+bool Mp4Editor::parseLayout()
+{
+    m_fileSize = m_file.size();
+
+    // Walk the top level atoms, only their headers are read (mdat is never touched)
+    bool hasMoov = false;
+    qint64 pos = 0;
+    while (pos < m_fileSize) {
+        Mp4::Atom atom;
+        if (!Mp4::readAtomHeader(&m_file, pos, m_fileSize, atom)) {
+            if (hasMoov) {
+                break;  // Trailing garbage behind moov is left alone
+            }
+            return fail(QString("Invalid MP4 atom at offset %1").arg(pos));
+        }
+
+        if (atom.type == "moov" && !hasMoov) {
+            hasMoov = true;
+            m_moov = atom;
+        } else if (hasMoov && atom.offset == m_moov.endOffset() && (atom.type == "free" || atom.type == "skip")) {
+            m_hasFreeAfterMoov = true;
+            m_freeAfterMoov = atom;
+        } else if (hasMoov && atom.type == "moof") {
+            // Fragments carry absolute offsets in their tfhd
+            m_moofs.append(atom);
+        } else if (hasMoov && atom.type == "mfra") {
+            // The fragment random access index points at each moof by absolute offset
+            m_mfras.append(atom);
+        }
+
+        pos = atom.endOffset();
+    }
+
+    if (!hasMoov) {
+        return fail("Missing moov atom");
+    }
+    if (m_moov.size > MAX_MOOV_SIZE) {
+        return fail("moov atom too large");
+    }
+
+    if (!m_file.seek(m_moov.offset)) {
+        return fail("Can't read moov atom");
+    }
+    m_moovData = m_file.read(m_moov.size);
+    if (m_moovData.size() != m_moov.size) {
+        return fail("Truncated moov atom");
+    }
+
+    // Follow moov/udta/meta/ilst as far as it exists, atoms below are relative to m_moovData
+    Mp4::Atom moov = m_moov;
+    moov.offset = 0;
+    m_parents.append(moov);
+
+    const char *path[] = {"udta", "meta", "ilst"};
+    for (const char *type : path) {
+        QList<Mp4::Atom> children;
+        if (!Mp4::childAtoms(m_moovData, m_parents.last(), children)) {
+            return fail(QString("Invalid %1 atom").arg(QString::fromLatin1(m_parents.last().type)));
+        }
+
+        bool found = false;
+        for (qsizetype i = 0; i < children.size() && !found; ++i) {
+            const Mp4::Atom& child = children.at(i);
+            if (child.type != type) {
+                continue;
+            }
+            found = true;
+
+            if (child.type == "ilst") {
+                m_hasIlst = true;
+                m_ilst = child;
+
+                // The ilst can grow into the free atoms right behind it
+                m_regionOffset = child.offset;
+                m_regionSize = child.size;
+                for (qsizetype j = i + 1; j < children.size(); ++j) {
+                    if (children.at(j).type != "free" && children.at(j).type != "skip") {
+                        break;
+                    }
+                    m_regionSize += children.at(j).size;
+                }
+            } else if (child.type == "meta" && child.size < Mp4::HeaderSize + 4) {
+                return fail("Invalid meta atom");
+            } else {
+                m_parents.append(child);
+            }
+        }
+
+        if (!found) {
+            break;
+        }
+    }
+
+    if (m_hasIlst) {
+        QList<Mp4::Atom> items;
+        if (!Mp4::childAtoms(m_moovData, m_ilst, items)) {
+            return fail("Invalid ilst atom");
+        }
+    } else {
+        // New atoms are added at the end of the deepest existing parent
+        m_regionOffset = m_parents.last().endOffset();
+        m_regionSize = 0;
+    }
+
+    return true;
+}
+
+QByteArray Mp4Editor::buildIlst() const
+{
+    // New items by key, set later wins
+    QList<QPair<QByteArray, QByteArray>> replacements;
+    replacements.append(qMakePair(QByteArray("covr"), Mp4::dataItem("covr", m_coverDataType, m_coverData)));
+    for (const QByteArray& item : m_items) {
+        Mp4::Atom atom;
+        Mp4::parseAtomHeader(item, 0, item.size(), atom);
+        QByteArray key = Mp4::itemKey(item, atom);
+        replacements.erase(std::remove_if(replacements.begin(), replacements.end(),
+                                          [&key](const QPair<QByteArray, QByteArray>& r) { return r.first == key; }),
+                           replacements.end());
+        replacements.append(qMakePair(key, item));
+    }
+
+    // Keep all other items as they are unless removed, a new item replaces the old one at
+    // the same position
+    QList<Mp4::Atom> items;
+    if (m_hasIlst) {
+        Mp4::childAtoms(m_moovData, m_ilst, items);
+    }
+
+    QByteArray payload;
+    QList<bool> written(replacements.size(), false);
+    for (const Mp4::Atom& item : std::as_const(items)) {
+        QByteArray key = Mp4::itemKey(m_moovData, item);
+        qsizetype index = -1;
+        for (qsizetype i = 0; i < replacements.size() && index < 0; ++i) {
+            if (replacements.at(i).first == key) {
+                index = i;
+            }
+        }
+
+        if (index < 0) {
+            if (!m_removedKeys.contains(key)) {
+                payload += m_moovData.mid(item.offset, item.size);
+            }
+        } else if (!written.at(index)) {
+            payload += replacements.at(index).second;
+            written[index] = true;
+        }
+    }
+    for (qsizetype i = 0; i < replacements.size(); ++i) {
+        if (!written.at(i)) {
+            payload += replacements.at(i).second;
+        }
+    }
+
+    return Mp4::renderAtom("ilst", payload);
+}
+
+QByteArray Mp4Editor::buildContent(const QByteArray& ilst, qint64 contentSize) const
+{
+    // The ilst followed by a free atom filling up the rest of contentSize
+    QByteArray content = ilst;
+    qint64 padding = contentSize - wrapperSize() - ilst.size();
+    if (padding > 0) {
+        content += Mp4::freeAtom(padding);
+    }
+
+    // Create the missing parents, meta needs the iTunes metadata handler
+    if (m_parents.size() < 3) {
+        QByteArray hdlr = Mp4::renderAtom("hdlr", QByteArray(8, '\0') + QByteArray("mdirappl") + QByteArray(9, '\0'));
+        content = Mp4::renderAtom("meta", QByteArray(4, '\0') + hdlr + content);
+    }
+    if (m_parents.size() < 2) {
+        content = Mp4::renderAtom("udta", content);
+    }
+    return content;
+}
+
+qint64 Mp4Editor::wrapperSize() const
+{
+    // Headers of the udta/meta atoms that have to be created around the ilst
+    qint64 size = 0;
+    if (m_parents.size() < 3) {
+        size += Mp4::HeaderSize + 4 + Mp4::HeaderSize + 25;  // meta + hdlr
+    }
+    if (m_parents.size() < 2) {
+        size += Mp4::HeaderSize;  // udta
+    }
+    return size;
+}
+
+bool Mp4Editor::fits(qint64 available, qint64 needed)
+{
+    // Any leftover must be able to hold a free atom (at least 8 bytes)
+    return available == needed || available >= needed + Mp4::HeaderSize;
+}
+
+bool Mp4Editor::apply()
+{
+    if (!parseLayout()) {
+        return false;
+    }
+
+    QByteArray ilst = buildIlst();
+    qint64 moovEnd = m_moov.endOffset();
+    qint64 regionEnd = m_regionOffset + m_regionSize;
+
+    // Step 1: The new ilst fits into the old one and its padding, nothing else changes
+    if (m_hasIlst && fits(m_regionSize, ilst.size())) {
+        m_saveMode = SaveMode::InPlace;
+        qint64 padding = m_regionSize - ilst.size();
+        return writeAt(m_moov.offset + m_regionOffset, padding > 0 ? ilst + Mp4::freeHeader(padding) : ilst);
+    }
+
+    // Step 2: moov has to grow, reserve padding so the next cover fits in place
+    qint64 wrapper = wrapperSize();
+    qint64 contentSize = wrapper + ilst.size() + PADDING_SIZE;
+    bool shiftFollowing = false;
+    if (m_hasFreeAfterMoov && fits(m_regionSize + m_freeAfterMoov.size - wrapper, ilst.size())) {
+        // Take over the free atom behind moov as padding, the data behind it stays put
+        contentSize = m_regionSize + m_freeAfterMoov.size;
+    } else if (moovEnd < m_fileSize) {
+        // Everything behind moov (usually mdat) is moved, the expensive case
+        shiftFollowing = true;
+    }
+    if (shiftFollowing && m_journal) {
+        return fail("Moving the media data can't be journaled");
+    }
+    qint64 delta = contentSize - m_regionSize;
+
+    // Step 3: Build the new moov and fragment headers, all validation happens before writing
+    QByteArray moov = m_moovData;
+    QList<QPair<qint64, QByteArray>> fragmentHeaders;
+    if (shiftFollowing) {
+        if (!updateChunkOffsets(moov, m_parents.first(), moovEnd, delta)) {
+            return false;
+        }
+
+        for (const Mp4::Atom& atom : std::as_const(m_moofs)) {
+            if (atom.size > MAX_MOOV_SIZE || !m_file.seek(atom.offset)) {
+                return fail("Can't read moof atom");
+            }
+            QByteArray moof = m_file.read(atom.size);
+            if (moof.size() != atom.size) {
+                return fail("Truncated moof atom");
+            }
+            Mp4::Atom root = atom;
+            root.offset = 0;
+            if (!updateFragmentOffsets(moof, root, moovEnd, delta)) {
+                return false;
+            }
+            fragmentHeaders.append(qMakePair(atom.offset + delta, moof));
+        }
+
+        for (const Mp4::Atom& atom : std::as_const(m_mfras)) {
+            if (atom.size > MAX_MOOV_SIZE || !m_file.seek(atom.offset)) {
+                return fail("Can't read mfra atom");
+            }
+            QByteArray mfra = m_file.read(atom.size);
+            if (mfra.size() != atom.size) {
+                return fail("Truncated mfra atom");
+            }
+            Mp4::Atom root = atom;
+            root.offset = 0;
+            if (!updateRandomAccessOffsets(mfra, root, moovEnd, delta)) {
+                return false;
+            }
+            fragmentHeaders.append(qMakePair(atom.offset + delta, mfra));
+        }
+    }
+    if (!updateParentSizes(moov, delta)) {
+        return false;
+    }
+    moov = moov.left(m_regionOffset) + buildContent(ilst, contentSize) + moov.mid(regionEnd);
+
+    // Step 4: Write the moved data, then moov and the fragment headers. This isn't crash
+    // safe: until moov is written its chunk offsets point at the old, now shifted
+    // positions, and a crash in between leaves the file corrupt. Only the clone used
+    // by MediaTagWriter's safe writes protects against that.
+    m_saveMode = SaveMode::Rewrite;
+    m_bytesMoved = m_moov.size - regionEnd;
+    if (shiftFollowing) {
+        m_bytesMoved += m_fileSize - moovEnd;
+        if (!shiftTail(moovEnd, delta)) {
+            return false;
+        }
+    }
+
+    if (!writeAt(m_moov.offset, moov)) {
+        return false;
+    }
+
+    for (const auto& header : std::as_const(fragmentHeaders)) {
+        if (!writeAt(header.first, header.second)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool Mp4Editor::updateParentSizes(QByteArray& moov, qint64 delta)
+{
+    for (const Mp4::Atom& parent : std::as_const(m_parents)) {
+        qint64 size = parent.size + delta;
+        if (parent.headerSize == Mp4::LargeHeaderSize) {
+            Mp4::writeUInt64(moov, parent.offset + Mp4::HeaderSize, static_cast<quint64>(size));
+        } else if (Mp4::readUInt32(moov, parent.offset) == 0) {
+            continue;  // "Extends to the end" stays valid
+        } else if (size > 0xFFFFFFFFLL) {
+            return fail(QString("%1 atom too large for a 32-bit size").arg(QString::fromLatin1(parent.type)));
+        } else {
+            Mp4::writeUInt32(moov, parent.offset, static_cast<quint32>(size));
+        }
+    }
+    return true;
+}
+
+bool Mp4Editor::updateChunkOffsets(QByteArray& moov, const Mp4::Atom& parent, qint64 from, qint64 delta)
+{
+    QList<Mp4::Atom> children;
+    if (!Mp4::childAtoms(moov, parent, children)) {
+        return fail(QString("Invalid %1 atom").arg(QString::fromLatin1(parent.type)));
+    }
+
+    for (const Mp4::Atom& child : std::as_const(children)) {
+        if (child.type == "trak" || child.type == "mdia" || child.type == "minf" || child.type == "stbl") {
+            if (!updateChunkOffsets(moov, child, from, delta)) {
+                return false;
+            }
+            continue;
+        }
+
+        bool isStco = child.type == "stco";
+        if (!isStco && child.type != "co64") {
+            continue;
+        }
+
+        // version/flags, entry count, then 32-bit (stco) or 64-bit (co64) absolute offsets
+        int entrySize = isStco ? 4 : 8;
+        qint64 pos = child.dataOffset() + 8;
+        if (pos > child.endOffset()) {
+            return fail("Invalid chunk offset table");
+        }
+        qint64 count = Mp4::readUInt32(moov, child.dataOffset() + 4);
+        if (pos + count * entrySize > child.endOffset()) {
+            return fail("Invalid chunk offset table");
+        }
+
+        for (qint64 i = 0; i < count; ++i, pos += entrySize) {
+            quint64 offset = isStco ? Mp4::readUInt32(moov, pos) : Mp4::readUInt64(moov, pos);
+            if (offset < static_cast<quint64>(from)) {
+                continue;
+            }
+            offset += static_cast<quint64>(delta);
+            if (isStco) {
+                if (offset > 0xFFFFFFFFULL) {
+                    return fail("Chunk offsets would exceed 32 bits");
+                }
+                Mp4::writeUInt32(moov, pos, static_cast<quint32>(offset));
+            } else {
+                Mp4::writeUInt64(moov, pos, offset);
+            }
+        }
+    }
+    return true;
+}
+
+bool Mp4Editor::updateFragmentOffsets(QByteArray& moof, const Mp4::Atom& parent, qint64 from, qint64 delta)
+{
+    QList<Mp4::Atom> children;
+    if (!Mp4::childAtoms(moof, parent, children)) {
+        return fail("Invalid moof atom");
+    }
+
+    for (const Mp4::Atom& child : std::as_const(children)) {
+        if (child.type == "traf") {
+            if (!updateFragmentOffsets(moof, child, from, delta)) {
+                return false;
+            }
+        } else if (child.type == "tfhd" && child.size >= Mp4::HeaderSize + 16) {
+            // version/flags, track ID, then base_data_offset if flag 0x1 is set
+            quint32 flags = Mp4::readUInt32(moof, child.dataOffset()) & 0xFFFFFF;
+            qint64 pos = child.dataOffset() + 8;
+            quint64 offset = Mp4::readUInt64(moof, pos);
+            if ((flags & 0x1) && offset >= static_cast<quint64>(from)) {
+                Mp4::writeUInt64(moof, pos, offset + static_cast<quint64>(delta));
+            }
+        }
+    }
+    return true;
+}
+
+bool Mp4Editor::updateRandomAccessOffsets(QByteArray& mfra, const Mp4::Atom& parent, qint64 from, qint64 delta)
+{
+    QList<Mp4::Atom> children;
+    if (!Mp4::childAtoms(mfra, parent, children)) {
+        return fail("Invalid mfra atom");
+    }
+
+    for (const Mp4::Atom& child : std::as_const(children)) {
+        if (child.type != "tfra") {
+            continue;
+        }
+
+        // version/flags, track ID, field sizes, entry count, then per entry the time and
+        // moof offset (32-bit, 64-bit in version 1) and the traf/trun/sample numbers
+        if (child.size < Mp4::HeaderSize + 16) {
+            return fail("Invalid tfra atom");
+        }
+        bool isVersion1 = static_cast<quint8>(mfra.at(child.dataOffset())) == 1;
+        quint32 sizes = Mp4::readUInt32(mfra, child.dataOffset() + 8);
+        int fieldSize = isVersion1 ? 8 : 4;
+        int entrySize = 2 * fieldSize + ((sizes >> 4) & 0x3) + ((sizes >> 2) & 0x3) + (sizes & 0x3) + 3;
+        qint64 count = Mp4::readUInt32(mfra, child.dataOffset() + 12);
+        qint64 pos = child.dataOffset() + 16;
+        if (pos + count * entrySize > child.endOffset()) {
+            return fail("Invalid tfra atom");
+        }
+
+        for (qint64 i = 0; i < count; ++i, pos += entrySize) {
+            qint64 offsetPos = pos + fieldSize;
+            quint64 offset = isVersion1 ? Mp4::readUInt64(mfra, offsetPos) : Mp4::readUInt32(mfra, offsetPos);
+            if (offset < static_cast<quint64>(from)) {
+                continue;
+            }
+            offset += static_cast<quint64>(delta);
+            if (isVersion1) {
+                Mp4::writeUInt64(mfra, offsetPos, offset);
+            } else if (offset > 0xFFFFFFFFULL) {
+                return fail("Fragment offsets would exceed 32 bits");
+            } else {
+                Mp4::writeUInt32(mfra, offsetPos, static_cast<quint32>(offset));
+            }
+        }
+    }
+    return true;
+}
+
+bool Mp4Editor::shiftTail(qint64 from, qint64 delta)
+{
+    // Copy back to front, the destination overlaps the source. One pooled buffer for
+    // every chunk, a multi-GB move would otherwise allocate thousands of them.
+    BufferPool::Buffer buffer(COPY_BUFFER_SIZE);
+    qint64 pos = m_fileSize;
+    while (pos > from) {
+        qint64 length = qMin(COPY_BUFFER_SIZE, pos - from);
+        pos -= length;
+
+        if (!m_file.seek(pos)) {
+            return fail(QString("Read failed: %1").arg(m_file.errorString()));
+        }
+        if (m_file.read(buffer.data(), length) != length) {
+            return fail("Short read while moving data");
+        }
+        if (!writeAt(pos + delta, QByteArray::fromRawData(buffer.data(), length))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Mp4Editor::finish()
+{
+    // Journaled writes are only final once the file is synced and the journal is gone
+    if (m_journal) {
+        return m_journal->commit(m_file) || fail(m_journal->errorString());
+    }
+    return m_file.flush();
+}
+
+bool Mp4Editor::writeAt(qint64 offset, const QByteArray& data)
+{
+    if (m_journal && !m_journal->saveRegion(m_file, offset, data.size())) {
+        return fail(m_journal->errorString());
+    }
+    if (!m_file.seek(offset)) {
+        return fail(QString("Write failed: %1").arg(m_file.errorString()));
+    }
+    // Counted before writing, a write that fails halfway may still have changed the file
+    m_bytesWritten += data.size();
+    if (m_file.write(data) != data.size()) {
+        return fail(QString("Write failed: %1").arg(m_file.errorString()));
+    }
+    return true;
+}
@@ -0,0 +1,99 @@
+#ifndef MP4EDITOR_H
+#define MP4EDITOR_H
+
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QFile>
+#include "mp4atoms.h"
+
+class WriteJournal;
+
+// Replaces the "covr" item of moov/udta/meta/ilst without rewriting the file when possible.
+// Further items (title, genre, ...) set on the editor are replaced in the same pass.
+//
+// The new ilst reuses the old one plus the "free" atoms behind it. If it doesn't fit,
+// moov grows and a padding budget is reserved inside meta so the next cover fits in
+// place. Growing only moves data when moov isn't the last atom and no "free" atom
+// follows it; chunk offsets (stco/co64/tfhd/tfra) are updated for everything moved.
+// Moving data isn't crash safe, MediaTagWriter's safe writes rewrite a clone instead.
+class Mp4Editor
+{
+public:
+    enum class SaveMode {
+        InPlace,  // Only the ilst and its padding were written
+        Rewrite   // moov grew, data behind the ilst was moved
+    };
+
+    explicit Mp4Editor(const QString& filePath);
+
+    // dataType is Mp4::JpegDataType or Mp4::PngDataType
+    void setCover(const QByteArray& imageData, quint32 dataType);
+
+    // Replace the item of type (e.g. "\xA9nam") with a UTF-8 text
+    void setTextItem(const char *type, const QString& value);
+    // Replace the freeform item com.apple.iTunes:name
+    void setFreeformItem(const QByteArray& name, const QString& value);
+    // Drop the item with this key (e.g. "desc" or "----:com.apple.iTunes:TMDB"), unless
+    // an item with the same key is set as well
+    void removeItem(const QByteArray& key);
+
+    // Save every region to journal before it is overwritten. save() then fails
+    // instead of moving media data, which is too large to journal.
+    void setJournal(WriteJournal *journal);
+
+    bool save();
+
+    QString errorString() const;
+    SaveMode saveMode() const;
+    // Number of bytes written by the last save(), moved data included. After a failed
+    // save(), 0 means the file wasn't changed.
+    qint64 bytesWritten() const;
+    // Number of bytes of existing file content the last save() had to move
+    qint64 bytesMoved() const;
+
+private:
+    bool apply();
+    bool parseLayout();
+    QByteArray buildIlst() const;
+    QByteArray buildContent(const QByteArray& ilst, qint64 contentSize) const;
+    qint64 wrapperSize() const;
+    bool updateParentSizes(QByteArray& moov, qint64 delta);
+    bool updateChunkOffsets(QByteArray& moov, const Mp4::Atom& parent, qint64 from, qint64 delta);
+    bool updateFragmentOffsets(QByteArray& moof, const Mp4::Atom& parent, qint64 from, qint64 delta);
+    bool updateRandomAccessOffsets(QByteArray& mfra, const Mp4::Atom& parent, qint64 from, qint64 delta);
+    bool shiftTail(qint64 from, qint64 delta);
+    static bool fits(qint64 available, qint64 needed);
+    bool writeAt(qint64 offset, const QByteArray& data);
+    bool finish();
+    bool fail(const QString& message);
+
+    QString m_filePath;
+    QFile m_file;
+    QString m_errorString;
+    WriteJournal *m_journal = nullptr;
+    SaveMode m_saveMode = SaveMode::InPlace;
+    qint64 m_bytesWritten = 0;
+    qint64 m_bytesMoved = 0;
+
+    QByteArray m_coverData;
+    quint32 m_coverDataType = Mp4::JpegDataType;
+    QList<QByteArray> m_items;         // Rendered items besides the cover
+    QList<QByteArray> m_removedKeys;   // Existing items to drop
+
+    // Layout of the file, filled by parseLayout(). Atoms below moov are relative to m_moovData.
+    qint64 m_fileSize = 0;
+    Mp4::Atom m_moov;
+    QByteArray m_moovData;             // The whole moov atom, header included
+    bool m_hasFreeAfterMoov = false;
+    Mp4::Atom m_freeAfterMoov;         // Top level "free" atom right behind moov
+    QList<Mp4::Atom> m_parents;        // Existing moov, udta, meta, outermost first
+    bool m_hasIlst = false;
+    Mp4::Atom m_ilst;
+    qint64 m_regionOffset = 0;         // Part of m_moovData replaced by the new content
+    qint64 m_regionSize = 0;
+    QList<Mp4::Atom> m_moofs;          // Top level fragments behind moov
+    QList<Mp4::Atom> m_mfras;          // Top level fragment random access indexes behind moov
+};
+
+#endif // MP4EDITOR_H
@@ -0,0 +1,210 @@
+#include "postercache.h"
+#include "appconfig.h"
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QDateTime>
+#include <QSaveFile>
+#include <QFile>
+#include <QDir>
+#include <QFileInfo>
+#include <QDebug>
+
+// The budgets until setMaxDiskBytes()/setMaxMemoryBytes(), AppConfig's defaults
+// for poster_cache_bytes / poster_memory_cache_bytes
+static const AppConfig& defaultConfig()
+{
+    static const AppConfig config;
+    return config;
+}
+
+PosterCache::PosterCache(const QString& directory)
+    : m_directory(directory)
+    , m_maxDiskBytes(defaultConfig().posterCacheBytes)
+    , m_memory(defaultConfig().posterMemoryCacheBytes)
+{
+}
+
+QString PosterCache::defaultDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + "/MovieTag/posters";
+}
+
+void PosterCache::setDirectory(const QString& directory)
+{
+    m_directory = directory;
+    m_diskOrder.clear();
+    m_diskEntries.clear();
+    m_diskBytes = 0;
+    m_diskIndexLoaded = false;
+}
+
+void PosterCache::setMaxDiskBytes(qint64 bytes)
+{
+    m_maxDiskBytes = qMax<qint64>(0, bytes);
+    if (m_diskIndexLoaded && m_maxDiskBytes > 0) {
+        evictDisk();
+    }
+}
+
+void PosterCache::setMaxMemoryBytes(qint64 bytes)
+{
+    m_memory.setMaxCost(qMax<qint64>(0, bytes));
+}
+
+QString PosterCache::keyFor(const QString& posterPath, const QString& posterSize)
+{
+    // Content address of the poster: the same path and size always map to the same file
+    QByteArray id = (posterSize + posterPath).toUtf8();
+    return QString::fromLatin1(QCryptographicHash::hash(id, QCryptographicHash::Sha1).toHex());
+}
+
+QString PosterCache::filePathFor(const QString& key) const
+{
+    return m_directory + "/" + key;
+}
+
+QByteArray PosterCache::find(const QString& posterPath, const QString& posterSize)
+{
+    QString key = keyFor(posterPath, posterSize);
+
+    // Memory first, object() also marks the entry as recently used
+    if (QByteArray *imageData = m_memory.object(key)) {
+        ++m_memoryHits;
+        return *imageData;
+    }
+
+    // Without a disk budget the directory isn't even indexed, indexing would evict all of it
+    if (m_maxDiskBytes <= 0) {
+        ++m_misses;
+        return QByteArray();
+    }
+
+    loadDiskIndex();
+    if (m_diskEntries.contains(key)) {
+        QFile file(filePathFor(key));
+        if (file.open(QIODevice::ReadOnly)) {
+            QByteArray imageData = file.readAll();
+
+            // The modification time keeps the LRU order across runs
+            file.setFileTime(QDateTime::currentDateTimeUtc(), QFileDevice::FileModificationTime);
+            file.close();
+
+            if (!imageData.isEmpty()) {
+                ++m_diskHits;
+                touchDiskEntry(key);
+                m_memory.insert(key, new QByteArray(imageData), imageData.size());
+                return imageData;
+            }
+        }
+
+        // Removed or truncated behind our back
+        removeDiskEntry(key);
+    }
+
+    ++m_misses;
+    return QByteArray();
+}
+
+void PosterCache::insert(const QString& posterPath, const QString& posterSize, const QByteArray& imageData)
+{
+    if (imageData.isEmpty()) {
+        return;
+    }
+
+    QString key = keyFor(posterPath, posterSize);
+    m_memory.insert(key, new QByteArray(imageData), imageData.size());
+
+    if (m_maxDiskBytes <= 0) {
+        return;
+    }
+
+    loadDiskIndex();
+    if (m_diskEntries.contains(key)) {
+        touchDiskEntry(key);
+        return;
+    }
+
+    // QSaveFile never leaves a partially written poster behind
+    QDir().mkpath(m_directory);
+    QSaveFile file(filePathFor(key));
+    if (!file.open(QIODevice::WriteOnly) || file.write(imageData) != imageData.size() || !file.commit()) {
+        qDebug() << "Failed to write poster cache entry:" << file.errorString();
+        return;
+    }
+
+    addDiskEntry(key, imageData.size());
+    evictDisk();
+}
+
+void PosterCache::loadDiskIndex()
+{
+    if (m_diskIndexLoaded) {
+        return;
+    }
+    m_diskIndexLoaded = true;
+
+    // Oldest first, matching the order of m_diskOrder
+    QDir directory(m_directory);
+    const QFileInfoList files = directory.entryInfoList(QDir::Files, QDir::Time | QDir::Reversed);
+    for (const QFileInfo& fileInfo : files) {
+        addDiskEntry(fileInfo.fileName(), fileInfo.size());
+    }
+
+    evictDisk();
+}
+
+void PosterCache::touchDiskEntry(const QString& key)
+{
+    auto it = m_diskEntries.find(key);
+    if (it == m_diskEntries.end()) {
+        return;
+    }
+    m_diskOrder.splice(m_diskOrder.end(), m_diskOrder, it->order);
+}
+
+void PosterCache::addDiskEntry(const QString& key, qint64 size)
+{
+    m_diskOrder.push_back(key);
+    m_diskEntries.insert(key, DiskEntry{std::prev(m_diskOrder.end()), size});
+    m_diskBytes += size;
+}
+
+void PosterCache::removeDiskEntry(const QString& key)
+{
+    auto it = m_diskEntries.find(key);
+    if (it == m_diskEntries.end()) {
+        return;
+    }
+    m_diskBytes -= it->size;
+    m_diskOrder.erase(it->order);
+    m_diskEntries.erase(it);
+}
+
+void PosterCache::evictDisk()
+{
+    while (m_diskBytes > m_maxDiskBytes && !m_diskOrder.empty()) {
+        QString key = m_diskOrder.front();
+        QFile::remove(filePathFor(key));
+        removeDiskEntry(key);
+    }
+}
+
+qint64 PosterCache::memoryHits() const
+{
+    return m_memoryHits;
+}
+
+qint64 PosterCache::diskHits() const
+{
+    return m_diskHits;
+}
+
+qint64 PosterCache::misses() const
+{
+    return m_misses;
+}
+
+qint64 PosterCache::diskBytes() const
+{
+    return m_diskBytes;
+}
@@ -0,0 +1,68 @@
+#ifndef POSTERCACHE_H
+#define POSTERCACHE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QCache>
+#include <QHash>
+#include <list>
+
+// Two level poster cache: an in-memory LRU in front of a content-addressed
+// directory on disk. Entries are keyed by TMDb poster path and poster size,
+// and both levels evict the least recently used entries above their byte budget.
+class PosterCache
+{
+public:
+    explicit PosterCache(const QString& directory = defaultDirectory());
+
+    // Shared by the GUI and the batch tagger
+    static QString defaultDirectory();
+
+    // Entries already on disk are forgotten, the new directory is indexed on first use
+    void setDirectory(const QString& directory);
+
+    // 0 disables the disk level, nothing on disk is read, written or removed
+    void setMaxDiskBytes(qint64 bytes);
+    void setMaxMemoryBytes(qint64 bytes);
+
+    // Returns the cached image, or an empty array on a miss
+    QByteArray find(const QString& posterPath, const QString& posterSize);
+    void insert(const QString& posterPath, const QString& posterSize, const QByteArray& imageData);
+
+    qint64 memoryHits() const;
+    qint64 diskHits() const;
+    qint64 misses() const;
+    qint64 diskBytes() const;
+
+private:
+    struct DiskEntry {
+        std::list<QString>::iterator order;
+        qint64 size;
+    };
+
+    static QString keyFor(const QString& posterPath, const QString& posterSize);
+    QString filePathFor(const QString& key) const;
+    void loadDiskIndex();
+    void touchDiskEntry(const QString& key);
+    void addDiskEntry(const QString& key, qint64 size);
+    void removeDiskEntry(const QString& key);
+    void evictDisk();
+
+    QString m_directory;
+    qint64 m_maxDiskBytes;
+    qint64 m_diskBytes = 0;
+    bool m_diskIndexLoaded = false;
+
+    // Cost is the image size in bytes, QCache drops the least recently used first
+    QCache<QString, QByteArray> m_memory;
+
+    // Disk entries from least (front) to most (back) recently used
+    std::list<QString> m_diskOrder;
+    QHash<QString, DiskEntry> m_diskEntries;
+
+    qint64 m_memoryHits = 0;
+    qint64 m_diskHits = 0;
+    qint64 m_misses = 0;
+};
+
+#endif // POSTERCACHE_H
@@ -0,0 +1,75 @@
+#include "posterthumbnailer.h"
+#include "metrics.h"
+#include <QBuffer>
+#include <QElapsedTimer>
+#include <QImageReader>
+#include <QThread>
+
+PosterThumbnailer::PosterThumbnailer(const QSize& thumbnailSize, QObject *parent)
+    : QObject(parent)
+    , m_thumbnailSize(thumbnailSize)
+{
+    // Decoding is short, a couple of threads keep up with the network
+    m_pool.setMaxThreadCount(qBound(1, QThread::idealThreadCount() / 2, 4));
+}
+
+PosterThumbnailer::~PosterThumbnailer()
+{
+    // Running jobs emit into this object, they must finish before it goes away
+    cancelAll();
+    m_pool.waitForDone();
+}
+
+void PosterThumbnailer::setMaxThreadCount(int count)
+{
+    m_pool.setMaxThreadCount(qMax(1, count));
+}
+
+void PosterThumbnailer::submit(quint64 id, const QByteArray& imageData)
+{
+    QSize size = m_thumbnailSize;
+    m_pool.start([this, id, imageData, size]() {
+        QElapsedTimer timer;
+        timer.start();
+        QImage thumbnail = decodeThumbnail(imageData, size);
+        Metrics::instance().observeElapsed("poster_decode_seconds", timer);
+        emit thumbnailReady(id, thumbnail);
+    });
+}
+
+void PosterThumbnailer::cancelAll()
+{
+    m_pool.clear();
+}
+
+QImage PosterThumbnailer::decodeThumbnail(const QByteArray& imageData, const QSize& size)
+{
+    QByteArray data = imageData;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadOnly);
+
+    QImageReader reader(&buffer);
+    reader.setAutoTransform(true);
+
+    // Step 1: Ask the decoder for the final size, the JPEG handler then only
+    // decodes a reduced resolution (1/2, 1/4, 1/8) and scales the rest
+    QSize originalSize = reader.size();
+    if (originalSize.isValid()) {
+        QSize scaledSize = originalSize.scaled(size, Qt::KeepAspectRatio);
+        if (scaledSize.width() < originalSize.width()) {
+            reader.setScaledSize(scaledSize);
+        }
+    }
+
+    // Step 2: Decode
+    QImage image = reader.read();
+    if (image.isNull()) {
+        return QImage();
+    }
+
+    // Step 3: Formats without scaled decoding (or unknown size) are scaled here
+    if (image.width() > size.width() || image.height() > size.height()) {
+        image = image.scaled(size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+    return image;
+}
@@ -0,0 +1,42 @@
+#ifndef POSTERTHUMBNAILER_H
+#define POSTERTHUMBNAILER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QImage>
+#include <QSize>
+#include <QThreadPool>
+
+// Decodes downloaded posters to thumbnails on a worker pool, so a burst of
+// posters never stalls the GUI thread. JPEGs are decoded straight at (close to)
+// thumbnail resolution instead of decoding the full image and scaling it down.
+// thumbnailReady is emitted from the worker threads and delivered queued.
+class PosterThumbnailer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PosterThumbnailer(const QSize& thumbnailSize, QObject *parent = nullptr);
+    ~PosterThumbnailer();
+
+    void setMaxThreadCount(int count);
+
+    // Queue imageData for decoding, the result is reported with the same id
+    void submit(quint64 id, const QByteArray& imageData);
+
+    // Drop jobs that have not started yet
+    void cancelAll();
+
+    // Decode imageData to an image fitting into size, null if it isn't a readable image
+    static QImage decodeThumbnail(const QByteArray& imageData, const QSize& size);
+
+signals:
+    // image is null if the data couldn't be decoded
+    void thumbnailReady(quint64 id, const QImage& image);
+
+private:
+    QSize m_thumbnailSize;
+    QThreadPool m_pool;
+};
+
+#endif // POSTERTHUMBNAILER_H
@@ -0,0 +1,145 @@
+#include "reflink.h"
+#include <QFile>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#if defined(Q_OS_LINUX)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <linux/fs.h>
+#elif defined(Q_OS_MACOS)
+#include <unistd.h>
+#include <sys/attr.h>
+#include <sys/clonefile.h>
+#include <sys/stat.h>
+#endif
+
+namespace Reflink {
+
+static bool failWith(QString *errorString, const QString& message)
+{
+    if (errorString) {
+        *errorString = message;
+    }
+    return false;
+}
+
+#if defined(Q_OS_LINUX)
+// Give the clone the owner, permissions and extended attributes (ACLs, SELinux
+// labels, user.* attributes) of the original, it replaces the original later.
+// An owner that can't be kept is an error, the file would silently change hands.
+static bool copyMetadata(int sourceFd, int targetFd, const QString& source, QString *errorString)
+{
+    struct stat sourceStat;
+    struct stat targetStat;
+    if (::fstat(sourceFd, &sourceStat) != 0 || ::fstat(targetFd, &targetStat) != 0) {
+        return failWith(errorString, QString("Can't stat %1: %2").arg(source, QString::fromLocal8Bit(strerror(errno))));
+    }
+
+    // Step 1: Owner first, chown clears the setuid/setgid bits
+    if ((sourceStat.st_uid != targetStat.st_uid || sourceStat.st_gid != targetStat.st_gid)
+        && ::fchown(targetFd, sourceStat.st_uid, sourceStat.st_gid) != 0) {
+        return failWith(errorString, QString("Can't keep the owner of %1: %2").arg(source, QString::fromLocal8Bit(strerror(errno))));
+    }
+
+    // Step 2: Extended attributes where the filesystem and our privileges allow,
+    // trusted.* needs CAP_SYS_ADMIN and not every filesystem stores them
+    ssize_t listSize = ::flistxattr(sourceFd, nullptr, 0);
+    if (listSize > 0) {
+        QByteArray names(listSize, Qt::Uninitialized);
+        listSize = ::flistxattr(sourceFd, names.data(), names.size());
+        for (qsizetype offset = 0; listSize > 0 && offset < listSize;) {
+            const char *name = names.constData() + offset;
+            offset += qstrlen(name) + 1;
+
+            ssize_t valueSize = ::fgetxattr(sourceFd, name, nullptr, 0);
+            if (valueSize < 0) {
+                continue;
+            }
+            QByteArray value(valueSize, Qt::Uninitialized);
+            valueSize = ::fgetxattr(sourceFd, name, value.data(), value.size());
+            if (valueSize >= 0) {
+                ::fsetxattr(targetFd, name, value.constData(), static_cast<size_t>(valueSize), 0);
+            }
+        }
+    }
+
+    // Step 3: Permission bits last, they must match the ACL copied above
+    if (::fchmod(targetFd, sourceStat.st_mode & 07777) != 0) {
+        return failWith(errorString, QString("Can't keep the permissions of %1: %2").arg(source, QString::fromLocal8Bit(strerror(errno))));
+    }
+    return true;
+}
+#endif
+
+bool clone(const QString& source, const QString& target, QString *errorString)
+{
+    QByteArray sourcePath = QFile::encodeName(source);
+    QByteArray targetPath = QFile::encodeName(target);
+
+#if defined(Q_OS_LINUX)
+    int sourceFd = ::open(sourcePath.constData(), O_RDONLY | O_CLOEXEC);
+    if (sourceFd < 0) {
+        return failWith(errorString, QString("Can't open %1: %2").arg(source, QString::fromLocal8Bit(strerror(errno))));
+    }
+    int targetFd = ::open(targetPath.constData(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (targetFd < 0) {
+        int error = errno;
+        ::close(sourceFd);
+        return failWith(errorString, QString("Can't create %1: %2").arg(target, QString::fromLocal8Bit(strerror(error))));
+    }
+
+    // Private until copyMetadata() applies the original's owner and permissions
+    if (!copyMetadata(sourceFd, targetFd, source, errorString)) {
+        ::close(targetFd);
+        ::close(sourceFd);
+        ::unlink(targetPath.constData());
+        return false;
+    }
+
+    // FICLONE shares the extents, EOPNOTSUPP/EXDEV/EINVAL if the filesystem can't
+    bool ok = ::ioctl(targetFd, FICLONE, sourceFd) == 0;
+    int error = errno;
+    ::close(targetFd);
+    ::close(sourceFd);
+    if (!ok) {
+        ::unlink(targetPath.constData());
+        return failWith(errorString, QString("Reflink not supported: %1").arg(QString::fromLocal8Bit(strerror(error))));
+    }
+    return true;
+#elif defined(Q_OS_MACOS)
+    // clonefile() copies the permissions and extended attributes itself, the owner
+    // only with enough privileges; otherwise the clone belongs to us
+    if (::clonefile(sourcePath.constData(), targetPath.constData(), 0) != 0) {
+        return failWith(errorString, QString("Reflink not supported: %1").arg(QString::fromLocal8Bit(strerror(errno))));
+    }
+    struct stat sourceStat;
+    struct stat targetStat;
+    if (::stat(sourcePath.constData(), &sourceStat) != 0 || ::stat(targetPath.constData(), &targetStat) != 0
+        || sourceStat.st_uid != targetStat.st_uid || sourceStat.st_gid != targetStat.st_gid) {
+        ::unlink(targetPath.constData());
+        return failWith(errorString, QString("Can't keep the owner of %1").arg(source));
+    }
+    return true;
+#else
+    Q_UNUSED(sourcePath)
+    Q_UNUSED(targetPath)
+    return failWith(errorString, "Reflink not supported on this platform");
+#endif
+}
+
+bool replace(const QString& source, const QString& target, QString *errorString)
+{
+    // rename() replaces the target atomically on POSIX systems; clone() only
+    // succeeds there, so no other platform ever gets here with a clone
+    if (std::rename(QFile::encodeName(source).constData(), QFile::encodeName(target).constData()) != 0) {
+        return failWith(errorString, QString("Can't replace %1: %2").arg(target, QString::fromLocal8Bit(strerror(errno))));
+    }
+    return true;
+}
+
+} // namespace Reflink
@@ -0,0 +1,21 @@
+#ifndef REFLINK_H
+#define REFLINK_H
+
+#include <QString>
+
+// Copy-on-write file clones. A clone shares all data blocks with its source, so
+// creating one costs no data I/O; only blocks written afterwards are copied.
+// Supported on Btrfs, XFS (reflink=1) and bcachefs on Linux, and APFS on macOS.
+namespace Reflink {
+
+// Clone source to target (which must not exist), false if the filesystem can't.
+// The clone gets the owner, permissions and extended attributes of source, and
+// fails if the owner can't be kept.
+bool clone(const QString& source, const QString& target, QString *errorString = nullptr);
+
+// Atomically replace target with source (same filesystem)
+bool replace(const QString& source, const QString& target, QString *errorString = nullptr);
+
+} // namespace Reflink
+
+#endif // REFLINK_H
@@ -0,0 +1,302 @@
+#include "releasenameparser.h"
+#include <QHash>
+#include <QStringView>
+#include <QVarLengthArray>
+#include <initializer_list>
+
+namespace {
+
+enum class TokenKind {
+    Word,
+    Year,
+    Resolution,
+    Source,
+    Edition,
+    Tag         // Codecs, audio formats and other release flags
+};
+
+struct Keyword {
+    TokenKind kind;
+    QString name;
+    bool ambiguous = false;  // Also an ordinary word, see parse()
+};
+
+// Editions spelled as two tokens, "Directors.Cut" and the like
+struct EditionPhrase {
+    const char *first;
+    const char *second;
+    const char *name;
+};
+
+const EditionPhrase EDITION_PHRASES[] = {
+    { "directors", "cut", "Director's Cut" },
+    { "director's", "cut", "Director's Cut" },
+    { "final", "cut", "Final Cut" },
+    { "extended", "cut", "Extended" },
+    { "extended", "edition", "Extended" },
+    { "theatrical", "cut", "Theatrical" },
+    { "special", "edition", "Special Edition" },
+    { "collectors", "edition", "Collector's Edition" },
+    { "anniversary", "edition", "Anniversary Edition" },
+};
+
+const char *const VIDEO_EXTENSIONS[] = {
+    "mkv", "mp4", "m4v", "avi", "mov", "wmv", "webm", "mpg", "mpeg", "ts", "m2ts"
+};
+
+// Lower case spelling -> classification, built once on first use
+const QHash<QString, Keyword>& keywords()
+{
+    static const QHash<QString, Keyword> table = [] {
+        QHash<QString, Keyword> table;
+        auto add = [&table](TokenKind kind, const char *name, std::initializer_list<const char*> spellings) {
+            for (const char *spelling : spellings) {
+                table.insert(QString::fromLatin1(spelling), Keyword{ kind, QString::fromLatin1(name) });
+            }
+        };
+
+        add(TokenKind::Resolution, "2160p", { "2160p", "4k", "uhd" });
+        add(TokenKind::Resolution, "1080p", { "1080p" });
+        add(TokenKind::Resolution, "1080i", { "1080i" });
+        add(TokenKind::Resolution, "720p", { "720p" });
+        add(TokenKind::Resolution, "576p", { "576p" });
+        add(TokenKind::Resolution, "480p", { "480p" });
+
+        add(TokenKind::Source, "BluRay", { "bluray", "blu-ray", "bdrip", "brrip" });
+        add(TokenKind::Source, "Remux", { "remux", "bdremux" });
+        add(TokenKind::Source, "WEB-DL", { "web-dl", "webdl" });
+        add(TokenKind::Source, "WEBRip", { "webrip", "web-rip" });
+        add(TokenKind::Source, "WEB", { "web" });
+        add(TokenKind::Source, "HDTV", { "hdtv" });
+        add(TokenKind::Source, "HDRip", { "hdrip" });
+        add(TokenKind::Source, "DVDRip", { "dvdrip" });
+        add(TokenKind::Source, "DVD", { "dvd", "dvdr", "dvd5", "dvd9" });
+
+        add(TokenKind::Edition, "Extended", { "extended" });
+        add(TokenKind::Edition, "Unrated", { "unrated" });
+        add(TokenKind::Edition, "Uncut", { "uncut" });
+        add(TokenKind::Edition, "Remastered", { "remastered" });
+        add(TokenKind::Edition, "IMAX", { "imax" });
+        add(TokenKind::Edition, "Theatrical", { "theatrical" });
+        add(TokenKind::Edition, "Criterion", { "criterion" });
+
+        add(TokenKind::Tag, "", { "x264", "x265", "h264", "h265", "hevc", "avc", "xvid", "divx",
+                                  "aac", "ac3", "dts", "dts-hd", "truehd", "atmos", "dd5", "ddp5",
+                                  "10bit", "8bit", "hdr", "hdr10", "dv", "proper", "repack",
+                                  "internal", "limited", "multi", "subbed", "dubbed" });
+
+        // Ordinary words as well ("Charlotte's.Web.2006", "Limited.2020"), only tags once
+        // the name has turned into release flags
+        for (const char *spelling : { "web", "dv", "multi", "limited", "internal" }) {
+            table[QString::fromLatin1(spelling)].ambiguous = true;
+        }
+        return table;
+    }();
+    return table;
+}
+
+bool isSeparator(QChar c)
+{
+    switch (c.unicode()) {
+    case ' ': case '.': case '_': case ',':
+    case '(': case ')': case '[': case ']': case '{': case '}':
+        return true;
+    default:
+        return c.isSpace();
+    }
+}
+
+// File name without directory and video extension
+QStringView releaseName(const QString& filePath)
+{
+    QStringView name(filePath);
+    qsizetype slash = qMax(name.lastIndexOf(u'/'), name.lastIndexOf(u'\\'));
+    name = name.mid(slash + 1);
+
+    // Only known extensions, "Movie.2010" must keep its year
+    qsizetype dot = name.lastIndexOf(u'.');
+    if (dot > 0) {
+        QStringView suffix = name.mid(dot + 1);
+        for (const char *extension : VIDEO_EXTENSIONS) {
+            if (suffix.compare(QLatin1String(extension), Qt::CaseInsensitive) == 0) {
+                return name.left(dot);
+            }
+        }
+    }
+    return name;
+}
+
+int yearValue(QStringView token)
+{
+    if (token.size() != 4) {
+        return 0;
+    }
+    int year = 0;
+    for (QChar c : token) {
+        if (c < u'0' || c > u'9') {
+            return 0;
+        }
+        year = year * 10 + (c.unicode() - '0');
+    }
+    return (year >= 1900 && year <= 2099) ? year : 0;
+}
+
+const Keyword *findKeyword(QStringView token)
+{
+    const QHash<QString, Keyword>& table = keywords();
+    auto it = table.constFind(token.toString().toLower());
+    if (it != table.constEnd()) {
+        return &it.value();
+    }
+
+    // Release group suffix, "x264-GRP" or "WEB-DL-GRP"
+    qsizetype dash = token.lastIndexOf(u'-');
+    if (dash > 0) {
+        it = table.constFind(token.left(dash).toString().toLower());
+        if (it != table.constEnd()) {
+            return &it.value();
+        }
+    }
+    return nullptr;
+}
+
+const EditionPhrase *findEditionPhrase(QStringView first, QStringView second)
+{
+    for (const EditionPhrase& phrase : EDITION_PHRASES) {
+        if (first.compare(QLatin1String(phrase.first), Qt::CaseInsensitive) == 0
+            && second.compare(QLatin1String(phrase.second), Qt::CaseInsensitive) == 0) {
+            return &phrase;
+        }
+    }
+    return nullptr;
+}
+
+} // namespace
+
+ReleaseInfo ReleaseNameParser::parse(const QString& filePath)
+{
+    ReleaseInfo info;
+    QStringView name = releaseName(filePath);
+
+    // Step 1: Split into tokens, dashes standing alone ("Title - 2010") are dropped
+    QVarLengthArray<QStringView, 32> tokens;
+    qsizetype start = -1;
+    for (qsizetype i = 0; i <= name.size(); ++i) {
+        bool atSeparator = i == name.size() || isSeparator(name.at(i));
+        if (!atSeparator) {
+            if (start < 0) {
+                start = i;
+            }
+            continue;
+        }
+        if (start >= 0) {
+            QStringView token = name.mid(start, i - start);
+            if (token.count(u'-') != token.size()) {
+                tokens.append(token);
+            }
+            start = -1;
+        }
+    }
+
+    // Step 2: Classify every token. Ambiguous keywords stay words until a year or an
+    // unambiguous tag (resolution, source, codec) has shown where the title ends.
+    QVarLengthArray<TokenKind, 32> kinds(tokens.size());
+    QVarLengthArray<QString, 32> names(tokens.size());
+    bool pastTitle = false;
+    for (qsizetype i = 0; i < tokens.size(); ++i) {
+        kinds[i] = TokenKind::Word;
+
+        if (i + 1 < tokens.size()) {
+            if (const EditionPhrase *phrase = findEditionPhrase(tokens[i], tokens[i + 1])) {
+                kinds[i] = kinds[i + 1] = TokenKind::Edition;
+                names[i] = QString::fromLatin1(phrase->name);
+                ++i;
+                continue;
+            }
+        }
+
+        if (yearValue(tokens[i]) > 0) {
+            kinds[i] = TokenKind::Year;
+            // A leading number is part of the title ("2001.A.Space.Odyssey")
+            pastTitle = pastTitle || i > 0;
+        } else if (const Keyword *keyword = findKeyword(tokens[i])) {
+            if (keyword->ambiguous && !pastTitle) {
+                continue;
+            }
+            kinds[i] = keyword->kind;
+            names[i] = keyword->name;
+            pastTitle = pastTitle || (!keyword->ambiguous && keyword->kind != TokenKind::Edition);
+        }
+    }
+
+    // Step 3: The title ends at the last year before the first technical tag. Titles
+    // may start with a number ("2001.A.Space.Odyssey.1968"), so the first token is
+    // always part of it.
+    qsizetype tagIndex = tokens.size();
+    for (qsizetype i = 1; i < tokens.size(); ++i) {
+        if (kinds[i] == TokenKind::Resolution || kinds[i] == TokenKind::Source || kinds[i] == TokenKind::Tag) {
+            tagIndex = i;
+            break;
+        }
+    }
+
+    qsizetype titleEnd = -1;
+    for (qsizetype i = tagIndex - 1; i >= 1; --i) {
+        if (kinds[i] == TokenKind::Year) {
+            titleEnd = i;
+            info.year = yearValue(tokens[i]);
+            break;
+        }
+    }
+
+    // Without a year the title also ends at an edition ("Title.Extended.1080p")
+    if (titleEnd < 0) {
+        titleEnd = tagIndex;
+        for (qsizetype i = 1; i < tagIndex; ++i) {
+            if (kinds[i] == TokenKind::Edition) {
+                titleEnd = i;
+                break;
+            }
+        }
+    }
+
+    // Step 4: Title words, first letter capitalized
+    QStringList words;
+    for (qsizetype i = 0; i < titleEnd; ++i) {
+        QString word = tokens[i].toString();
+        word[0] = word.at(0).toUpper();
+        words.append(word);
+    }
+    info.title = words.join(' ');
+
+    // Step 5: Tags after the title, the first resolution and source win
+    for (qsizetype i = titleEnd; i < tokens.size(); ++i) {
+        switch (kinds[i]) {
+        case TokenKind::Resolution:
+            if (info.resolution.isEmpty()) {
+                info.resolution = names[i];
+            }
+            break;
+        case TokenKind::Source:
+            if (info.source.isEmpty()) {
+                info.source = names[i];
+            }
+            break;
+        case TokenKind::Edition:
+            // Second token of a phrase has no name
+            if (!names[i].isEmpty() && !info.editions.contains(names[i])) {
+                info.editions.append(names[i]);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    // Nothing usable, fall back to the plain file name
+    if (info.title.isEmpty()) {
+        info.title = name.toString();
+    }
+
+    return info;
+}
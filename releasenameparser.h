@@ -0,0 +1,25 @@
+#ifndef RELEASENAMEPARSER_H
+#define RELEASENAMEPARSER_H
+
+#include <QString>
+#include <QStringList>
+
+// What a scene-style file name (Movie.Title.2010.Directors.Cut.1080p.BluRay.x264-GRP.mkv) tells about the release
+struct ReleaseInfo {
+    QString title;          // "Movie Title", words capitalized
+    int year = 0;           // 0 if the name has no year
+    QString resolution;     // "1080p", "2160p", ...
+    QString source;         // "BluRay", "WEB-DL", "HDTV", ...
+    QStringList editions;   // "Director's Cut", "Extended", ...
+};
+
+// Splits release names into tokens once and classifies them against static
+// keyword tables, no regular expression is compiled or run per name, so batch
+// scans can call it for every file.
+class ReleaseNameParser
+{
+public:
+    static ReleaseInfo parse(const QString& filePath);
+};
+
+#endif // RELEASENAMEPARSER_H
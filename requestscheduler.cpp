@@ -0,0 +1,190 @@
+#include "requestscheduler.h"
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QDateTime>
+#include <QRandomGenerator>
+#include <cmath>
+
+// First retry delay without Retry-After, doubled on every further attempt
+static const qint64 BASE_RETRY_DELAY_MS = 1000;
+
+// Never wait longer than this for a retry, whatever the server asks for
+static const qint64 MAX_RETRY_DELAY_MS = 60 * 1000;
+
+RequestScheduler::RequestScheduler(QNetworkAccessManager *networkManager, QObject *parent)
+    : QObject(parent)
+    , m_networkManager(networkManager)
+    , m_requestsPerSecond(0)
+    , m_tokens(0)
+    , m_pausedUntil(0)
+    , m_maxInFlight(8)
+    , m_inFlight(0)
+    , m_maxRetries(3)
+    , m_retriedRequests(0)
+{
+    m_dispatchTimer.setSingleShot(true);
+    connect(&m_dispatchTimer, &QTimer::timeout, this, &RequestScheduler::dispatch);
+    m_lastRefill.start();
+}
+
+void RequestScheduler::setRequestsPerSecond(double requestsPerSecond)
+{
+    m_requestsPerSecond = requestsPerSecond;
+    // Allow a burst of up to one second worth of requests
+    m_tokens = qMax(1.0, requestsPerSecond);
+    m_lastRefill.restart();
+    scheduleDispatch(0);
+}
+
+void RequestScheduler::setMaxInFlight(int count)
+{
+    m_maxInFlight = qMax(1, count);
+    scheduleDispatch(0);
+}
+
+void RequestScheduler::setMaxRetries(int count)
+{
+    m_maxRetries = qMax(0, count);
+}
+
+int RequestScheduler::retriedRequests() const
+{
+    return m_retriedRequests;
+}
+
+void RequestScheduler::get(const QNetworkRequest& request, Priority priority, ReplyHandler handler,
+                           DataHandler dataHandler)
+{
+    PendingRequest pending;
+    pending.request = request;
+    pending.priority = priority;
+    pending.handler = handler;
+    pending.dataHandler = dataHandler;
+
+    if (priority == Priority::High) {
+        m_highPriority.enqueue(pending);
+    } else {
+        m_lowPriority.enqueue(pending);
+    }
+    dispatch();
+}
+
+void RequestScheduler::scheduleDispatch(qint64 delayMs)
+{
+    // Keep the earliest pending wake up
+    qint64 delay = qMax<qint64>(0, delayMs);
+    if (m_dispatchTimer.isActive() && m_dispatchTimer.remainingTime() <= delay) {
+        return;
+    }
+    m_dispatchTimer.start(static_cast<int>(delay));
+}
+
+void RequestScheduler::refillTokens()
+{
+    if (m_requestsPerSecond <= 0) {
+        return;
+    }
+
+    double elapsed = m_lastRefill.restart() / 1000.0;
+    m_tokens = qMin(qMax(1.0, m_requestsPerSecond), m_tokens + elapsed * m_requestsPerSecond);
+}
+
+void RequestScheduler::dispatch()
+{
+    refillTokens();
+
+    while (m_inFlight < m_maxInFlight && (!m_highPriority.isEmpty() || !m_lowPriority.isEmpty())) {
+        // The server asked us to back off, nothing is sent until then
+        if (!m_pausedUntil.hasExpired()) {
+            scheduleDispatch(m_pausedUntil.remainingTime());
+            return;
+        }
+
+        if (m_requestsPerSecond > 0) {
+            if (m_tokens < 1.0) {
+                qint64 waitMs = static_cast<qint64>(std::ceil((1.0 - m_tokens) * 1000.0 / m_requestsPerSecond));
+                scheduleDispatch(waitMs);
+                return;
+            }
+            m_tokens -= 1.0;
+        }
+
+        // Searches first, the user (or the batch pipeline) is waiting for them
+        PendingRequest pending = !m_highPriority.isEmpty() ? m_highPriority.dequeue() : m_lowPriority.dequeue();
+        send(pending);
+    }
+}
+
+void RequestScheduler::send(const PendingRequest& pending)
+{
+    ++m_inFlight;
+    QNetworkReply *reply = m_networkManager->get(pending.request);
+
+    // Bodies of 429/5xx replies that will be retried never reach the data handler
+    if (pending.dataHandler) {
+        connect(reply, &QNetworkReply::readyRead, this, [dataHandler = pending.dataHandler, reply]() {
+            int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+            if (status >= 200 && status < 300) {
+                dataHandler(reply);
+            }
+        });
+    }
+
+    connect(reply, &QNetworkReply::finished, this, [this, pending, reply]() {
+        onFinished(pending, reply);
+    });
+}
+
+void RequestScheduler::onFinished(PendingRequest pending, QNetworkReply *reply)
+{
+    --m_inFlight;
+
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    bool retryable = status == 429 || (status >= 500 && status < 600);
+
+    if (retryable && pending.attempt < m_maxRetries) {
+        qint64 delay = retryDelay(reply, pending.attempt);
+        ++pending.attempt;
+        ++m_retriedRequests;
+
+        // Rate limited: hold back everything, not just this request
+        if (status == 429) {
+            m_pausedUntil = QDeadlineTimer(delay);
+        }
+
+        QTimer::singleShot(static_cast<int>(delay), this, [this, pending]() {
+            // Retries go ahead of new requests of the same priority
+            if (pending.priority == Priority::High) {
+                m_highPriority.prepend(pending);
+            } else {
+                m_lowPriority.prepend(pending);
+            }
+            dispatch();
+        });
+    } else {
+        pending.handler(reply);
+    }
+
+    reply->deleteLater();
+    dispatch();
+}
+
+qint64 RequestScheduler::retryDelay(QNetworkReply *reply, int attempt) const
+{
+    // Retry-After is either a number of seconds or an HTTP date
+    QByteArray retryAfter = reply->rawHeader("Retry-After").trimmed();
+    if (!retryAfter.isEmpty()) {
+        bool ok = false;
+        qint64 seconds = retryAfter.toLongLong(&ok);
+        qint64 delay = ok ? seconds * 1000
+                          : QDateTime::currentDateTimeUtc().msecsTo(
+                                QDateTime::fromString(QString::fromLatin1(retryAfter), Qt::RFC2822Date));
+        if (ok || delay > 0) {
+            return qBound<qint64>(0, delay, MAX_RETRY_DELAY_MS);
+        }
+    }
+
+    // Exponential backoff with jitter, so parallel retries don't arrive together
+    qint64 delay = qMin(MAX_RETRY_DELAY_MS, BASE_RETRY_DELAY_MS << qMin(attempt, 6));
+    return delay / 2 + QRandomGenerator::global()->bounded(delay / 2 + 1);
+}
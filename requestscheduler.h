@@ -0,0 +1,79 @@
+#ifndef REQUESTSCHEDULER_H
+#define REQUESTSCHEDULER_H
+
+#include <QObject>
+#include <QNetworkRequest>
+#include <QQueue>
+#include <QElapsedTimer>
+#include <QDeadlineTimer>
+#include <QTimer>
+#include <functional>
+
+class QNetworkAccessManager;
+class QNetworkReply;
+
+// Throttles GET requests to a token bucket of requestsPerSecond with at most
+// maxInFlight requests running. High priority requests (searches) are always
+// sent before low priority ones (poster downloads). Replies with HTTP 429 or 5xx
+// are retried with exponential backoff, or after the server's Retry-After.
+class RequestScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum class Priority {
+        High,
+        Low
+    };
+
+    // Called once with the final reply, which is deleted after the handler returns
+    using ReplyHandler = std::function<void(QNetworkReply* reply)>;
+    // Called on readyRead of successful (2xx) replies, to consume the body as it arrives
+    using DataHandler = std::function<void(QNetworkReply* reply)>;
+
+    explicit RequestScheduler(QNetworkAccessManager *networkManager, QObject *parent = nullptr);
+
+    // 0 or less disables the rate limit
+    void setRequestsPerSecond(double requestsPerSecond);
+    void setMaxInFlight(int count);
+    void setMaxRetries(int count);
+
+    void get(const QNetworkRequest& request, Priority priority, ReplyHandler handler,
+             DataHandler dataHandler = nullptr);
+
+    // Number of requests that were sent again after a 429/5xx
+    int retriedRequests() const;
+
+private:
+    struct PendingRequest {
+        QNetworkRequest request;
+        Priority priority;
+        ReplyHandler handler;
+        DataHandler dataHandler;
+        int attempt = 0;
+    };
+
+    void scheduleDispatch(qint64 delayMs);
+    void dispatch();
+    void refillTokens();
+    void send(const PendingRequest& pending);
+    void onFinished(PendingRequest pending, QNetworkReply *reply);
+    qint64 retryDelay(QNetworkReply *reply, int attempt) const;
+
+    QNetworkAccessManager *m_networkManager;
+    QQueue<PendingRequest> m_highPriority;
+    QQueue<PendingRequest> m_lowPriority;
+    QTimer m_dispatchTimer;
+
+    double m_requestsPerSecond;
+    double m_tokens;
+    QElapsedTimer m_lastRefill;
+    QDeadlineTimer m_pausedUntil;  // Set by Retry-After, holds back all requests
+
+    int m_maxInFlight;
+    int m_inFlight;
+    int m_maxRetries;
+    int m_retriedRequests;
+};
+
+#endif // REQUESTSCHEDULER_H
@@ -0,0 +1,96 @@
+#include "reviewqueue.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QStandardPaths>
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+
+// Candidates listed per file, the rest of a search is rarely the right one
+static const int MAX_LISTED_CANDIDATES = 5;
+
+ReviewQueue::ReviewQueue(const QString& filePath)
+    : m_filePath(filePath.isEmpty() ? defaultFilePath() : filePath)
+{
+    // Read the files already listed, so that a file which stays ambiguous
+    // isn't appended again on every run. A missing queue is simply empty.
+    QFile file(m_filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+    while (!file.atEnd()) {
+        QJsonObject entry = QJsonDocument::fromJson(file.readLine()).object();
+        QString listedFile = entry.value("file").toString();
+        if (!listedFile.isEmpty()) {
+            m_listedFiles.insert(listedFile);
+        }
+    }
+}
+
+QString ReviewQueue::defaultFilePath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) + "/MovieTag/review-queue.jsonl";
+}
+
+QString ReviewQueue::filePath() const
+{
+    return m_filePath;
+}
+
+bool ReviewQueue::contains(const QString& mediaFilePath) const
+{
+    return m_listedFiles.contains(mediaFilePath);
+}
+
+QString ReviewQueue::errorString() const
+{
+    return m_errorString;
+}
+
+bool ReviewQueue::append(const QString& mediaFilePath, const QString& title, int year, int runtimeMinutes,
+                         const MovieMatcher::Match& match)
+{
+    if (contains(mediaFilePath)) {
+        return true;
+    }
+
+    QJsonObject entry;
+    entry.insert("time", QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+    entry.insert("file", mediaFilePath);
+    entry.insert("title", title);
+    entry.insert("year", year);
+    entry.insert("runtime", runtimeMinutes);
+    entry.insert("reason", match.reason);
+
+    QJsonArray candidates;
+    for (const MovieMatcher::Candidate& candidate : match.candidates) {
+        if (candidates.size() == MAX_LISTED_CANDIDATES) {
+            break;
+        }
+        QJsonObject object;
+        object.insert("id", candidate.movie.id);
+        object.insert("title", candidate.movie.title);
+        object.insert("year", candidate.movie.year);
+        object.insert("runtime", candidate.movie.runtime);
+        object.insert("score", candidate.score);
+        object.insert("title_score", candidate.titleScore);
+        object.insert("year_score", candidate.yearScore);
+        object.insert("runtime_score", candidate.runtimeScore);
+        object.insert("popularity_score", candidate.popularityScore);
+        candidates.append(object);
+    }
+    entry.insert("candidates", candidates);
+
+    // Appended line by line, entries written before a crash are kept
+    QDir().mkpath(QFileInfo(m_filePath).absolutePath());
+    QFile file(m_filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append)
+        || file.write(QJsonDocument(entry).toJson(QJsonDocument::Compact) + '\n') < 0) {
+        m_errorString = QString("Couldn't write review queue %1: %2").arg(m_filePath, file.errorString());
+        return false;
+    }
+    m_listedFiles.insert(mediaFilePath);
+    return true;
+}
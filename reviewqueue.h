@@ -0,0 +1,36 @@
+#ifndef REVIEWQUEUE_H
+#define REVIEWQUEUE_H
+
+#include <QString>
+#include <QSet>
+#include "moviematcher.h"
+
+// Files the batch tagger couldn't match with confidence, for someone to look at
+// later. One JSON object per line: the file, what its name and container said,
+// the ranked candidates with their scores and why none was accepted.
+class ReviewQueue
+{
+public:
+    // An empty path uses defaultFilePath()
+    explicit ReviewQueue(const QString& filePath = QString());
+
+    static QString defaultFilePath();
+    QString filePath() const;
+
+    // Whether the file is already listed, in an earlier run or this one
+    bool contains(const QString& mediaFilePath) const;
+
+    // A file that is already listed isn't added again, that counts as success
+    bool append(const QString& mediaFilePath, const QString& title, int year, int runtimeMinutes,
+                const MovieMatcher::Match& match);
+
+    QString errorString() const;
+
+private:
+    QString m_filePath;
+    QString m_errorString;
+    // Files listed in the queue, read once when the queue is opened
+    QSet<QString> m_listedFiles;
+};
+
+#endif // REVIEWQUEUE_H
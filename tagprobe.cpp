@@ -0,0 +1,404 @@
+#include "tagprobe.h"
+#include <QFileInfo>
+#include <QtEndian>
+#include <cstring>
+
+// SeekHeads only hold a handful of entries
+static const qint64 MAX_SEEKHEAD_SIZE = 64 * 1024;
+
+// Mime types are short strings, anything longer is not a cover
+static const qint64 MAX_MIME_TYPE_SIZE = 256;
+
+// Info holds a few small elements (title, muxing app, dates), read in one go
+static const qint64 MAX_INFO_SIZE = 64 * 1024;
+
+TagProbe::TagProbe(const QString& filePath)
+    : m_filePath(filePath)
+    , m_file(filePath)
+{
+}
+
+QString TagProbe::errorString() const
+{
+    return m_errorString;
+}
+
+qint64 TagProbe::bytesRead() const
+{
+    return m_bytesRead;
+}
+
+TagProbe::CoverState TagProbe::fail(const QString& message)
+{
+    m_errorString = message;
+    return CoverState::Unknown;
+}
+
+TagProbe::CoverState TagProbe::probeCover()
+{
+    m_errorString.clear();
+    m_bytesRead = 0;
+
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        return fail(QString("Can't open file: %1").arg(m_file.errorString()));
+    }
+
+    QString suffix = QFileInfo(m_filePath).suffix().toLower();
+    CoverState state;
+    if (suffix == "mp4" || suffix == "m4v") {
+        state = probeMp4();
+    } else if (suffix == "mkv") {
+        state = probeMkv();
+    } else {
+        state = fail("Unsupported file format");
+    }
+
+    m_file.close();
+    return state;
+}
+
+qint64 TagProbe::probeDuration()
+{
+    m_errorString.clear();
+    m_bytesRead = 0;
+
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        fail(QString("Can't open file: %1").arg(m_file.errorString()));
+        return -1;
+    }
+
+    QString suffix = QFileInfo(m_filePath).suffix().toLower();
+    qint64 duration;
+    if (suffix == "mp4" || suffix == "m4v") {
+        duration = probeMp4Duration();
+    } else if (suffix == "mkv") {
+        duration = probeMkvDuration();
+    } else {
+        fail("Unsupported file format");
+        duration = -1;
+    }
+
+    m_file.close();
+    return duration;
+}
+
+QByteArray TagProbe::readBytes(qint64 offset, qint64 length)
+{
+    QByteArray data = Ebml::readBytes(&m_file, offset, length);
+    m_bytesRead += data.size();
+    return data;
+}
+
+bool TagProbe::readMp4Header(qint64 offset, qint64 end, Mp4::Atom& atom)
+{
+    QByteArray data = readBytes(offset, qMin<qint64>(Mp4::LargeHeaderSize, end - offset));
+    if (!Mp4::parseAtomHeader(data, 0, end - offset, atom)) {
+        return false;
+    }
+    atom.offset = offset;
+    return true;
+}
+
+bool TagProbe::findMp4Child(const Mp4::Atom& parent, const char *type, Mp4::Atom& child)
+{
+    // Sibling headers only, the payload of skipped atoms (trak, mdat, ...) is never read
+    qint64 pos = Mp4::childrenOffset(parent);
+    while (pos + Mp4::HeaderSize <= parent.endOffset()) {
+        if (!readMp4Header(pos, parent.endOffset(), child)) {
+            return false;
+        }
+        if (child.type == type) {
+            return true;
+        }
+        pos = child.endOffset();
+    }
+    return false;
+}
+
+TagProbe::CoverState TagProbe::probeMp4()
+{
+    // Step 1: The file itself is the parent of the top-level atoms
+    Mp4::Atom file;
+    file.offset = 0;
+    file.headerSize = 0;
+    file.size = m_file.size();
+
+    Mp4::Atom moov;
+    if (!findMp4Child(file, "moov", moov)) {
+        return fail("No moov atom");
+    }
+
+    // Step 2: moov/udta/meta/ilst/covr, a missing level means there is no cover
+    Mp4::Atom udta, meta, ilst, covr, data;
+    if (!findMp4Child(moov, "udta", udta) || !findMp4Child(udta, "meta", meta)
+        || !findMp4Child(meta, "ilst", ilst) || !findMp4Child(ilst, "covr", covr)) {
+        return CoverState::Missing;
+    }
+
+    // Step 3: A covr with a non-empty data atom (type indicator and locale come first)
+    if (findMp4Child(covr, "data", data) && data.size > Mp4::HeaderSize + 8) {
+        return CoverState::Present;
+    }
+    return CoverState::Missing;
+}
+
+bool TagProbe::readEbmlHeader(qint64 offset, Ebml::Element& element)
+{
+    QByteArray data = readBytes(offset, Ebml::MaxHeaderSize);
+    if (!Ebml::parseElementHeader(data, 0, element)) {
+        return false;
+    }
+    element.offset = offset;
+    return true;
+}
+
+bool TagProbe::findInSeekHead(const Ebml::Element& seekHead, qint64 segmentDataOffset, quint32 wantedId,
+                              Ebml::Element& element)
+{
+    if (seekHead.hasUnknownSize() || static_cast<qint64>(seekHead.dataSize) > MAX_SEEKHEAD_SIZE) {
+        return false;
+    }
+
+    QByteArray data = readBytes(seekHead.dataOffset(), static_cast<qint64>(seekHead.dataSize));
+    if (data.size() != static_cast<qint64>(seekHead.dataSize)) {
+        return false;
+    }
+
+    qint64 pos = 0;
+    while (pos < data.size()) {
+        Ebml::Element seek;
+        if (!Ebml::parseElementHeader(data, pos, seek) || seek.hasUnknownSize() || seek.endOffset() > data.size()) {
+            return false;
+        }
+
+        if (seek.id == Ebml::Seek) {
+            quint32 id = 0;
+            qint64 position = -1;
+            qint64 childPos = seek.dataOffset();
+            while (childPos < seek.endOffset()) {
+                Ebml::Element child;
+                if (!Ebml::parseElementHeader(data, childPos, child) || child.hasUnknownSize()
+                    || child.endOffset() > seek.endOffset() || child.dataSize > 8) {
+                    return false;
+                }
+                if (child.id == Ebml::SeekID) {
+                    id = static_cast<quint32>(Ebml::decodeUInt(data, child.dataOffset(), static_cast<int>(child.dataSize)));
+                } else if (child.id == Ebml::SeekPosition) {
+                    position = static_cast<qint64>(Ebml::decodeUInt(data, child.dataOffset(), static_cast<int>(child.dataSize)));
+                }
+                childPos = child.endOffset();
+            }
+
+            if (id == wantedId && position >= 0) {
+                return readEbmlHeader(segmentDataOffset + position, element)
+                       && element.id == wantedId && !element.hasUnknownSize();
+            }
+        }
+
+        pos = seek.endOffset();
+    }
+    return false;
+}
+
+TagProbe::CoverState TagProbe::probeMkv()
+{
+    qint64 fileSize = m_file.size();
+
+    // Step 1: EBML header and Segment
+    Ebml::Element header, segment;
+    if (!readEbmlHeader(0, header) || header.id != Ebml::EBMLHeader || header.hasUnknownSize()) {
+        return fail("Not a Matroska file");
+    }
+    if (!readEbmlHeader(header.endOffset(), segment) || segment.id != Ebml::Segment) {
+        return fail("Missing Matroska Segment");
+    }
+    qint64 segmentEnd = segment.hasUnknownSize() ? fileSize : qMin(segment.endOffset(), fileSize);
+
+    // Step 2: Level 1 headers up to the first Cluster, Attachments usually sit in front of it
+    bool hasAttachments = false;
+    bool hasSeekHead = false;
+    Ebml::Element attachments, seekHead;
+    qint64 pos = segment.dataOffset();
+    while (pos < segmentEnd) {
+        Ebml::Element child;
+        if (!readEbmlHeader(pos, child) || child.id == Ebml::Cluster || child.hasUnknownSize()) {
+            break;
+        }
+        if (child.id == Ebml::Attachments) {
+            hasAttachments = true;
+            attachments = child;
+            break;
+        }
+        if (child.id == Ebml::SeekHead && !hasSeekHead) {
+            hasSeekHead = true;
+            seekHead = child;
+        }
+        pos = child.endOffset();
+    }
+
+    // Step 3: Attachments behind the Clusters are found through the SeekHead
+    if (!hasAttachments && hasSeekHead) {
+        hasAttachments = findInSeekHead(seekHead, segment.dataOffset(), Ebml::Attachments, attachments);
+    }
+    if (!hasAttachments) {
+        return CoverState::Missing;
+    }
+
+    // Step 4: AttachedFile headers and their mime types, FileData is skipped
+    qint64 attachmentsEnd = qMin(attachments.endOffset(), fileSize);
+    pos = attachments.dataOffset();
+    while (pos < attachmentsEnd) {
+        Ebml::Element attachedFile;
+        if (!readEbmlHeader(pos, attachedFile) || attachedFile.hasUnknownSize()) {
+            return fail("Invalid AttachedFile element");
+        }
+
+        if (attachedFile.id == Ebml::AttachedFile) {
+            qint64 childPos = attachedFile.dataOffset();
+            qint64 attachedFileEnd = qMin(attachedFile.endOffset(), attachmentsEnd);
+            while (childPos < attachedFileEnd) {
+                Ebml::Element child;
+                if (!readEbmlHeader(childPos, child) || child.hasUnknownSize()) {
+                    return fail("Invalid AttachedFile element");
+                }
+                if (child.id == Ebml::FileMimeType && static_cast<qint64>(child.dataSize) <= MAX_MIME_TYPE_SIZE) {
+                    QByteArray mimeType = readBytes(child.dataOffset(), static_cast<qint64>(child.dataSize));
+                    // Same covers MediaTagWriter replaces
+                    if (mimeType == "image/jpeg" || mimeType == "image/png") {
+                        return CoverState::Present;
+                    }
+                }
+                childPos = child.endOffset();
+            }
+        }
+
+        pos = attachedFile.endOffset();
+    }
+
+    return CoverState::Missing;
+}
+
+qint64 TagProbe::probeMp4Duration()
+{
+    Mp4::Atom file;
+    file.offset = 0;
+    file.headerSize = 0;
+    file.size = m_file.size();
+
+    Mp4::Atom moov, mvhd;
+    if (!findMp4Child(file, "moov", moov)) {
+        fail("No moov atom");
+        return -1;
+    }
+    if (!findMp4Child(moov, "mvhd", mvhd)) {
+        fail("No mvhd atom");
+        return -1;
+    }
+
+    // Version 0: version/flags, created, modified (32 bit each), timescale, duration (32 bit)
+    // Version 1: version/flags, created, modified (64 bit each), timescale, duration (64 bit)
+    QByteArray data = readBytes(mvhd.dataOffset(), 32);
+    if (data.isEmpty()) {
+        fail("Invalid mvhd atom");
+        return -1;
+    }
+    bool version1 = static_cast<quint8>(data.at(0)) == 1;
+    if (data.size() < (version1 ? 32 : 20)) {
+        fail("Invalid mvhd atom");
+        return -1;
+    }
+
+    quint32 timescale = qFromBigEndian<quint32>(data.constData() + (version1 ? 20 : 12));
+    quint64 duration = version1 ? qFromBigEndian<quint64>(data.constData() + 24)
+                                : qFromBigEndian<quint32>(data.constData() + 16);
+    // All ones means "unknown" (fragmented files)
+    if (timescale == 0 || duration == (version1 ? Q_UINT64_C(0xFFFFFFFFFFFFFFFF) : Q_UINT64_C(0xFFFFFFFF))) {
+        fail("No duration in mvhd atom");
+        return -1;
+    }
+    return static_cast<qint64>(duration * 1000 / timescale);
+}
+
+qint64 TagProbe::probeMkvDuration()
+{
+    qint64 fileSize = m_file.size();
+
+    // Step 1: EBML header and Segment
+    Ebml::Element header, segment;
+    if (!readEbmlHeader(0, header) || header.id != Ebml::EBMLHeader || header.hasUnknownSize()) {
+        fail("Not a Matroska file");
+        return -1;
+    }
+    if (!readEbmlHeader(header.endOffset(), segment) || segment.id != Ebml::Segment) {
+        fail("Missing Matroska Segment");
+        return -1;
+    }
+    qint64 segmentEnd = segment.hasUnknownSize() ? fileSize : qMin(segment.endOffset(), fileSize);
+
+    // Step 2: Info is almost always in front of the first Cluster, otherwise ask the SeekHead
+    bool hasInfo = false;
+    bool hasSeekHead = false;
+    Ebml::Element info, seekHead;
+    qint64 pos = segment.dataOffset();
+    while (pos < segmentEnd) {
+        Ebml::Element child;
+        if (!readEbmlHeader(pos, child) || child.id == Ebml::Cluster || child.hasUnknownSize()) {
+            break;
+        }
+        if (child.id == Ebml::Info) {
+            hasInfo = true;
+            info = child;
+            break;
+        }
+        if (child.id == Ebml::SeekHead && !hasSeekHead) {
+            hasSeekHead = true;
+            seekHead = child;
+        }
+        pos = child.endOffset();
+    }
+    if (!hasInfo && hasSeekHead) {
+        hasInfo = findInSeekHead(seekHead, segment.dataOffset(), Ebml::Info, info);
+    }
+    if (!hasInfo || static_cast<qint64>(info.dataSize) > MAX_INFO_SIZE) {
+        fail("No Matroska Info element");
+        return -1;
+    }
+
+    // Step 3: Duration is a float in TimestampScale units (nanoseconds, default 1 ms)
+    QByteArray data = readBytes(info.dataOffset(), static_cast<qint64>(info.dataSize));
+    if (data.size() != static_cast<qint64>(info.dataSize)) {
+        fail("Invalid Matroska Info element");
+        return -1;
+    }
+
+    quint64 timestampScale = 1000000;
+    double duration = -1;
+    pos = 0;
+    while (pos < data.size()) {
+        Ebml::Element child;
+        if (!Ebml::parseElementHeader(data, pos, child) || child.hasUnknownSize() || child.endOffset() > data.size()) {
+            break;
+        }
+        const char *payload = data.constData() + child.dataOffset();
+        if (child.id == Ebml::TimestampScale && child.dataSize >= 1 && child.dataSize <= 8) {
+            timestampScale = Ebml::decodeUInt(data, child.dataOffset(), static_cast<int>(child.dataSize));
+        } else if (child.id == Ebml::Duration && child.dataSize == 4) {
+            quint32 bits = qFromBigEndian<quint32>(payload);
+            float value;
+            memcpy(&value, &bits, sizeof(value));
+            duration = value;
+        } else if (child.id == Ebml::Duration && child.dataSize == 8) {
+            quint64 bits = qFromBigEndian<quint64>(payload);
+            double value;
+            memcpy(&value, &bits, sizeof(value));
+            duration = value;
+        }
+        pos = child.endOffset();
+    }
+
+    if (duration < 0 || timestampScale == 0) {
+        fail("No duration in Matroska Info element");
+        return -1;
+    }
+    return static_cast<qint64>(duration * static_cast<double>(timestampScale) / 1000000.0);
+}
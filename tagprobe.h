@@ -0,0 +1,54 @@
+#ifndef TAGPROBE_H
+#define TAGPROBE_H
+
+#include <QString>
+#include <QFile>
+#include "ebml.h"
+#include "mp4atoms.h"
+
+// Finds out whether a file already carries a cover without opening it through
+// TagLib. Only atom/element headers and the few small elements on the way are
+// read: for MP4 the top-level atoms up to moov and the moov/udta/meta/ilst/covr
+// path, for MKV the level 1 elements up to the first Cluster (or the SeekHead)
+// and the AttachedFile headers. mdat, Clusters and the image data itself are
+// never read, a probe costs a few KB of I/O however large the file is.
+class TagProbe
+{
+public:
+    enum class CoverState {
+        Present,
+        Missing,
+        Unknown     // Unsupported or unreadable file, see errorString()
+    };
+
+    explicit TagProbe(const QString& filePath);
+
+    CoverState probeCover();
+
+    // Playing time from the mvhd atom or the Matroska Info element, in milliseconds.
+    // -1 if the file doesn't say, see errorString().
+    qint64 probeDuration();
+
+    QString errorString() const;
+    // Number of bytes read by the last probeCover() or probeDuration()
+    qint64 bytesRead() const;
+
+private:
+    CoverState probeMp4();
+    CoverState probeMkv();
+    qint64 probeMp4Duration();
+    qint64 probeMkvDuration();
+    bool findMp4Child(const Mp4::Atom& parent, const char *type, Mp4::Atom& child);
+    bool readMp4Header(qint64 offset, qint64 end, Mp4::Atom& atom);
+    bool readEbmlHeader(qint64 offset, Ebml::Element& element);
+    QByteArray readBytes(qint64 offset, qint64 length);
+    bool findInSeekHead(const Ebml::Element& seekHead, qint64 segmentDataOffset, quint32 id, Ebml::Element& element);
+    CoverState fail(const QString& message);
+
+    QString m_filePath;
+    QFile m_file;
+    QString m_errorString;
+    qint64 m_bytesRead = 0;
+};
+
+#endif // TAGPROBE_H
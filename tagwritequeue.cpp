@@ -0,0 +1,180 @@
+#include "tagwritequeue.h"
+#include "mediatagwriter.h"
+#include <QFileInfo>
+#include <QStorageInfo>
+#include <QMutexLocker>
+#include <QList>
+#include <QPair>
+
+// Directories whose device is remembered. A library with one directory per movie
+// would otherwise grow the cache for the whole run.
+static const int DEVICE_CACHE_DIRECTORIES = 1024;
+
+TagWriteQueue::TagWriteQueue(QObject *parent) : QObject(parent)
+{
+}
+
+TagWriteQueue::~TagWriteQueue()
+{
+    // Queued jobs are dropped, running ones must finish before the queue goes away
+    cancelAll();
+    m_pool.waitForDone();
+}
+
+void TagWriteQueue::setMaxThreadCount(int count)
+{
+    m_pool.setMaxThreadCount(qMax(1, count));
+}
+
+void TagWriteQueue::setMaxConcurrentWritesPerDevice(int count)
+{
+    QMutexLocker locker(&m_mutex);
+    m_maxWritesPerDevice = qMax(1, count);
+    dispatchLocked();
+}
+
+void TagWriteQueue::setSafeWrites(bool enabled)
+{
+    QMutexLocker locker(&m_mutex);
+    m_safeWrites = enabled;
+}
+
+quint64 TagWriteQueue::submit(const QString& filePath, const QImage& coverArt, const MovieResult& metadata)
+{
+    Job job;
+    job.filePath = filePath;
+    job.coverArt = coverArt;
+    job.metadata = metadata;
+    return enqueue(job);
+}
+
+quint64 TagWriteQueue::submit(const QString& filePath, const QByteArray& imageData, const MovieResult& metadata)
+{
+    Job job;
+    job.filePath = filePath;
+    job.imageData = imageData;
+    job.metadata = metadata;
+    return enqueue(job);
+}
+
+quint64 TagWriteQueue::enqueue(Job job)
+{
+    QMutexLocker locker(&m_mutex);
+    job.id = m_nextJobId++;
+    job.safeWrites = m_safeWrites;
+    job.device = deviceForFile(job.filePath);
+    m_devices[job.device].pending.enqueue(job);
+    dispatchLocked();
+    return job.id;
+}
+
+QByteArray TagWriteQueue::deviceForFile(const QString& filePath)
+{
+    // Resolving the mount point is comparatively expensive, files of one directory share it
+    QString directory = QFileInfo(filePath).absolutePath();
+    auto it = m_deviceByDirectory.constFind(directory);
+    if (it != m_deviceByDirectory.constEnd()) {
+        return it.value();
+    }
+
+    QStorageInfo storage(directory);
+    QByteArray device = storage.isValid() ? storage.device() : QByteArray();
+    if (m_deviceByDirectory.size() >= DEVICE_CACHE_DIRECTORIES) {
+        m_deviceByDirectory.clear();
+    }
+    m_deviceByDirectory.insert(directory, device);
+    return device;
+}
+
+bool TagWriteQueue::cancel(quint64 jobId)
+{
+    QString filePath;
+    {
+        QMutexLocker locker(&m_mutex);
+        for (DeviceQueue& device : m_devices) {
+            for (qsizetype i = 0; i < device.pending.size(); ++i) {
+                if (device.pending.at(i).id == jobId) {
+                    filePath = device.pending.takeAt(i).filePath;
+                    break;
+                }
+            }
+            if (!filePath.isEmpty()) {
+                break;
+            }
+        }
+    }
+
+    if (filePath.isEmpty()) {
+        return false;
+    }
+
+    emit jobCanceled(jobId, filePath);
+    return true;
+}
+
+void TagWriteQueue::cancelAll()
+{
+    QList<QPair<quint64, QString>> canceled;
+    {
+        QMutexLocker locker(&m_mutex);
+        for (DeviceQueue& device : m_devices) {
+            while (!device.pending.isEmpty()) {
+                Job job = device.pending.dequeue();
+                canceled.append(qMakePair(job.id, job.filePath));
+            }
+        }
+    }
+
+    for (const auto& job : canceled) {
+        emit jobCanceled(job.first, job.second);
+    }
+}
+
+void TagWriteQueue::waitForDone()
+{
+    m_pool.waitForDone();
+}
+
+void TagWriteQueue::dispatchLocked()
+{
+    for (DeviceQueue& device : m_devices) {
+        while (device.running < m_maxWritesPerDevice && !device.pending.isEmpty()) {
+            Job job = device.pending.dequeue();
+            ++device.running;
+            m_pool.start([this, job]() {
+                runJob(job);
+            });
+        }
+    }
+}
+
+void TagWriteQueue::runJob(const Job& job)
+{
+    // Runs on a pool thread, the writer lives only for this job
+    MediaTagWriter tagWriter;
+    QString lastMessage;
+
+    connect(&tagWriter, &MediaTagWriter::progressUpdate,
+            this, &TagWriteQueue::progressUpdate, Qt::DirectConnection);
+    connect(&tagWriter, &MediaTagWriter::error, &tagWriter,
+            [this, &lastMessage](const QString& message) {
+                lastMessage = message;
+                emit error(message);
+            }, Qt::DirectConnection);
+    connect(&tagWriter, &MediaTagWriter::success, &tagWriter,
+            [this, &lastMessage](const QString& message) {
+                lastMessage = message;
+                emit success(message);
+            }, Qt::DirectConnection);
+
+    tagWriter.setSafeWrites(job.safeWrites);
+    tagWriter.setMetadata(job.metadata);
+    bool ok = job.imageData.isEmpty() ? tagWriter.writeTagsToFile(job.filePath, job.coverArt)
+                                      : tagWriter.writeTagsToFile(job.filePath, job.imageData);
+
+    emit jobFinished(job.id, job.filePath, ok, lastMessage);
+
+    QMutexLocker locker(&m_mutex);
+    --m_devices[job.device].running;
+    dispatchLocked();
+}
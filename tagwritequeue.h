@@ -0,0 +1,86 @@
+#ifndef TAGWRITEQUEUE_H
+#define TAGWRITEQUEUE_H
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QImage>
+#include <QHash>
+#include <QQueue>
+#include <QMutex>
+#include <QThreadPool>
+#include "movieresult.h"
+
+// Runs MediaTagWriter jobs on a worker pool so large files never block the
+// calling thread. Jobs are grouped by storage device and at most
+// maxConcurrentWritesPerDevice of them touch the same device at a time.
+// MediaTagWriter's progressUpdate/error/success signals are forwarded from the
+// worker threads and delivered queued to receivers living in other threads.
+class TagWriteQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TagWriteQueue(QObject *parent = nullptr);
+    ~TagWriteQueue();
+
+    // Total number of writes running at the same time
+    void setMaxThreadCount(int count);
+    // Number of writes running at the same time on one storage device
+    void setMaxConcurrentWritesPerDevice(int count);
+    // Crash-safe writes for jobs submitted from now on, see MediaTagWriter::setSafeWrites()
+    void setSafeWrites(bool enabled);
+
+    // Queue a write and return its job id, the outcome is reported by jobFinished().
+    // metadata is written in the same pass as the cover, see MediaTagWriter::setMetadata().
+    quint64 submit(const QString& filePath, const QImage& coverArt, const MovieResult& metadata = MovieResult());
+    // Same, but imageData (e.g. a downloaded poster) is embedded as-is when it is JPEG/PNG
+    quint64 submit(const QString& filePath, const QByteArray& imageData, const MovieResult& metadata = MovieResult());
+
+    // Drop a job that has not started yet, returns false if it is running or done.
+    // Running writes are never interrupted so the file is not left half written.
+    bool cancel(quint64 jobId);
+    void cancelAll();
+
+    // Block until all started jobs are finished
+    void waitForDone();
+
+signals:
+    void progressUpdate(const QString& message);
+    void error(const QString& message);
+    void success(const QString& message);
+    void jobFinished(quint64 jobId, const QString& filePath, bool ok, const QString& message);
+    void jobCanceled(quint64 jobId, const QString& filePath);
+
+private:
+    struct Job {
+        quint64 id = 0;
+        QString filePath;
+        QByteArray device;
+        QImage coverArt;
+        QByteArray imageData;
+        MovieResult metadata;
+        bool safeWrites = false;
+    };
+
+    struct DeviceQueue {
+        int running = 0;
+        QQueue<Job> pending;
+    };
+
+    quint64 enqueue(Job job);
+    QByteArray deviceForFile(const QString& filePath);
+    void dispatchLocked();
+    void runJob(const Job& job);
+
+    QMutex m_mutex;  // Guards everything below, jobs finish on worker threads
+    QHash<QByteArray, DeviceQueue> m_devices;
+    QHash<QString, QByteArray> m_deviceByDirectory;
+    int m_maxWritesPerDevice = 1;
+    bool m_safeWrites = false;
+    quint64 m_nextJobId = 1;
+
+    QThreadPool m_pool;
+};
+
+#endif // TAGWRITEQUEUE_H
@@ -1,23 +1,89 @@
 #include "tmdbclient.h"
+#include "metrics.h"
 #include <QUrlQuery>
+#include <QPointer>
+#include <QTimer>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDebug>
+#include <memory>
 
 const QString TmdbClient::API_BASE_URL = "https://api.themoviedb.org/3";
 
+// Number of search result pages kept in the search cache
+static const int SEARCH_CACHE_ENTRIES = 2000;
+
+// Number of movies kept in the movie details cache
+static const int MOVIE_DETAILS_CACHE_ENTRIES = 500;
+
+// Default lifetime of cached search results
+static const int DEFAULT_SEARCH_CACHE_TTL = 60 * 60;
+
+// Default age after which the cached TMDb configuration is refreshed
+static const int DEFAULT_CONFIGURATION_CACHE_TTL = 3 * 24 * 60 * 60;
+
 TmdbClient::TmdbClient(const QString& bearerToken, QObject *parent)
     : QObject(parent)
     , m_bearerToken(bearerToken)
+    , m_apiBaseUrl(API_BASE_URL)
     , m_networkManager(new QNetworkAccessManager(this))
+    , m_scheduler(new RequestScheduler(m_networkManager, this))
     , m_isConfigured(false)
+    , m_configurationCacheFile(defaultConfigurationCacheFile())
+    , m_configurationCacheTtl(DEFAULT_CONFIGURATION_CACHE_TTL)
+    , m_searchCacheTtl(DEFAULT_SEARCH_CACHE_TTL)
+    , m_searchRequests(0)
+    , m_searchCacheHits(0)
+    , m_coalescedSearches(0)
 {
+    m_searchCache.setMaxCost(SEARCH_CACHE_ENTRIES);
+    m_movieDetailsCache.setMaxCost(MOVIE_DETAILS_CACHE_ENTRIES);
+
+    // Every failure is reported through error(), count them there
+    connect(this, &TmdbClient::error, this, [](ErrorSource source, const QString&) {
+        switch (source) {
+        case ErrorSource::Configuration:
+            Metrics::instance().increment("tmdb_configuration_errors");
+            break;
+        case ErrorSource::Search:
+            Metrics::instance().increment("tmdb_search_errors");
+            break;
+        case ErrorSource::PosterDownload:
+            Metrics::instance().increment("tmdb_poster_download_errors");
+            break;
+        case ErrorSource::MovieDetails:
+            Metrics::instance().increment("tmdb_movie_details_errors");
+            break;
+        }
+    });
 }
 
 TmdbClient::~TmdbClient()
 {
 }
 
+void TmdbClient::setApiBaseUrl(const QString& url)
+{
+    // Endpoints start with a slash
+    m_apiBaseUrl = url.isEmpty() ? API_BASE_URL : url;
+    while (m_apiBaseUrl.endsWith('/')) {
+        m_apiBaseUrl.chop(1);
+    }
+}
+
+QString TmdbClient::apiBaseUrl() const
+{
+    return m_apiBaseUrl;
+}
+
 QNetworkRequest TmdbClient::createRequest(const QString& endpoint) const
 {
-    QUrl url(API_BASE_URL + endpoint);
+    QUrl url(m_apiBaseUrl + endpoint);
     QNetworkRequest request(url);
 
     request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
@@ -27,132 +93,441 @@ QNetworkRequest TmdbClient::createRequest(const QString& endpoint) const
     return request;
 }
 
+QString TmdbClient::defaultConfigurationCacheFile()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + "/MovieTag/tmdb-configuration.ini";
+}
+
+void TmdbClient::setConfigurationCacheTtl(int seconds)
+{
+    m_configurationCacheTtl = qMax(0, seconds);
+}
+
 void TmdbClient::getConfiguration()
 {
+    // Step 1: Start from the copy saved by a previous run, posters can be downloaded right away
+    bool isFresh = false;
+    if (!m_isConfigured && loadCachedConfiguration(isFresh)) {
+        m_isConfigured = true;
+        emit configurationComplete();
+        if (isFresh) {
+            return;
+        }
+    }
+
+    // Step 2: Fetch the configuration, in the background if a stale copy is already in use
     QNetworkRequest request = createRequest("/configuration");
-    QNetworkReply* reply = m_networkManager->get(request);
 
-    connect(reply, &QNetworkReply::finished, this, [this, reply]() {
-        handleConfigurationResponse(reply);
-        reply->deleteLater();
-    });
+    // The body is parsed as it arrives, the parser lives as long as the request
+    auto parser = std::make_shared<TmdbConfigurationParser>();
+    QElapsedTimer timer;
+    timer.start();
+    m_scheduler->get(request, RequestScheduler::Priority::High,
+                     [this, parser, timer](QNetworkReply* reply) {
+                         Metrics::instance().observeElapsed("tmdb_configuration_seconds", timer);
+                         handleConfigurationResponse(reply, *parser);
+                     },
+                     [parser](QNetworkReply* reply) {
+                         parser->addData(reply->readAll());
+                     });
 }
 
-void TmdbClient::handleConfigurationResponse(QNetworkReply* reply)
+void TmdbClient::handleConfigurationResponse(QNetworkReply* reply, TmdbConfigurationParser& parser)
 {
+    // A failed background refresh keeps the cached configuration, only a missing one is an error
+    auto fail = [this](const QString& message) {
+        if (m_isConfigured) {
+            qWarning() << "Couldn't refresh TMDb configuration, using the cached copy:" << message;
+            return;
+        }
+        emit error(ErrorSource::Configuration, message);
+    };
+
     if (reply->error() != QNetworkReply::NoError) {
-        emit error(ErrorSource::Configuration,
-                   QString("Network error during configuration: %1").arg(reply->errorString()));
+        fail(QString("Network error during configuration: %1").arg(reply->errorString()));
         return;
     }
 
-    QByteArray data = reply->readAll();
-    QJsonDocument doc = QJsonDocument::fromJson(data);
+    parser.addData(reply->readAll());
+    if (!parser.finish()) {
+        fail("Invalid JSON response during configuration");
+        return;
+    }
 
-    if (doc.isNull()) {
-        emit error(ErrorSource::Configuration,
-                   "Invalid JSON response during configuration");
+    if (!parser.hasImages()) {
+        fail("Missing 'images' section in configuration response");
         return;
     }
 
-    QJsonObject root = doc.object();
-    if (!root.contains("images")) {
-        emit error(ErrorSource::Configuration,
-                   "Missing 'images' section in configuration response");
+    if (parser.secureBaseUrl().isEmpty() || !parser.hasPosterSizes()) {
+        fail("Missing required fields in configuration response");
         return;
     }
 
-    QJsonObject images = root["images"].toObject();
+    applyConfiguration(parser.secureBaseUrl(), parser.posterSizes());
+    saveCachedConfiguration(parser.secureBaseUrl(), parser.posterSizes());
 
-    if (!images.contains("secure_base_url") || !images.contains("poster_sizes")) {
-        emit error(ErrorSource::Configuration,
-                   "Missing required fields in configuration response");
-        return;
+    if (!m_isConfigured) {
+        m_isConfigured = true;
+        emit configurationComplete();
     }
+}
 
+void TmdbClient::applyConfiguration(const QString& secureBaseUrl, const QStringList& posterSizes)
+{
     // Store secure base URL
-    m_baseUrl = images["secure_base_url"].toString();
+    m_baseUrl = secureBaseUrl;
 
     // Get poster sizes and select appropriate size
-    QJsonArray posterSizes = images["poster_sizes"].toArray();
     m_posterSize = "w500";
 
-    bool hasW500 = false;
-    for (const QJsonValue& size : posterSizes) {
-        if (size.toString() == "w500") {
-            hasW500 = true;
-            break;
-        }
+    if (!posterSizes.contains("w500") && !posterSizes.isEmpty()) {
+        m_posterSize = posterSizes.first();
     }
+}
+
+bool TmdbClient::loadCachedConfiguration(bool& isFresh)
+{
+    if (m_configurationCacheTtl == 0 || !QFile::exists(m_configurationCacheFile)) {
+        return false;
+    }
+
+    QSettings cache(m_configurationCacheFile, QSettings::IniFormat);
+    QString secureBaseUrl = cache.value("Configuration/secure_base_url").toString();
+    QStringList posterSizes = cache.value("Configuration/poster_sizes").toStringList();
+    QDateTime fetched = cache.value("Configuration/fetched").toDateTime();
+
+    if (secureBaseUrl.isEmpty() || posterSizes.isEmpty() || !fetched.isValid()) {
+        return false;
+    }
+
+    // Saved from another server (a stand-in or TMDb itself), its image url doesn't apply here
+    if (cache.value("Configuration/api_base_url", API_BASE_URL).toString() != m_apiBaseUrl) {
+        return false;
+    }
+
+    applyConfiguration(secureBaseUrl, posterSizes);
+    isFresh = fetched.secsTo(QDateTime::currentDateTimeUtc()) < m_configurationCacheTtl;
+    return true;
+}
+
+void TmdbClient::saveCachedConfiguration(const QString& secureBaseUrl, const QStringList& posterSizes) const
+{
+    if (m_configurationCacheTtl == 0) {
+        return;
+    }
+
+    QDir().mkpath(QFileInfo(m_configurationCacheFile).absolutePath());
+
+    QSettings cache(m_configurationCacheFile, QSettings::IniFormat);
+    cache.setValue("Configuration/api_base_url", m_apiBaseUrl);
+    cache.setValue("Configuration/secure_base_url", secureBaseUrl);
+    cache.setValue("Configuration/poster_sizes", posterSizes);
+    cache.setValue("Configuration/fetched", QDateTime::currentDateTimeUtc());
+}
 
-    if (!hasW500 && !posterSizes.isEmpty()) {
-        m_posterSize = posterSizes.first().toString();
+bool TmdbClient::isConfigured() const
+{
+    return m_isConfigured;
+}
+
+PosterCache& TmdbClient::posterCache()
+{
+    return m_posterCache;
+}
+
+RequestScheduler& TmdbClient::requestScheduler()
+{
+    return *m_scheduler;
+}
+
+void TmdbClient::setSearchCacheTtl(int seconds)
+{
+    m_searchCacheTtl = qMax(0, seconds);
+    if (m_searchCacheTtl == 0) {
+        m_searchCache.clear();
+        m_movieDetailsCache.clear();
     }
+}
+
+int TmdbClient::searchRequests() const
+{
+    return m_searchRequests;
+}
+
+int TmdbClient::searchCacheHits() const
+{
+    return m_searchCacheHits;
+}
+
+int TmdbClient::coalescedSearches() const
+{
+    return m_coalescedSearches;
+}
 
-    m_isConfigured = true;
-    emit configurationComplete();
+QString TmdbClient::searchKey(const QString& query, int year, int page)
+{
+    // "The  Matrix" and "the matrix" are the same search
+    return QString("%1|%2|%3").arg(query.simplified().toCaseFolded(), QString::number(year), QString::number(page));
 }
 
 void TmdbClient::searchMovie(const QString& query)
 {
+    searchMovie(query, 0, 1, this, [this](bool ok, const SearchPage& page) {
+        if (ok) {
+            emit searchCompleted(page.movies);
+        }
+    });
+}
+
+void TmdbClient::searchMovie(const QString& query, QObject *context, SearchCallback callback)
+{
+    searchMovie(query, 0, 1, context, callback);
+}
+
+void TmdbClient::searchMovie(const QString& query, int year, int page, QObject *context, SearchCallback callback)
+{
+    // Only call back while the requester is still alive
+    SearchCallback guardedCallback = [guard = QPointer<QObject>(context), callback](bool ok, const SearchPage& page) {
+        if (guard && callback) {
+            callback(ok, page);
+        }
+    };
+
     if (query.trimmed().isEmpty()) {
         emit error(ErrorSource::Search, "Search query cannot be empty");
+        guardedCallback(false, SearchPage());
+        return;
+    }
+
+    page = qMax(1, page);
+    QString key = searchKey(query, year, page);
+
+    // Cache hit, no network round trip. Still call back asynchronously like a search.
+    CachedSearch *cached = m_searchCache.object(key);
+    if (cached && !cached->expiry.hasExpired()) {
+        ++m_searchCacheHits;
+        Metrics::instance().increment("tmdb_search_cache_hits");
+        SearchPage cachedPage = cached->page;
+        QTimer::singleShot(0, this, [guardedCallback, cachedPage]() {
+            guardedCallback(true, cachedPage);
+        });
+        return;
+    }
+
+    // The same search is already in flight, wait for its reply
+    auto pending = m_pendingSearches.find(key);
+    if (pending != m_pendingSearches.end()) {
+        ++m_coalescedSearches;
+        pending->append(guardedCallback);
         return;
     }
+    m_pendingSearches.insert(key, QList<SearchCallback>() << guardedCallback);
 
     QNetworkRequest request = createRequest("/search/movie");
     QUrl url = request.url();
     QUrlQuery urlQuery;
-    urlQuery.addQueryItem("query", query);
+    urlQuery.addQueryItem("query", query.simplified());
+    if (year > 0) {
+        urlQuery.addQueryItem("year", QString::number(year));
+    }
+    if (page > 1) {
+        urlQuery.addQueryItem("page", QString::number(page));
+    }
     url.setQuery(urlQuery);
     request.setUrl(url);
 
-    QNetworkReply* reply = m_networkManager->get(request);
-    connect(reply, &QNetworkReply::finished, this, [this, reply]() {
-        handleSearchResponse(reply);
-        reply->deleteLater();
-    });
+    ++m_searchRequests;
+    auto parser = std::make_shared<TmdbSearchParser>();
+    // Measured from here, the time a request waits for the rate limit is included
+    QElapsedTimer timer;
+    timer.start();
+    m_scheduler->get(request, RequestScheduler::Priority::High,
+                     [this, parser, key, page, timer](QNetworkReply* reply) {
+                         Metrics::instance().observeElapsed("tmdb_search_seconds", timer);
+                         handleSearchResponse(reply, *parser, key, page);
+                     },
+                     [parser](QNetworkReply* reply) {
+                         parser->addData(reply->readAll());
+                     });
 }
 
-void TmdbClient::handleSearchResponse(QNetworkReply* reply)
+void TmdbClient::handleSearchResponse(QNetworkReply* reply, TmdbSearchParser& parser, const QString& key, int page)
 {
+    auto fail = [this, &key](const QString& message) {
+        emit error(ErrorSource::Search, message);
+        finishSearch(key, false, SearchPage());
+    };
+
     if (reply->error() != QNetworkReply::NoError) {
-        emit error(ErrorSource::Search,
-                   QString("Network error during search: %1").arg(reply->errorString()));
+        fail(QString("Network error during search: %1").arg(reply->errorString()));
         return;
     }
 
-    QByteArray data = reply->readAll();
-    QJsonDocument doc = QJsonDocument::fromJson(data);
+    // Most of the body has usually been parsed on readyRead already
+    parser.addData(reply->readAll());
+    if (!parser.finish()) {
+        fail("Invalid JSON response during search");
+        return;
+    }
 
-    if (doc.isNull()) {
-        emit error(ErrorSource::Search,
-                   "Invalid JSON response during search");
+    if (!parser.hasResults()) {
+        fail("Missing 'results' field in search response");
         return;
     }
 
-    QJsonObject root = doc.object();
-    if (!root.contains("results")) {
-        emit error(ErrorSource::Search,
-                   "Missing 'results' field in search response");
+    SearchPage result;
+    result.movies = parser.movies();
+    result.page = parser.page() > 0 ? parser.page() : page;
+    result.totalPages = qMax(result.page, parser.totalPages());
+
+    // Only successful searches are cached, failures are retried by the next request
+    if (m_searchCacheTtl > 0) {
+        CachedSearch *cached = new CachedSearch;
+        cached->page = result;
+        cached->expiry = QDeadlineTimer(std::chrono::seconds(m_searchCacheTtl));
+        m_searchCache.insert(key, cached);
+    }
+
+    finishSearch(key, true, result);
+}
+
+void TmdbClient::finishSearch(const QString& key, bool ok, const SearchPage& page)
+{
+    // Hand the page to every requester of this search
+    const QList<SearchCallback> callbacks = m_pendingSearches.take(key);
+    for (const SearchCallback& callback : callbacks) {
+        callback(ok, page);
+    }
+}
+
+void TmdbClient::getMovieDetails(int movieId, QObject *context, MovieDetailsCallback callback)
+{
+    // Only call back while the requester is still alive
+    MovieDetailsCallback guardedCallback = [guard = QPointer<QObject>(context), callback](bool ok, const MovieResult& movie) {
+        if (guard && callback) {
+            callback(ok, movie);
+        }
+    };
+
+    if (movieId <= 0) {
+        emit error(ErrorSource::MovieDetails, "Invalid movie id");
+        guardedCallback(false, MovieResult());
         return;
     }
 
-    QJsonArray results = root["results"].toArray();
-    emit searchCompleted(results);
+    // Cache hit, e.g. the runtime was fetched for matching and now the tags need the rest
+    CachedMovieDetails *cached = m_movieDetailsCache.object(movieId);
+    if (cached && !cached->expiry.hasExpired()) {
+        Metrics::instance().increment("tmdb_movie_details_cache_hits");
+        MovieResult cachedMovie = cached->movie;
+        QTimer::singleShot(0, this, [guardedCallback, cachedMovie]() {
+            guardedCallback(true, cachedMovie);
+        });
+        return;
+    }
+
+    // The same movie is already in flight, wait for its reply
+    auto pending = m_pendingMovieDetails.find(movieId);
+    if (pending != m_pendingMovieDetails.end()) {
+        pending->append(guardedCallback);
+        return;
+    }
+    m_pendingMovieDetails.insert(movieId, QList<MovieDetailsCallback>() << guardedCallback);
+
+    // Credits come in the same reply, no second round trip for director and cast
+    QNetworkRequest request = createRequest(QString("/movie/%1").arg(movieId));
+    QUrl url = request.url();
+    QUrlQuery urlQuery;
+    urlQuery.addQueryItem("append_to_response", "credits");
+    url.setQuery(urlQuery);
+    request.setUrl(url);
+
+    auto parser = std::make_shared<TmdbMovieDetailsParser>();
+    QElapsedTimer timer;
+    timer.start();
+    // Details decide which poster to download, so they go ahead of the posters like searches
+    m_scheduler->get(request, RequestScheduler::Priority::High,
+                     [this, parser, movieId, timer](QNetworkReply* reply) {
+                         Metrics::instance().observeElapsed("tmdb_movie_details_seconds", timer);
+                         handleMovieDetailsResponse(reply, *parser, movieId);
+                     },
+                     [parser](QNetworkReply* reply) {
+                         parser->addData(reply->readAll());
+                     });
+}
+
+void TmdbClient::handleMovieDetailsResponse(QNetworkReply* reply, TmdbMovieDetailsParser& parser, int movieId)
+{
+    auto fail = [this, movieId](const QString& message) {
+        emit error(ErrorSource::MovieDetails, message);
+        finishMovieDetails(movieId, false, MovieResult());
+    };
+
+    if (reply->error() != QNetworkReply::NoError) {
+        fail(QString("Network error during movie details request: %1").arg(reply->errorString()));
+        return;
+    }
+
+    parser.addData(reply->readAll());
+    if (!parser.finish()) {
+        fail("Invalid JSON response for movie details");
+        return;
+    }
+
+    if (!parser.hasMovie()) {
+        fail("Missing 'id' field in movie details response");
+        return;
+    }
+
+    if (m_searchCacheTtl > 0) {
+        CachedMovieDetails *cached = new CachedMovieDetails;
+        cached->movie = parser.movie();
+        cached->expiry = QDeadlineTimer(std::chrono::seconds(m_searchCacheTtl));
+        m_movieDetailsCache.insert(movieId, cached);
+    }
+
+    finishMovieDetails(movieId, true, parser.movie());
+}
+
+void TmdbClient::finishMovieDetails(int movieId, bool ok, const MovieResult& movie)
+{
+    const QList<MovieDetailsCallback> callbacks = m_pendingMovieDetails.take(movieId);
+    for (const MovieDetailsCallback& callback : callbacks) {
+        callback(ok, movie);
+    }
 }
 
-void TmdbClient::downloadMoviePoster(const QString& posterPath, QObject *sender)
+void TmdbClient::downloadMoviePoster(const QString& posterPath, QObject *context, PosterCallback callback)
 {
+    // Only call back while the requester (e.g. the list item) is still alive
+    PosterCallback guardedCallback = [guard = QPointer<QObject>(context), callback](const QByteArray& imageData) {
+        if (guard && callback) {
+            callback(imageData);
+        }
+    };
+
     if (!m_isConfigured) {
         emit error(ErrorSource::PosterDownload,
                    "TMDB client not configured. Call getConfiguration first.");
+        guardedCallback(QByteArray());
         return;
     }
 
     if (posterPath.isEmpty()) {
         emit error(ErrorSource::PosterDownload,
                    "Poster path cannot be empty");
+        guardedCallback(QByteArray());
+        return;
+    }
+
+    // Cache hit, no network round trip. Still call back asynchronously like a download.
+    QByteArray cachedImage = m_posterCache.find(posterPath, m_posterSize);
+    if (!cachedImage.isEmpty()) {
+        Metrics::instance().increment("poster_cache_hits");
+        QTimer::singleShot(0, this, [guardedCallback, cachedImage]() {
+            guardedCallback(cachedImage);
+        });
         return;
     }
 
@@ -163,18 +538,21 @@ void TmdbClient::downloadMoviePoster(const QString& posterPath, QObject *sender)
     request.setUrl(url);
     request.setRawHeader("Authorization", QString("Bearer %1").arg(m_bearerToken).toUtf8());
 
-    QNetworkReply* reply = m_networkManager->get(request);
-    connect(reply, &QNetworkReply::finished, [this, reply, sender, posterPath]() {
-        handlePosterDownload(reply, sender, posterPath);
-        reply->deleteLater();
+    // Posters wait behind searches, a search result is useless without them anyway
+    QElapsedTimer timer;
+    timer.start();
+    m_scheduler->get(request, RequestScheduler::Priority::Low, [this, posterPath, guardedCallback, timer](QNetworkReply* reply) {
+        Metrics::instance().observeElapsed("tmdb_poster_download_seconds", timer);
+        handlePosterDownload(reply, posterPath, guardedCallback);
     });
 }
 
-void TmdbClient::handlePosterDownload(QNetworkReply* reply, QObject *sender, const QString& posterPath)
+void TmdbClient::handlePosterDownload(QNetworkReply* reply, const QString& posterPath, const PosterCallback& callback)
 {
     if (reply->error() != QNetworkReply::NoError) {
         emit error(ErrorSource::PosterDownload,
                    QString("Network error during poster download: %1").arg(reply->errorString()));
+        callback(QByteArray());
         return;
     }
 
@@ -182,9 +560,13 @@ void TmdbClient::handlePosterDownload(QNetworkReply* reply, QObject *sender, con
     if (imageData.isEmpty()) {
         emit error(ErrorSource::PosterDownload,
                    "Received empty image data");
+        callback(QByteArray());
         return;
     }
 
-    // Emit the signal with the image data and the poster path
-    emit posterDownloaded(imageData, posterPath);
+    Metrics::instance().observeBytes("tmdb_poster_download_bytes", imageData.size());
+    m_posterCache.insert(posterPath, m_posterSize, imageData);
+
+    // Hand the image straight to the requester of this poster
+    callback(imageData);
 }
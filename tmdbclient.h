@@ -5,10 +5,15 @@
 #include <QString>
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
-#include <QJsonDocument>
-#include <QJsonObject>
-#include <QJsonArray>
 #include <QByteArray>
+#include <QHash>
+#include <QCache>
+#include <QDeadlineTimer>
+#include <functional>
+#include "postercache.h"
+#include "requestscheduler.h"
+#include "movieresult.h"
+#include "tmdbresponseparser.h"
 
 class TmdbClient : public QObject
 {
@@ -18,36 +23,121 @@ public:
     enum class ErrorSource {
         Configuration,
         Search,
-        PosterDownload
+        PosterDownload,
+        MovieDetails
     };
     Q_ENUM(ErrorSource)
 
+    // One page of search results
+    struct SearchPage {
+        MovieResults movies;
+        int page = 1;
+        int totalPages = 1;
+
+        // Further pages can be requested with searchMovie(query, year, page + 1, ...)
+        bool hasMore() const { return page < totalPages; }
+    };
+
+    // Per-request search result callback, ok is false on network/parse errors
+    using SearchCallback = std::function<void(bool ok, const SearchPage& page)>;
+    // Per-request movie details callback, ok is false on network/parse errors
+    using MovieDetailsCallback = std::function<void(bool ok, const MovieResult& movie)>;
+    // Per-request poster callback, imageData is empty on failure
+    using PosterCallback = std::function<void(const QByteArray& imageData)>;
+
     explicit TmdbClient(const QString& bearerToken, QObject *parent = nullptr);
     ~TmdbClient();
 
+    // Root of the TMDb API ("https://api.themoviedb.org/3"), e.g. a local stand-in
+    // server for benchmarks. An empty url restores the default. Posters are downloaded
+    // from the image base url the configuration names.
+    void setApiBaseUrl(const QString& url);
+    QString apiBaseUrl() const;
+
+    // Uses the configuration saved by a previous run right away (configurationComplete is
+    // emitted before returning) and only goes to the network once that copy has expired
     void getConfiguration();
     void searchMovie(const QString& query);
-    void downloadMoviePoster(const QString& posterPath, QObject *sender);  // Updated method signature
+    // Search and deliver the results only to callback (not via searchCompleted).
+    // The callback is dropped if context is destroyed before the reply arrives.
+    void searchMovie(const QString& query, QObject *context, SearchCallback callback);
+    // Search a single page, year 0 matches any year. Identical searches in flight share
+    // one request and results are cached by normalized query, year and page.
+    void searchMovie(const QString& query, int year, int page, QObject *context, SearchCallback callback);
+    // Full record of one movie (runtime, genres and credits, which searches lack), delivered
+    // only to callback. The callback is dropped if context is destroyed before the reply
+    // arrives. Requests for the same movie share one reply, which is cached like searches.
+    void getMovieDetails(int movieId, QObject *context, MovieDetailsCallback callback);
+    // Download a poster and deliver it only to callback, which is always called
+    // exactly once unless context is destroyed before the download completes
+    void downloadMoviePoster(const QString& posterPath, QObject *context, PosterCallback callback);
+    bool isConfigured() const;
+
+    // Posters are served from this cache when possible, see PosterCache
+    PosterCache& posterCache();
+    // All requests go through this scheduler, see RequestScheduler for the limits
+    RequestScheduler& requestScheduler();
+
+    // Age after which the saved configuration is refreshed, 0 disables saving it
+    void setConfigurationCacheTtl(int seconds);
+    static QString defaultConfigurationCacheFile();
+
+    // How long search results and movie details are reused, 0 disables both caches
+    void setSearchCacheTtl(int seconds);
+    // Search statistics: requests sent, answered from the cache, joined to one in flight
+    int searchRequests() const;
+    int searchCacheHits() const;
+    int coalescedSearches() const;
 
 signals:
     void error(ErrorSource source, const QString& message);
-    void searchCompleted(const QJsonArray& movies);
-    void posterDownloaded(const QByteArray& imageData, const QString& posterPath);  // Updated signal
+    void searchCompleted(const MovieResults& movies);
     void configurationComplete();
 
-private slots:
-    void handleConfigurationResponse(QNetworkReply* reply);
-    void handleSearchResponse(QNetworkReply* reply);
-    void handlePosterDownload(QNetworkReply* reply, QObject *sender, const QString& posterPath);  // Updated method signature
-
 private:
+    struct CachedSearch {
+        SearchPage page;
+        QDeadlineTimer expiry;
+    };
+
+    struct CachedMovieDetails {
+        MovieResult movie;
+        QDeadlineTimer expiry;
+    };
+
     QString m_bearerToken;
+    QString m_apiBaseUrl;
     QString m_baseUrl;
     QString m_posterSize;
     QNetworkAccessManager* m_networkManager;
+    RequestScheduler* m_scheduler;
     bool m_isConfigured;
+    QString m_configurationCacheFile;
+    int m_configurationCacheTtl;
+    PosterCache m_posterCache;
+
+    // Callbacks waiting for a search in flight, by search key
+    QHash<QString, QList<SearchCallback>> m_pendingSearches;
+    QCache<QString, CachedSearch> m_searchCache;
+    // Same for movie details, by movie id
+    QHash<int, QList<MovieDetailsCallback>> m_pendingMovieDetails;
+    QCache<int, CachedMovieDetails> m_movieDetailsCache;
+    int m_searchCacheTtl;
+    int m_searchRequests;
+    int m_searchCacheHits;
+    int m_coalescedSearches;
 
     static const QString API_BASE_URL;
+    static QString searchKey(const QString& query, int year, int page);
+    void handleConfigurationResponse(QNetworkReply* reply, TmdbConfigurationParser& parser);
+    void applyConfiguration(const QString& secureBaseUrl, const QStringList& posterSizes);
+    bool loadCachedConfiguration(bool& isFresh);
+    void saveCachedConfiguration(const QString& secureBaseUrl, const QStringList& posterSizes) const;
+    void handleSearchResponse(QNetworkReply* reply, TmdbSearchParser& parser, const QString& key, int page);
+    void finishSearch(const QString& key, bool ok, const SearchPage& page);
+    void handleMovieDetailsResponse(QNetworkReply* reply, TmdbMovieDetailsParser& parser, int movieId);
+    void finishMovieDetails(int movieId, bool ok, const MovieResult& movie);
+    void handlePosterDownload(QNetworkReply* reply, const QString& posterPath, const PosterCallback& callback);
     QNetworkRequest createRequest(const QString& endpoint) const;
 };
 
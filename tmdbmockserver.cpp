@@ -0,0 +1,359 @@
+#include "tmdbmockserver.h"
+#include <QTcpSocket>
+#include <QHostAddress>
+#include <QUrl>
+#include <QUrlQuery>
+#include <QFile>
+#include <QDir>
+#include <QTimer>
+#include <QPointer>
+#include <QBuffer>
+#include <QImage>
+#include <QRandomGenerator>
+#include <QCryptographicHash>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <iterator>
+
+// Poster sizes announced by the generated configuration, as TMDb lists them
+static const char *const POSTER_SIZES[] = { "w92", "w154", "w185", "w342", "w500", "w780", "original" };
+
+// Genres handed out to generated movies, with their TMDb ids
+static const struct {
+    int id;
+    const char *name;
+} GENRES[] = { { 28, "Action" }, { 12, "Adventure" }, { 35, "Comedy" }, { 80, "Crime" }, { 18, "Drama" },
+               { 14, "Fantasy" }, { 27, "Horror" }, { 878, "Science Fiction" }, { 53, "Thriller" } };
+
+TmdbMockServer::TmdbMockServer(QObject *parent) : QObject(parent)
+{
+    connect(&m_server, &QTcpServer::newConnection, this, &TmdbMockServer::onNewConnection);
+}
+
+void TmdbMockServer::setRecordingsDirectory(const QString& directory)
+{
+    m_recordingsDirectory = directory;
+}
+
+void TmdbMockServer::setLatency(int minMs, int maxMs)
+{
+    m_minLatency = qMax(0, minMs);
+    m_maxLatency = qMax(m_minLatency, maxMs);
+}
+
+void TmdbMockServer::setErrorRate(double rate)
+{
+    m_errorRate = qBound(0.0, rate, 1.0);
+}
+
+bool TmdbMockServer::listen(quint16 port)
+{
+    // Loopback only, this is no server for anyone else
+    return m_server.listen(QHostAddress::LocalHost, port);
+}
+
+quint16 TmdbMockServer::port() const
+{
+    return m_server.serverPort();
+}
+
+QString TmdbMockServer::errorString() const
+{
+    return m_server.errorString();
+}
+
+QString TmdbMockServer::apiBaseUrl() const
+{
+    return QString("http://127.0.0.1:%1/3").arg(port());
+}
+
+QString TmdbMockServer::imageBaseUrl() const
+{
+    return QString("http://127.0.0.1:%1/images/").arg(port());
+}
+
+int TmdbMockServer::requestCount() const
+{
+    return m_requestCount;
+}
+
+int TmdbMockServer::failedRequestCount() const
+{
+    return m_failedRequestCount;
+}
+
+void TmdbMockServer::onNewConnection()
+{
+    while (QTcpSocket *socket = m_server.nextPendingConnection()) {
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() {
+            onReadyRead(socket);
+        });
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket]() {
+            m_buffers.remove(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+void TmdbMockServer::onReadyRead(QTcpSocket *socket)
+{
+    QByteArray& buffer = m_buffers[socket];
+    buffer += socket->readAll();
+
+    // One request per header block, GET requests have no body
+    qsizetype headerEnd;
+    while ((headerEnd = buffer.indexOf("\r\n\r\n")) >= 0) {
+        QByteArray requestLine = buffer.left(buffer.indexOf("\r\n"));
+        buffer.remove(0, headerEnd + 4);
+        ++m_requestCount;
+
+        // "GET /3/search/movie?query=... HTTP/1.1"
+        QList<QByteArray> parts = requestLine.split(' ');
+        Response response;
+        if (parts.size() != 3 || parts.at(0) != "GET") {
+            response.status = 405;
+        } else if (QRandomGenerator::global()->bounded(1.0) < m_errorRate) {
+            // Both are retried by RequestScheduler
+            ++m_failedRequestCount;
+            response.status = QRandomGenerator::global()->bounded(2) == 0 ? 429 : 503;
+        } else {
+            response = respond(parts.at(1));
+        }
+
+        // Replies are sent in order, TmdbClient doesn't pipeline requests on a connection
+        int latency = m_minLatency + QRandomGenerator::global()->bounded(m_maxLatency - m_minLatency + 1);
+        QPointer<QTcpSocket> guard(socket);
+        QTimer::singleShot(latency, this, [this, guard, response]() {
+            if (guard) {
+                send(guard, response);
+            }
+        });
+    }
+}
+
+TmdbMockServer::Response TmdbMockServer::respond(const QByteArray& target)
+{
+    QUrl url(QString::fromLatin1(target));
+    QString path = url.path();
+
+    if (path == "/3/configuration") {
+        return configurationResponse();
+    }
+    if (path == "/3/search/movie") {
+        return searchResponse(QUrlQuery(url));
+    }
+    // "/3/movie/<id>"
+    if (path.startsWith("/3/movie/") && path.count('/') == 3) {
+        bool ok = false;
+        int id = path.section('/', 3).toInt(&ok);
+        if (ok) {
+            return movieResponse(id);
+        }
+    }
+    // "/images/<size>/<file name>"
+    if (path.startsWith("/images/") && path.count('/') == 3) {
+        return posterResponse(path.section('/', 3));
+    }
+
+    Response notFound;
+    notFound.status = 404;
+    notFound.body = R"({"success":false,"status_code":34,"status_message":"The resource you requested could not be found."})";
+    return notFound;
+}
+
+TmdbMockServer::Response TmdbMockServer::configurationResponse() const
+{
+    QJsonObject root = QJsonDocument::fromJson(recording("configuration.json")).object();
+    QJsonObject images = root.value("images").toObject();
+
+    // Recorded or not, posters must come from here
+    images.insert("base_url", imageBaseUrl());
+    images.insert("secure_base_url", imageBaseUrl());
+    if (!images.contains("poster_sizes")) {
+        QJsonArray posterSizes;
+        for (const char *size : POSTER_SIZES) {
+            posterSizes.append(QString::fromLatin1(size));
+        }
+        images.insert("poster_sizes", posterSizes);
+    }
+    root.insert("images", images);
+
+    Response response;
+    response.body = QJsonDocument(root).toJson(QJsonDocument::Compact);
+    return response;
+}
+
+TmdbMockServer::Response TmdbMockServer::searchResponse(const QUrlQuery& query) const
+{
+    QString text = query.queryItemValue("query", QUrl::FullyDecoded).simplified();
+    int year = query.queryItemValue("year").toInt();
+
+    Response response;
+    if (text.isEmpty()) {
+        response.status = 422;
+        response.body = R"({"success":false,"status_code":22,"status_message":"Invalid parameters."})";
+        return response;
+    }
+
+    // Step 1: A recording of this query, or of all queries
+    QString name = text.toLower().replace(' ', '-').replace('/', '-');
+    response.body = recording("search/" + name + ".json");
+    if (response.body.isEmpty()) {
+        response.body = recording("search.json");
+    }
+    if (!response.body.isEmpty()) {
+        return response;
+    }
+
+    // Step 2: Generate the movie the query asks for, plus a sequel and an older
+    // namesake, so matching has something to choose from. Ids are stable per query.
+    QByteArray digest = QCryptographicHash::hash(text.toLower().toUtf8(), QCryptographicHash::Md5);
+    int id = static_cast<int>((static_cast<quint8>(digest.at(0)) << 16 | static_cast<quint8>(digest.at(1)) << 8
+                               | static_cast<quint8>(digest.at(2))) * 3 + 1);
+    int releaseYear = year > 0 ? year : 2000 + static_cast<quint8>(digest.at(3)) % 25;
+
+    auto movie = [](int id, const QString& title, int year, double popularity) {
+        QJsonObject object;
+        object.insert("id", id);
+        object.insert("title", title);
+        object.insert("original_title", title);
+        object.insert("release_date", QString("%1-06-15").arg(year));
+        object.insert("overview", QString("Generated by the TMDb stand-in server for \"%1\".").arg(title));
+        object.insert("poster_path", QString("/mock%1.jpg").arg(id));
+        object.insert("popularity", popularity);
+        return object;
+    };
+
+    QJsonArray results;
+    results.append(movie(id, text, releaseYear, 42.5));
+    results.append(movie(id + 1, text + " 2", releaseYear + 3, 17.25));
+    if (year == 0) {
+        results.append(movie(id + 2, text, releaseYear - 30, 3.5));
+    }
+    for (const QJsonValue& result : std::as_const(results)) {
+        m_generatedMovies.insert(result.toObject().value("id").toInt(), result.toObject());
+    }
+
+    QJsonObject root;
+    root.insert("page", 1);
+    root.insert("results", results);
+    root.insert("total_pages", 1);
+    root.insert("total_results", results.size());
+    response.body = QJsonDocument(root).toJson(QJsonDocument::Compact);
+    return response;
+}
+
+TmdbMockServer::Response TmdbMockServer::movieResponse(int id) const
+{
+    Response response;
+    response.body = recording(QString("movie/%1.json").arg(id));
+    if (!response.body.isEmpty()) {
+        return response;
+    }
+
+    // Only movies a search has handed out exist
+    auto generated = m_generatedMovies.constFind(id);
+    if (generated == m_generatedMovies.constEnd()) {
+        response.status = 404;
+        response.body = R"({"success":false,"status_code":34,"status_message":"The resource you requested could not be found."})";
+        return response;
+    }
+
+    // A typical feature length, stable per id
+    QJsonObject movie = *generated;
+    movie.insert("runtime", 85 + id % 70);
+
+    // Two genres and credits (append_to_response=credits) of typical size, also stable per id
+    const int genreCount = static_cast<int>(std::size(GENRES));
+    QJsonArray genres;
+    for (int i = 0; i < 2; ++i) {
+        const auto& genre = GENRES[(id + i * 4) % genreCount];
+        genres.append(QJsonObject{ { "id", genre.id }, { "name", QString::fromLatin1(genre.name) } });
+    }
+    movie.insert("genres", genres);
+
+    QJsonArray cast;
+    for (int i = 0; i < 20; ++i) {
+        cast.append(QJsonObject{ { "id", id * 100 + i }, { "name", QString("Actor %1-%2").arg(id).arg(i + 1) },
+                                 { "character", QString("Character %1").arg(i + 1) }, { "order", i } });
+    }
+    QJsonArray crew;
+    crew.append(QJsonObject{ { "id", id * 100 + 50 }, { "name", QString("Director %1").arg(id) },
+                             { "department", "Directing" }, { "job", "Director" } });
+    crew.append(QJsonObject{ { "id", id * 100 + 51 }, { "name", QString("Writer %1").arg(id) },
+                             { "department", "Writing" }, { "job", "Screenplay" } });
+    movie.insert("credits", QJsonObject{ { "cast", cast }, { "crew", crew } });
+
+    response.body = QJsonDocument(movie).toJson(QJsonDocument::Compact);
+    return response;
+}
+
+TmdbMockServer::Response TmdbMockServer::posterResponse(const QString& fileName)
+{
+    Response response;
+    response.contentType = "image/jpeg";
+    response.body = recording("posters/" + fileName);
+    if (response.body.isEmpty()) {
+        if (m_generatedPoster.isEmpty()) {
+            m_generatedPoster = generatePoster();
+        }
+        response.body = m_generatedPoster;
+    } else if (fileName.endsWith(".png", Qt::CaseInsensitive)) {
+        response.contentType = "image/png";
+    }
+    return response;
+}
+
+QByteArray TmdbMockServer::generatePoster()
+{
+    // w500 poster with some noise, so it compresses to a realistic size (~100 KiB)
+    QImage image(500, 750, QImage::Format_RGB32);
+    QRandomGenerator random(500750);
+    for (int y = 0; y < image.height(); ++y) {
+        QRgb *line = reinterpret_cast<QRgb*>(image.scanLine(y));
+        for (int x = 0; x < image.width(); ++x) {
+            int noise = static_cast<int>(random.bounded(48));
+            line[x] = qRgb((x * 255 / image.width() + noise) & 0xFF, (y * 255 / image.height() + noise) & 0xFF, 96 + noise);
+        }
+    }
+
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    image.save(&buffer, "JPEG", 85);
+    return data;
+}
+
+QByteArray TmdbMockServer::recording(const QString& relativePath) const
+{
+    if (m_recordingsDirectory.isEmpty()) {
+        return QByteArray();
+    }
+
+    QFile file(QDir(m_recordingsDirectory).filePath(relativePath));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+    return file.readAll();
+}
+
+void TmdbMockServer::send(QTcpSocket *socket, const Response& response)
+{
+    const char *reason = "OK";
+    switch (response.status) {
+    case 404: reason = "Not Found"; break;
+    case 405: reason = "Method Not Allowed"; break;
+    case 422: reason = "Unprocessable Entity"; break;
+    case 429: reason = "Too Many Requests"; break;
+    case 503: reason = "Service Unavailable"; break;
+    default: break;
+    }
+
+    QByteArray header = "HTTP/1.1 " + QByteArray::number(response.status) + ' ' + reason + "\r\n"
+                        + "Content-Type: " + response.contentType + "\r\n"
+                        + "Content-Length: " + QByteArray::number(response.body.size()) + "\r\n"
+                        + "Connection: keep-alive\r\n\r\n";
+    socket->write(header);
+    socket->write(response.body);
+}
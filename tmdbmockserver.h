@@ -0,0 +1,92 @@
+#ifndef TMDBMOCKSERVER_H
+#define TMDBMOCKSERVER_H
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+#include <QTcpServer>
+#include <QJsonObject>
+
+class QTcpSocket;
+class QUrlQuery;
+
+// Local stand-in for the TMDb API, so TmdbClient and the batch pipeline can be
+// benchmarked without network access or an api key. It answers /configuration,
+// /search/movie, /movie/{id} and poster downloads from recorded responses, and generates a
+// plausible answer where no recording exists. Every reply is delayed by a
+// random latency, and a share of the requests can be failed with 429/503.
+//
+// Only what TmdbClient sends is understood: GET requests without a body on
+// keep-alive connections.
+class TmdbMockServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TmdbMockServer(QObject *parent = nullptr);
+
+    // Directory with recorded responses:
+    //   configuration.json     - /configuration, the image urls are pointed at this server
+    //   search/<query>.json    - /search/movie for one query, lower case, spaces as '-'
+    //   search.json            - /search/movie for all other queries
+    //   movie/<id>.json        - /movie/{id}
+    //   posters/<file name>    - poster images
+    void setRecordingsDirectory(const QString& directory);
+
+    // Every reply waits a random time between minMs and maxMs
+    void setLatency(int minMs, int maxMs);
+
+    // Share of requests (0..1) answered with 429 or 503 instead
+    void setErrorRate(double rate);
+
+    bool listen(quint16 port = 0);
+    quint16 port() const;
+    QString errorString() const;
+
+    // For TmdbClient::setApiBaseUrl() or tmdb_api_base_url in config.ini
+    QString apiBaseUrl() const;
+
+    int requestCount() const;
+    int failedRequestCount() const;
+
+    // JPEG served for posters without a recording, a w500 poster of typical size
+    static QByteArray generatePoster();
+
+private:
+    struct Response {
+        int status = 200;
+        QByteArray contentType = "application/json;charset=utf-8";
+        QByteArray body;
+    };
+
+    void onNewConnection();
+    void onReadyRead(QTcpSocket *socket);
+    Response respond(const QByteArray& target);
+    Response configurationResponse() const;
+    Response searchResponse(const QUrlQuery& query) const;
+    Response movieResponse(int id) const;
+    Response posterResponse(const QString& fileName);
+    void send(QTcpSocket *socket, const Response& response);
+    QByteArray recording(const QString& relativePath) const;
+    QString imageBaseUrl() const;
+
+    QTcpServer m_server;
+    QString m_recordingsDirectory;
+    int m_minLatency = 0;
+    int m_maxLatency = 0;
+    double m_errorRate = 0;
+    int m_requestCount = 0;
+    int m_failedRequestCount = 0;
+
+    // Bytes received but not yet parsed, per connection
+    QHash<QTcpSocket*, QByteArray> m_buffers;
+
+    // Movies generated by searches, /movie/{id} answers with these plus a runtime, genres and credits
+    mutable QHash<int, QJsonObject> m_generatedMovies;
+
+    // Served for every poster without a recording, generated on first use
+    QByteArray m_generatedPoster;
+};
+
+#endif // TMDBMOCKSERVER_H
@@ -0,0 +1,200 @@
+#include "tmdbresponseparser.h"
+
+bool TmdbSearchParser::hasResults() const
+{
+    return m_hasResults;
+}
+
+const MovieResults& TmdbSearchParser::movies() const
+{
+    return m_movies;
+}
+
+int TmdbSearchParser::page() const
+{
+    return m_page;
+}
+
+int TmdbSearchParser::totalPages() const
+{
+    return m_totalPages;
+}
+
+bool TmdbSearchParser::isResult() const
+{
+    // root object > "results" array > result object
+    return depth() == 2 && keyAt(0) == "results";
+}
+
+void TmdbSearchParser::startObject()
+{
+    if (isResult()) {
+        m_current = MovieResult();
+    }
+}
+
+void TmdbSearchParser::endObject()
+{
+    if (isResult()) {
+        m_movies.append(m_current);
+    }
+}
+
+void TmdbSearchParser::startArray()
+{
+    if (depth() == 1 && key() == "results") {
+        m_hasResults = true;
+    }
+}
+
+void TmdbSearchParser::value(const QJsonValue& value)
+{
+    if (depth() == 1) {
+        if (key() == "page") {
+            m_page = value.toInt();
+        } else if (key() == "total_pages") {
+            m_totalPages = value.toInt();
+        }
+        return;
+    }
+
+    // Fields of a result, anything nested deeper (genre_ids) is skipped
+    if (depth() != 3 || keyAt(0) != "results") {
+        return;
+    }
+
+    QString field = key();
+    if (field == "id") {
+        m_current.id = value.toInt();
+    } else if (field == "title") {
+        m_current.title = value.toString();
+    } else if (field == "release_date") {
+        // "YYYY-MM-DD", often empty for unreleased movies
+        m_current.year = value.toString().left(4).toInt();
+    } else if (field == "overview") {
+        m_current.overview = value.toString();
+    } else if (field == "poster_path") {
+        m_current.posterPath = value.toString();  // null becomes empty
+    } else if (field == "original_title") {
+        m_current.originalTitle = value.toString();
+    } else if (field == "popularity") {
+        m_current.popularity = value.toDouble();
+    }
+}
+
+bool TmdbMovieDetailsParser::hasMovie() const
+{
+    return m_movie.id > 0;
+}
+
+const MovieResult& TmdbMovieDetailsParser::movie() const
+{
+    return m_movie;
+}
+
+bool TmdbMovieDetailsParser::isCrewMember() const
+{
+    // root object > "credits" object > "crew" array > crew member object
+    return depth() == 3 && keyAt(0) == "credits" && keyAt(1) == "crew";
+}
+
+void TmdbMovieDetailsParser::startObject()
+{
+    if (isCrewMember()) {
+        m_crewName.clear();
+        m_crewJob.clear();
+    }
+}
+
+void TmdbMovieDetailsParser::endObject()
+{
+    if (isCrewMember() && m_crewJob == "Director" && !m_crewName.isEmpty()) {
+        m_movie.directors.append(m_crewName);
+    }
+}
+
+void TmdbMovieDetailsParser::value(const QJsonValue& value)
+{
+    // Names of genres and cast members, the cast is sorted by billing order
+    if (depth() == 3 && keyAt(0) == "genres" && key() == "name") {
+        m_movie.genres.append(value.toString());
+        return;
+    }
+    if (depth() == 4 && keyAt(0) == "credits") {
+        if (keyAt(1) == "cast" && key() == "name") {
+            m_movie.cast.append(value.toString());
+        } else if (keyAt(1) == "crew" && key() == "name") {
+            m_crewName = value.toString();
+        } else if (keyAt(1) == "crew" && key() == "job") {
+            m_crewJob = value.toString();
+        }
+        return;
+    }
+
+    // Other top-level fields, production companies etc. are nested deeper
+    if (depth() != 1) {
+        return;
+    }
+
+    QString field = key();
+    if (field == "id") {
+        m_movie.id = value.toInt();
+    } else if (field == "title") {
+        m_movie.title = value.toString();
+    } else if (field == "original_title") {
+        m_movie.originalTitle = value.toString();
+    } else if (field == "release_date") {
+        m_movie.year = value.toString().left(4).toInt();
+    } else if (field == "overview") {
+        m_movie.overview = value.toString();
+    } else if (field == "poster_path") {
+        m_movie.posterPath = value.toString();
+    } else if (field == "popularity") {
+        m_movie.popularity = value.toDouble();
+    } else if (field == "runtime") {
+        m_movie.runtime = value.toInt();  // null for unreleased movies
+    }
+}
+
+bool TmdbConfigurationParser::hasImages() const
+{
+    return m_hasImages;
+}
+
+bool TmdbConfigurationParser::hasPosterSizes() const
+{
+    return m_hasPosterSizes;
+}
+
+QString TmdbConfigurationParser::secureBaseUrl() const
+{
+    return m_secureBaseUrl;
+}
+
+QStringList TmdbConfigurationParser::posterSizes() const
+{
+    return m_posterSizes;
+}
+
+void TmdbConfigurationParser::startObject()
+{
+    if (depth() == 1 && key() == "images") {
+        m_hasImages = true;
+    }
+}
+
+void TmdbConfigurationParser::startArray()
+{
+    if (depth() == 2 && keyAt(0) == "images" && key() == "poster_sizes") {
+        m_hasPosterSizes = true;
+    }
+}
+
+void TmdbConfigurationParser::value(const QJsonValue& value)
+{
+    if (depth() == 2 && keyAt(0) == "images" && key() == "secure_base_url") {
+        m_secureBaseUrl = value.toString();
+    } else if (depth() == 3 && keyAt(0) == "images" && keyAt(1) == "poster_sizes") {
+        m_posterSizes.append(value.toString());
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef TMDBRESPONSEPARSER_H
+#define TMDBRESPONSEPARSER_H
+
+#include <QString>
+#include <QStringList>
+#include "jsonstreamreader.h"
+#include "movieresult.h"
+
+// Incremental parser of a /search/movie response, results are filled as the data arrives
+class TmdbSearchParser : public JsonStreamReader
+{
+public:
+    // False if the response had no "results" array
+    bool hasResults() const;
+    const MovieResults& movies() const;
+    // 0 if the response didn't say
+    int page() const;
+    int totalPages() const;
+
+protected:
+    void startObject() override;
+    void endObject() override;
+    void startArray() override;
+    void value(const QJsonValue& value) override;
+
+private:
+    bool isResult() const;
+
+    bool m_hasResults = false;
+    MovieResults m_movies;
+    MovieResult m_current;
+    int m_page = 0;
+    int m_totalPages = 0;
+};
+
+// Incremental parser of a /movie/{id}?append_to_response=credits response
+class TmdbMovieDetailsParser : public JsonStreamReader
+{
+public:
+    // False if the response had no movie id
+    bool hasMovie() const;
+    const MovieResult& movie() const;
+
+protected:
+    void startObject() override;
+    void endObject() override;
+    void value(const QJsonValue& value) override;
+
+private:
+    bool isCrewMember() const;
+
+    MovieResult m_movie;
+    // Fields of the crew member being read, they come in any order
+    QString m_crewName;
+    QString m_crewJob;
+};
+
+// Incremental parser of a /configuration response, only the image settings are kept
+class TmdbConfigurationParser : public JsonStreamReader
+{
+public:
+    bool hasImages() const;
+    bool hasPosterSizes() const;
+    QString secureBaseUrl() const;
+    QStringList posterSizes() const;
+
+protected:
+    void startObject() override;
+    void startArray() override;
+    void value(const QJsonValue& value) override;
+
+private:
+    bool m_hasImages = false;
+    bool m_hasPosterSizes = false;
+    QString m_secureBaseUrl;
+    QStringList m_posterSizes;
+};
+
+#endif // TMDBRESPONSEPARSER_H
@@ -0,0 +1,221 @@
+#include "writejournal.h"
+#include <QFileInfo>
+#include <QDir>
+#include <QList>
+#include <QCryptographicHash>
+#include <QtEndian>
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Journal layout: magic, original file size, then one record per saved region:
+// offset (8), length (8), the saved bytes and a SHA-1 over all three. A record
+// cut short by a crash fails its checksum; its region was never written.
+static const QByteArray JOURNAL_MAGIC = "MTJ1";
+static const int RECORD_HEADER_SIZE = 16;
+static const int RECORD_CHECKSUM_SIZE = 20;
+
+static QByteArray encodeInt64(qint64 value)
+{
+    QByteArray data(8, '\0');
+    qToBigEndian<qint64>(value, data.data());
+    return data;
+}
+
+static qint64 decodeInt64(const QByteArray& data, qint64 pos)
+{
+    return qFromBigEndian<qint64>(data.constData() + pos);
+}
+
+WriteJournal::WriteJournal(const QString& filePath)
+    : m_filePath(filePath)
+    , m_journal(journalPath(filePath))
+{
+}
+
+WriteJournal::~WriteJournal()
+{
+    // An uncommitted journal stays on disk, recover() rolls the file back
+    m_journal.close();
+}
+
+QString WriteJournal::journalPath(const QString& filePath)
+{
+    QFileInfo fileInfo(filePath);
+    return fileInfo.absolutePath() + "/." + fileInfo.fileName() + ".movietag-journal";
+}
+
+QString WriteJournal::errorString() const
+{
+    return m_errorString;
+}
+
+bool WriteJournal::fail(const QString& message)
+{
+    m_errorString = message;
+    return false;
+}
+
+bool WriteJournal::begin(qint64 originalSize)
+{
+    m_originalSize = originalSize;
+
+    if (!m_journal.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return fail(QString("Can't create write journal: %1").arg(m_journal.errorString()));
+    }
+
+    // The journal must exist on disk before the first byte of the file changes
+    if (m_journal.write(JOURNAL_MAGIC + encodeInt64(originalSize)) != JOURNAL_MAGIC.size() + 8
+        || !syncFile(m_journal) || !syncDirectory(QFileInfo(m_filePath).absolutePath())) {
+        return fail(QString("Can't write journal: %1").arg(m_journal.errorString()));
+    }
+    return true;
+}
+
+bool WriteJournal::saveRegion(QFile& file, qint64 offset, qint64 length)
+{
+    if (!m_journal.isOpen()) {
+        return fail("Write journal not started");
+    }
+
+    // Bytes beyond the original end don't need saving, rollback truncates them
+    qint64 end = qMin(offset + length, m_originalSize);
+    if (end <= offset) {
+        return true;
+    }
+
+    if (!file.seek(offset)) {
+        return fail(QString("Can't read region to journal: %1").arg(file.errorString()));
+    }
+    QByteArray original = file.read(end - offset);
+    if (original.size() != end - offset) {
+        return fail("Short read while journaling");
+    }
+
+    QByteArray record = encodeInt64(offset) + encodeInt64(original.size()) + original;
+    record += QCryptographicHash::hash(record, QCryptographicHash::Sha1);
+    if (m_journal.write(record) != record.size() || !syncFile(m_journal)) {
+        return fail(QString("Can't write journal: %1").arg(m_journal.errorString()));
+    }
+    return true;
+}
+
+bool WriteJournal::commit(QFile& file)
+{
+    if (!syncFile(file)) {
+        return fail(QString("Can't sync file: %1").arg(file.errorString()));
+    }
+
+    m_journal.close();
+    if (!m_journal.remove()) {
+        return fail(QString("Can't remove write journal: %1").arg(m_journal.errorString()));
+    }
+    syncDirectory(QFileInfo(m_filePath).absolutePath());
+    return true;
+}
+
+bool WriteJournal::recover(const QString& filePath, QString *errorString)
+{
+    auto failRecovery = [errorString](const QString& message) {
+        if (errorString) {
+            *errorString = message;
+        }
+        return false;
+    };
+
+    QFile journal(journalPath(filePath));
+    if (!journal.exists()) {
+        return true;
+    }
+    if (!journal.open(QIODevice::ReadOnly)) {
+        return failRecovery(QString("Can't read write journal: %1").arg(journal.errorString()));
+    }
+    QByteArray data = journal.readAll();
+    journal.close();
+
+    // Step 1: Without a complete header nothing was written yet
+    if (data.size() < JOURNAL_MAGIC.size() + 8 || !data.startsWith(JOURNAL_MAGIC)) {
+        journal.remove();
+        return true;
+    }
+    qint64 originalSize = decodeInt64(data, JOURNAL_MAGIC.size());
+
+    // Step 2: Collect the complete records
+    struct Region {
+        qint64 offset;
+        QByteArray bytes;
+    };
+    QList<Region> regions;
+    qint64 pos = JOURNAL_MAGIC.size() + 8;
+    while (pos + RECORD_HEADER_SIZE <= data.size()) {
+        qint64 offset = decodeInt64(data, pos);
+        qint64 length = decodeInt64(data, pos + 8);
+        qint64 recordSize = RECORD_HEADER_SIZE + length;
+        if (offset < 0 || length < 0 || pos + recordSize + RECORD_CHECKSUM_SIZE > data.size()) {
+            break;
+        }
+        if (QCryptographicHash::hash(data.mid(pos, recordSize), QCryptographicHash::Sha1)
+            != data.mid(pos + recordSize, RECORD_CHECKSUM_SIZE)) {
+            break;
+        }
+        regions.append(Region{ offset, data.mid(pos + RECORD_HEADER_SIZE, length) });
+        pos += recordSize + RECORD_CHECKSUM_SIZE;
+    }
+
+    // Step 3: Restore newest first, so a region saved twice ends up with its oldest content
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadWrite)) {
+        return failRecovery(QString("Can't open %1 to roll back: %2").arg(filePath, file.errorString()));
+    }
+    for (qsizetype i = regions.size() - 1; i >= 0; --i) {
+        const Region& region = regions.at(i);
+        if (!file.seek(region.offset) || file.write(region.bytes) != region.bytes.size()) {
+            return failRecovery(QString("Rolling back %1 failed: %2").arg(filePath, file.errorString()));
+        }
+    }
+    if (file.size() != originalSize && !file.resize(originalSize)) {
+        return failRecovery(QString("Rolling back %1 failed: %2").arg(filePath, file.errorString()));
+    }
+    if (!syncFile(file)) {
+        return failRecovery(QString("Can't sync %1: %2").arg(filePath, file.errorString()));
+    }
+    file.close();
+
+    // Step 4: The file is consistent again, the journal has done its job
+    journal.remove();
+    syncDirectory(QFileInfo(filePath).absolutePath());
+    return true;
+}
+
+bool WriteJournal::syncFile(QFile& file)
+{
+    if (!file.flush()) {
+        return false;
+    }
+#ifdef Q_OS_WIN
+    return _commit(file.handle()) == 0;
+#else
+    return ::fsync(file.handle()) == 0;
+#endif
+}
+
+bool WriteJournal::syncDirectory(const QString& directoryPath)
+{
+#ifdef Q_OS_WIN
+    // NTFS journals directory entries itself
+    Q_UNUSED(directoryPath)
+    return true;
+#else
+    int fd = ::open(QFile::encodeName(directoryPath).constData(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#endif
+}
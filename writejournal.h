@@ -0,0 +1,52 @@
+#ifndef WRITEJOURNAL_H
+#define WRITEJOURNAL_H
+
+#include <QString>
+#include <QByteArray>
+#include <QFile>
+
+// Undo journal for in-place edits of a movie file.
+//
+// Before a region of the file is overwritten, its current bytes are appended to
+// a small journal next to the file (.<name>.movietag-journal) and synced to disk.
+// commit() syncs the file and deletes the journal. If the process dies in
+// between, recover() copies the saved bytes back and truncates the file to its
+// original size, so the file is either fully written or untouched. Only the
+// overwritten regions are journaled, never the whole file.
+class WriteJournal
+{
+public:
+    explicit WriteJournal(const QString& filePath);
+    ~WriteJournal();
+
+    static QString journalPath(const QString& filePath);
+
+    // Create the journal, originalSize is the file size before any write
+    bool begin(qint64 originalSize);
+
+    // Save the current content of file at offset..offset+length, call before writing there
+    bool saveRegion(QFile& file, qint64 offset, qint64 length);
+
+    // Sync file and remove the journal, the write is final
+    bool commit(QFile& file);
+
+    QString errorString() const;
+
+    // Roll back an interrupted write of filePath, true if there was nothing to do or it succeeded
+    static bool recover(const QString& filePath, QString *errorString = nullptr);
+
+    // Flush Qt's buffer and the OS cache of file to the disk
+    static bool syncFile(QFile& file);
+    // Make creating, renaming or removing entries of directoryPath durable
+    static bool syncDirectory(const QString& directoryPath);
+
+private:
+    bool fail(const QString& message);
+
+    QString m_filePath;
+    QFile m_journal;
+    qint64 m_originalSize = 0;
+    QString m_errorString;
+};
+
+#endif // WRITEJOURNAL_H